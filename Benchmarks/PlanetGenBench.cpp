@@ -0,0 +1,522 @@
+// Benchmarks of the generation and I/O hot paths of PlanetGen.
+// Every case runs with fixed seeds, after warmup runs, and reports statistics
+// over its repetitions. Parallel cases are swept over thread counts to give
+// their scaling. Results can be saved as JSON and compared to a baseline.
+// With PLANETGEN_MEMORY_TRACKING, the heap allocations of every run are
+// counted, and the cases that must not allocate once warm fail the run.
+// With --counters, the hardware counters of the runs are reported on Linux.
+// The cube sphere and icosphere meshes are compared first, at equal vertex counts.
+//
+// Usage: PlanetGenBench [--filter text] [--reps N] [--warmup N] [--threads 1,2,4] [--quick]
+//                       [--counters] [--json out.json] [--baseline base.json] [--tolerance 0.1]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stb_image_write.h>
+
+#include "IO.h"
+#include "MemoryTracker.h"
+#include "Mesh.h"
+#include "PerfCounters.h"
+#include "TaskScheduler.h"
+#include "TextureCompressor.h"
+#include "TileCache.h"
+#include "WorldGen.h"
+
+namespace {
+
+const int Seed = 1337;
+
+struct Options {
+	std::string filter;
+	int reps = 10;
+	int warmup = 2;
+	std::vector<int> threads;
+	bool quick = false;
+	bool counters = false;
+	std::string json;
+	std::string baseline;
+	double tolerance = 0.10;
+};
+
+struct Result {
+	std::string name;
+	int threads = 1;
+	size_t items = 0;	// Processed per run: vertices, pixels or lookups
+	double minMs = 0.0;
+	double medianMs = 0.0;
+	double meanMs = 0.0;
+	double stddevMs = 0.0;
+	double allocationsPerRun = 0.0;	// Heap allocations of all threads, when tracked
+	PerfCounterValues counters;		// Per run, with --counters
+
+	std::string key() const { return name + "/t" + std::to_string(threads); }
+	double itemsPerSecond() const { return medianMs > 0.0 ? items / (medianMs / 1000.0) : 0.0; }
+};
+
+volatile size_t sink = 0;	// Keeps the results of the runs alive
+
+void setThreads(int threads) { TaskScheduler::setThreadCount(threads); }
+
+int maxThreads() {
+	return TaskScheduler::hardwareThreads();
+}
+
+// Heap allocations a case is allowed once warm
+enum class Allocations { Any, None };
+
+class Bench {
+   public:
+	explicit Bench(const Options& options) : _options(options) {}
+
+	// Parallel cases run once per thread count, the others with a single thread
+	void run(const std::string& name, bool parallel, size_t items, const std::function<void()>& body,
+			 Allocations allowed = Allocations::Any) {
+		if (!_options.filter.empty() && name.find(_options.filter) == std::string::npos) return;
+		const std::vector<int> threadCounts = parallel ? _options.threads : std::vector<int>{1};
+		for (int threads : threadCounts) {
+			setThreads(threads);
+			for (int i = 0; i < _options.warmup; i++) body();
+
+			std::vector<double> times;
+			times.reserve(_options.reps);
+			const size_t allocationsBefore = MemoryTracker::cpuTotal().totalAllocations;
+			const PerfCounterValues countersBefore = PerfCounters::read();
+			for (int i = 0; i < _options.reps; i++) {
+				auto start = std::chrono::steady_clock::now();
+				body();
+				times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+									.count());
+			}
+			const PerfCounterValues counters = PerfCounters::read() - countersBefore;
+			const size_t allocations = MemoryTracker::cpuTotal().totalAllocations - allocationsBefore;
+			Result result = summarize(name, threads, items, times);
+			result.allocationsPerRun = double(allocations) / _options.reps;
+			result.counters = counters;
+			for (uint64_t& value : result.counters.values) value /= uint64_t(_options.reps);
+			report(result, allowed == Allocations::None && allocations > 0);
+		}
+		setThreads(maxThreads());
+	}
+
+	const std::vector<Result>& results() const { return _results; }
+	// Cases that allocated while they must not
+	int allocationFailures() const { return _allocationFailures; }
+
+   private:
+	static Result summarize(const std::string& name, int threads, size_t items, std::vector<double> times) {
+		std::sort(times.begin(), times.end());
+		Result result;
+		result.name = name;
+		result.threads = threads;
+		result.items = items;
+		result.minMs = times.front();
+		result.medianMs = times.size() % 2 ? times[times.size() / 2]
+										   : 0.5 * (times[times.size() / 2 - 1] + times[times.size() / 2]);
+		for (double t : times) result.meanMs += t / times.size();
+		for (double t : times) result.stddevMs += (t - result.meanMs) * (t - result.meanMs) / times.size();
+		result.stddevMs = std::sqrt(result.stddevMs);
+		return result;
+	}
+
+	void report(const Result& result, bool allocationFailure) {
+		// Speedup against the single thread run of the same case
+		double speedup = 1.0;
+		for (const Result& other : _results)
+			if (other.name == result.name && other.threads == 1) speedup = other.medianMs / result.medianMs;
+		std::printf("%-44s t=%-3d median %9.3f ms  min %9.3f  sd %7.3f  %10.2f Mitems/s  x%.2f",
+					result.name.c_str(), result.threads, result.medianMs, result.minMs, result.stddevMs,
+					result.itemsPerSecond() / 1e6, speedup);
+		if (MemoryTracker::tracksCPU()) std::printf("  %8.1f allocs/run", result.allocationsPerRun);
+		std::printf(allocationFailure ? "  ALLOCATES\n" : "\n");
+		if (PerfCounters::enabled()) {
+			const PerfCounterValues& c = result.counters;
+			const double cyclesPerItem = result.items ? double(c[HardwareCounter::Cycles]) / result.items : 0.0;
+			std::printf("%-44s       %6.2f IPC  %9.1f cycles/item  %7.2f cache misses/kI  %7.2f branch misses/kI\n",
+						"", c.instructionsPerCycle(), cyclesPerItem, c.perKiloInstruction(HardwareCounter::CacheMisses),
+						c.perKiloInstruction(HardwareCounter::BranchMisses));
+		}
+		std::fflush(stdout);
+		_allocationFailures += allocationFailure;
+		_results.push_back(result);
+	}
+
+	const Options& _options;
+	std::vector<Result> _results;
+	int _allocationFailures = 0;
+};
+
+// RGB8 picture of the planet heights, compressible like a real map tile
+std::vector<uint8_t> makeImage(const WorldGen& worldGen, int size) {
+	std::vector<float> xs, ys, zs;
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			glm::vec3 p = glm::normalize(glm::vec3(2.0f * x / size - 1.0f, 2.0f * y / size - 1.0f, 1.0f));
+			xs.push_back(p.x);
+			ys.push_back(p.y);
+			zs.push_back(p.z);
+		}
+	}
+	std::vector<float> heights(xs.size());
+	worldGen.getHeights(xs.data(), ys.data(), zs.data(), int(xs.size()), heights.data());
+
+	std::vector<uint8_t> rgb;
+	rgb.reserve(heights.size() * 3);
+	for (size_t i = 0; i < heights.size(); i++) {
+		glm::vec3 pos = glm::vec3(xs[i], ys[i], zs[i]) * heights[i];
+		glm::vec3 color = worldGen.getBiomeColor(pos, glm::normalize(pos));
+		for (int c = 0; c < 3; c++) rgb.push_back(uint8_t(glm::clamp(color[c], 0.0f, 1.0f) * 255.0f));
+	}
+	return rgb;
+}
+
+std::vector<unsigned char> encodePNG(int size, const std::vector<uint8_t>& rgb) {
+	std::vector<unsigned char> png;
+	stbi_write_png_to_func(
+		[](void* context, void* data, int bytes) {
+			auto* out = static_cast<std::vector<unsigned char>*>(context);
+			out->insert(out->end(), static_cast<unsigned char*>(data), static_cast<unsigned char*>(data) + bytes);
+		},
+		&png, size, size, 3, rgb.data(), size * 3);
+	return png;
+}
+
+// Icosphere frequency with about as many vertices as the cube sphere
+int matchingFrequency(int subdivisions) {
+	return std::max(1, int(std::lround(std::sqrt((WorldGen::sphereVertexCount(subdivisions) - 2) / 10.0))));
+}
+
+struct MeshShape {
+	double minEdge = 1e30, maxEdge = 0.0;
+	double minArea = 1e30, maxArea = 0.0;
+};
+
+// Edges and triangle areas on the unit sphere, whatever the heights
+MeshShape measureShape(const std::vector<glm::vec3>& vertices, const std::vector<glm::uvec3>& indices) {
+	MeshShape shape;
+	for (const glm::uvec3& triangle : indices) {
+		const glm::vec3 a = glm::normalize(vertices[triangle.x]);
+		const glm::vec3 b = glm::normalize(vertices[triangle.y]);
+		const glm::vec3 c = glm::normalize(vertices[triangle.z]);
+		for (double edge : {glm::length(b - a), glm::length(c - b), glm::length(a - c)}) {
+			shape.minEdge = std::min(shape.minEdge, edge);
+			shape.maxEdge = std::max(shape.maxEdge, edge);
+		}
+		const double area = 0.5 * glm::length(glm::cross(b - a, c - a));
+		shape.minArea = std::min(shape.minArea, area);
+		shape.maxArea = std::max(shape.maxArea, area);
+	}
+	return shape;
+}
+
+// Cube sphere against icosphere at equal vertex counts. The longest edge bounds
+// the geometric error of the planet surface: at equal longest edge, the
+// icosphere needs (ico edge / cube edge)^2 as many vertices.
+void compareSphereMeshes(const Options& options) {
+	const std::string name = "WorldGen::generateIcosphereMesh";
+	if (!options.filter.empty() && name.find(options.filter) == std::string::npos) return;
+	WorldGen worldGen(Seed);
+	std::printf("%-22s %10s %10s %10s %12s %12s\n", "Sphere mesh", "vertices", "max edge", "edge ratio",
+				"area ratio", "vertices at");
+	std::printf("%-22s %10s %10s %10s %12s %12s\n", "", "", "", "max/min", "max/min", "equal edge");
+	const std::vector<int> sweep = options.quick ? std::vector<int>{16, 64} : std::vector<int>{16, 32, 64, 128};
+	for (int subdivisions : sweep) {
+		std::vector<glm::vec3> vertices;
+		std::vector<glm::uvec3> indices;
+		worldGen.generateSphereMesh(subdivisions, vertices, indices);
+		const MeshShape cube = measureShape(vertices, indices);
+		const size_t cubeVertices = vertices.size();
+
+		const int frequency = matchingFrequency(subdivisions);
+		vertices.clear();
+		indices.clear();
+		worldGen.generateIcosphereMesh(frequency, vertices, indices);
+		const MeshShape ico = measureShape(vertices, indices);
+		const double equalEdge = (ico.maxEdge / cube.maxEdge) * (ico.maxEdge / cube.maxEdge);
+
+		std::printf("%-22s %10zu %10.5f %10.2f %12.2f %12s\n", ("cube/" + std::to_string(subdivisions)).c_str(),
+					cubeVertices, cube.maxEdge, cube.maxEdge / cube.minEdge, cube.maxArea / cube.minArea, "1.00");
+		std::printf("%-22s %10zu %10.5f %10.2f %12.2f %12.2f\n", ("icosphere/" + std::to_string(frequency)).c_str(),
+					vertices.size(), ico.maxEdge, ico.maxEdge / ico.minEdge, ico.maxArea / ico.minArea, equalEdge);
+	}
+	std::printf("\n");
+}
+
+void benchWorldGen(Bench& bench, const Options& options) {
+	WorldGen worldGen(Seed);
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::uvec3> indices;
+	std::vector<glm::vec2> positions2D;
+
+	const std::vector<int> sphereSweep = options.quick ? std::vector<int>{16, 64} : std::vector<int>{16, 64, 192};
+	for (int subdivisions : sphereSweep) {
+		bench.run("WorldGen::generateSphereMesh/" + std::to_string(subdivisions), true,
+				  WorldGen::sphereVertexCount(subdivisions), [&] {
+					  vertices.clear();
+					  indices.clear();
+					  worldGen.generateSphereMesh(subdivisions, vertices, indices);
+					  sink = sink + vertices.size();
+				  },
+				  Allocations::None);
+	}
+
+	// At the vertex counts of the cube spheres above
+	for (int subdivisions : sphereSweep) {
+		const int frequency = matchingFrequency(subdivisions);
+		bench.run("WorldGen::generateIcosphereMesh/" + std::to_string(frequency), true,
+				  WorldGen::icosphereVertexCount(frequency), [&] {
+					  vertices.clear();
+					  indices.clear();
+					  worldGen.generateIcosphereMesh(frequency, vertices, indices);
+					  sink = sink + vertices.size();
+				  },
+				  Allocations::None);
+	}
+
+	const std::vector<int> tileSweep = options.quick ? std::vector<int>{4, 6} : std::vector<int>{4, 6, 8};
+	for (int zoom : tileSweep) {
+		const size_t side = (size_t(1) << zoom) + 1;
+		bench.run("WorldGen::generateMercatorTileMesh/" + std::to_string(zoom), false, side * side, [&] {
+			positions2D.clear();
+			vertices.clear();
+			indices.clear();
+			worldGen.generateMercatorTileMesh(zoom, positions2D, vertices, indices);
+			sink = sink + vertices.size();
+		}, Allocations::None);
+	}
+}
+
+void benchMesh(Bench& bench, const Options& options) {
+	WorldGen worldGen(Seed);
+	const std::vector<int> sweep = options.quick ? std::vector<int>{6} : std::vector<int>{6, 8};
+	for (int zoom : sweep) {
+		Mesh mesh;
+		worldGen.generateMercatorTileMesh(zoom, mesh.texCoords(), mesh.positions(), mesh.indices());
+		bench.run("Mesh::recomputePerVertexNormals/" + std::to_string(zoom), true, mesh.positions().size(), [&] {
+			mesh.recomputePerVertexNormals();
+			sink = sink + mesh.normals().size();
+		}, Allocations::None);
+	}
+}
+
+void benchIO(Bench& bench, const Options& options) {
+	WorldGen worldGen(Seed);
+	const std::vector<int> sweep = options.quick ? std::vector<int>{256} : std::vector<int>{256, 512};
+	for (int size : sweep) {
+		const std::vector<unsigned char> png = encodePNG(size, makeImage(worldGen, size));
+		bench.run("IO::decodePNG/" + std::to_string(size), false, size_t(size) * size, [&] {
+			int width, height;
+			std::vector<unsigned char> pixels;
+			IO::decodePNG(png, width, height, pixels);
+			sink = sink + pixels.size();
+		});
+	}
+
+	const int ppmSize = 256;
+	std::vector<glm::vec3> pixels;
+	const std::vector<uint8_t> rgb = makeImage(worldGen, ppmSize);
+	for (size_t i = 0; i < rgb.size(); i += 3) pixels.push_back(glm::vec3(rgb[i], rgb[i + 1], rgb[i + 2]) / 255.0f);
+	const std::string ppm = (std::filesystem::temp_directory_path() / "PlanetGenBench.ppm").string();
+	bench.run("IO::savePPM/" + std::to_string(ppmSize), false, pixels.size(),
+			  [&] { IO::savePPM(ppm, ppmSize, ppmSize, pixels); });
+	std::filesystem::remove(ppm);
+}
+
+void benchTileCache(Bench& bench, const Options& options) {
+	WorldGen worldGen(Seed);
+
+	// Miss path: the tile is compressed before entering the cache
+	const std::vector<int> sweep = options.quick ? std::vector<int>{256} : std::vector<int>{256, 512};
+	for (int size : sweep) {
+		const std::vector<uint8_t> rgb = makeImage(worldGen, size);
+		bench.run("TextureCompressor::encodeBC1/" + std::to_string(size), true, size_t(size) * size, [&] {
+			CompressedTexture texture = TextureCompressor::encodeBC1(size, size, rgb);
+			sink = sink + texture.bytes();
+		});
+	}
+
+	auto texture = std::make_shared<CompressedTexture>(TextureCompressor::encodeBC1(256, 256, makeImage(worldGen, 256)));
+	const int tiles = 4096;
+	std::vector<glm::ivec3> keys;
+	std::mt19937 rng(Seed);
+	for (int i = 0; i < tiles; i++) {
+		int z = int(rng() % 16);
+		keys.push_back({z, int(rng() % (1u << z)), int(rng() % (1u << z))});
+	}
+
+	// Large enough for every tile, so that the hit path does not measure misses
+	TileCache cache(size_t(tiles) * texture->bytes());
+	bench.run("TileCache::put/" + std::to_string(tiles), false, tiles, [&] {
+		cache.clear();
+		for (const glm::ivec3& key : keys) cache.put(key.x, key.y, key.z, texture);
+		sink = sink + cache.size();
+	});
+	// Hit path, in a different order than the insertions
+	std::vector<glm::ivec3> lookups = keys;
+	std::shuffle(lookups.begin(), lookups.end(), rng);
+	bench.run("TileCache::get/" + std::to_string(tiles), false, tiles, [&] {
+		size_t hits = 0;
+		for (const glm::ivec3& key : lookups) hits += cache.get(key.x, key.y, key.z) != nullptr;
+		sink = sink + hits;
+	});
+}
+
+bool writeJSON(const std::string& filename, const Options& options, const std::vector<Result>& results) {
+	std::ofstream out(filename);
+	if (!out) return false;
+	out << "{\n  \"benchmark\": \"PlanetGenBench\",\n  \"seed\": " << Seed << ",\n  \"reps\": " << options.reps
+		<< ",\n  \"warmup\": " << options.warmup << ",\n  \"max_threads\": " << maxThreads()
+		<< ",\n  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++) {
+		const Result& r = results[i];
+		// One result per line, read back by readBaseline
+		out << "    {\"key\": \"" << r.key() << "\", \"name\": \"" << r.name << "\", \"threads\": " << r.threads
+			<< ", \"items\": " << r.items << ", \"median_ms\": " << r.medianMs << ", \"min_ms\": " << r.minMs
+			<< ", \"mean_ms\": " << r.meanMs << ", \"stddev_ms\": " << r.stddevMs
+			<< ", \"items_per_s\": " << r.itemsPerSecond() << ", \"allocs_per_run\": " << r.allocationsPerRun;
+		if (PerfCounters::enabled()) {
+			const PerfCounterValues& c = r.counters;
+			out << ", \"cycles\": " << c[HardwareCounter::Cycles]
+				<< ", \"instructions\": " << c[HardwareCounter::Instructions] << ", \"cache_misses\": " << c[HardwareCounter::CacheMisses]
+				<< ", \"branch_misses\": " << c[HardwareCounter::BranchMisses];
+		}
+		out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "  ]\n}\n";
+	return bool(out);
+}
+
+// Median times by key, from a file written by writeJSON
+std::map<std::string, double> readBaseline(const std::string& filename) {
+	std::map<std::string, double> medians;
+	std::ifstream in(filename);
+	std::string line;
+	while (std::getline(in, line)) {
+		size_t key = line.find("\"key\": \"");
+		size_t median = line.find("\"median_ms\": ");
+		if (key == std::string::npos || median == std::string::npos) continue;
+		key += 8;
+		medians[line.substr(key, line.find('"', key) - key)] = std::stod(line.substr(median + 13));
+	}
+	return medians;
+}
+
+// Returns the number of regressions
+int compare(const std::vector<Result>& results, const std::map<std::string, double>& baseline, double tolerance) {
+	int regressions = 0;
+	std::printf("\nComparison with the baseline (tolerance %.0f%%)\n", tolerance * 100.0);
+	for (const Result& result : results) {
+		auto base = baseline.find(result.key());
+		if (base == baseline.end()) {
+			std::printf("%-50s new\n", result.key().c_str());
+			continue;
+		}
+		const double ratio = result.medianMs / base->second;
+		const char* verdict = ratio > 1.0 + tolerance ? "REGRESSION" : ratio < 1.0 - tolerance ? "improved" : "";
+		if (ratio > 1.0 + tolerance) regressions++;
+		std::printf("%-50s %9.3f -> %9.3f ms  %+6.1f%%  %s\n", result.key().c_str(), base->second, result.medianMs,
+					(ratio - 1.0) * 100.0, verdict);
+	}
+	return regressions;
+}
+
+std::vector<int> parseThreads(const std::string& list) {
+	std::vector<int> threads;
+	std::stringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ','))
+		if (!item.empty()) threads.push_back(std::max(1, std::stoi(item)));
+	return threads;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+	Options options;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--quick") {
+			options.quick = true;
+			options.reps = 3;
+			options.warmup = 1;
+		} else if (arg == "--filter" && hasValue) {
+			options.filter = argv[++i];
+		} else if (arg == "--reps" && hasValue) {
+			options.reps = std::max(1, std::stoi(argv[++i]));
+		} else if (arg == "--warmup" && hasValue) {
+			options.warmup = std::max(0, std::stoi(argv[++i]));
+		} else if (arg == "--threads" && hasValue) {
+			options.threads = parseThreads(argv[++i]);
+		} else if (arg == "--counters") {
+			options.counters = true;
+		} else if (arg == "--json" && hasValue) {
+			options.json = argv[++i];
+		} else if (arg == "--baseline" && hasValue) {
+			options.baseline = argv[++i];
+		} else if (arg == "--tolerance" && hasValue) {
+			options.tolerance = std::stod(argv[++i]);
+		} else {
+			std::cerr << "Usage: " << argv[0]
+					  << " [--filter text] [--reps N] [--warmup N] [--threads 1,2,4] [--quick] [--counters]"
+						 " [--json out.json] [--baseline base.json] [--tolerance 0.1]"
+					  << std::endl;
+			return 1;
+		}
+	}
+	// Powers of two up to the available threads
+	if (options.threads.empty()) {
+		for (int t = 1; t < maxThreads(); t *= 2) options.threads.push_back(t);
+		options.threads.push_back(maxThreads());
+	}
+
+	std::printf("PlanetGenBench: seed %d, %d warmup + %d reps, up to %d threads\n", Seed, options.warmup,
+				options.reps, maxThreads());
+	if (options.counters && !PerfCounters::setEnabled(true))
+		std::printf("Hardware counters unavailable: %s\n", PerfCounters::reason().c_str());
+	std::printf("\n");
+	compareSphereMeshes(options);
+	Bench bench(options);
+	benchWorldGen(bench, options);
+	benchMesh(bench, options);
+	benchIO(bench, options);
+	benchTileCache(bench, options);
+	if (PerfCounters::enabled()) {
+		std::printf("\n");
+		PerfCounters::printSummary();
+	}
+
+	if (!options.json.empty()) {
+		if (!writeJSON(options.json, options, bench.results())) {
+			std::cerr << "Cannot write " << options.json << std::endl;
+			return 1;
+		}
+		std::printf("\nWrote %zu results to %s\n", bench.results().size(), options.json.c_str());
+	}
+	if (!options.baseline.empty()) {
+		std::map<std::string, double> baseline = readBaseline(options.baseline);
+		if (baseline.empty()) {
+			std::cerr << "No results in baseline " << options.baseline << std::endl;
+			return 1;
+		}
+		if (compare(bench.results(), baseline, options.tolerance) > 0) return 2;
+	}
+	if (bench.allocationFailures() > 0) {
+		std::printf("\n%d cases allocated in steady state\n", bench.allocationFailures());
+		return 3;
+	}
+	return 0;
+}
@@ -1,4 +1,4 @@
-#version 460 core
+#version 450 core
 out vec4 FragColor;
 
 const float PI = 3.14159265358979323846;
@@ -14,11 +14,15 @@ in vec3 fPos;
 in vec3 fPos_model;
 in vec2 fTexCoord;
 
-#define MAX_LIGHTS 10
+layout(std140, binding = 0) uniform FrameBlock {
+    mat4 view;
+    mat4 projection;
+    vec4 eyePos;
+};
 
 struct LightSource {
-    int type; // 0: directional, 1: point
     vec3 direction; // Directional light: direction, Point light: position
+    int type; // 0: directional, 1: point
     vec3 color;
     float intensity;
 
@@ -28,8 +32,23 @@ struct LightSource {
     float aq;
 };
 
-uniform LightSource lights[MAX_LIGHTS];
-uniform int numOfLights;
+layout(std430, binding = 2) readonly buffer LightBlock {
+    int numOfLights;
+    LightSource lights[];
+};
+
+#ifdef CLUSTERED_LIGHTING
+// Point lights binned per cluster of the view frustum on the CPU
+layout(std430, binding = 3) readonly buffer ClusterBlock {
+    uvec4 gridSize;
+    vec4 clusterParams; // Depth slice scale and bias, tile width and height in pixels
+    uvec2 clusters[];   // Offset and count in lightIndices
+};
+
+layout(std430, binding = 4) readonly buffer ClusterIndexBlock {
+    uint lightIndices[];
+};
+#endif
 
 struct Material {
     vec3 albedo;
@@ -38,7 +57,9 @@ struct Material {
     float metalness;
 };
 
-uniform Material material;
+layout(std140, binding = 1) uniform MaterialBlock {
+    Material material;
+};
 
 struct Ray {
     vec3 origin;
@@ -46,8 +67,6 @@ struct Ray {
     vec3 inv_direction;
 };
 
-uniform vec3 eyePos;
-
 // Trowbridge-Reitz Normal Distribution
 float NormalDistributionGGX(vec3 n, vec3 wh, float alpha) {
     float nom = sqr(alpha);
@@ -104,7 +123,7 @@ vec3 evaluateRadiancePointLight(Material mat, LightSource source, vec3 normal, v
     float attenuation = 1.0 / (source.ac + dist * source.al + dist * dist * source.aq);
     vec3 lightDir = -normalize(source.direction - pos);
 
-    LightSource new_source = LightSource(1, lightDir, source.color, source.intensity * attenuation, 0.0, 0.0, 0.0);
+    LightSource new_source = LightSource(lightDir, 1, source.color, source.intensity * attenuation, 0.0, 0.0, 0.0);
 
     return evaluateRadianceDirectional(mat, new_source, normal, pos, ray);
 }
@@ -123,8 +142,8 @@ void main() {
     vec3 radiance = vec3(0);
 
     Ray ray;
-    ray.origin = eyePos;
-    ray.direction = normalize(fPos - eyePos);
+    ray.origin = eyePos.xyz;
+    ray.direction = normalize(fPos - eyePos.xyz);
 
     vec3 normal = normalize(fNormal);
     vec3 worldUp = normalize(fPos);
@@ -160,13 +179,34 @@ void main() {
         mat.albedo = vec3(1.0);
         mat.roughness = 0.7;
         mat.metalness = 0.3;
-    }
+    }*/
+
+    Material mat = material;
+    mat.albedo *= texture(tex_diffuse, fTexCoord).xyz;
 
+#if defined(NUM_DIR_LIGHTS)
+    // Specialized variant: the lights are sorted by type and the loops have constant bounds
+    for(int i=0; i<NUM_DIR_LIGHTS; i++) {
+        radiance += evaluateRadianceDirectional(mat, lights[i], normal, fPos, ray);
+    }
+#if defined(CLUSTERED_LIGHTING)
+    float depth = -(view * vec4(fPos, 1.0)).z;
+    uvec3 cell = uvec3(gl_FragCoord.xy / clusterParams.zw, max(log(depth) * clusterParams.x + clusterParams.y, 0.0));
+    cell = min(cell, gridSize.xyz - 1u);
+    uvec2 cluster = clusters[(cell.z * gridSize.y + cell.y) * gridSize.x + cell.x];
+    for(uint i=0u; i<cluster.y; i++) {
+        radiance += evaluateRadiancePointLight(mat, lights[lightIndices[cluster.x + i]], normal, fPos, ray);
+    }
+#else
+    for(int i=0; i<NUM_POINT_LIGHTS; i++) {
+        radiance += evaluateRadiancePointLight(mat, lights[NUM_DIR_LIGHTS + i], normal, fPos, ray);
+    }
+#endif
+#else
     for(int i=0; i<numOfLights; i++) {
         radiance += evaluateRadiance(mat, lights[i], normal, fPos, ray);
-    }*/
-
-    vec3 albedo = texture(tex_diffuse, fTexCoord).xyz;
+    }
+#endif
 
-    FragColor = vec4(albedo, 1.0);
+    FragColor = vec4(radiance, 1.0);
 }
@@ -1,22 +1,42 @@
-#version 460 core
+#version 450 core
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNorm;
+layout (location = 1) in vec3 aNorm; // Octahedral in .xy with COMPACT_VERTICES
 layout (location = 2) in vec2 aTexCoord;
+// Per-mesh dequantization of the positions (identity for float vertices)
+layout (location = 3) in vec4 aPosOffset;
+layout (location = 4) in vec4 aPosScale;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat3 normalMatrix; // transpose(inverse(model)), computed on the CPU
+
+layout(std140, binding = 0) uniform FrameBlock {
+    mat4 view;
+    mat4 projection;
+    vec4 eyePos;
+};
 
 out vec3 fNormal;
 out vec3 fPos;
 out vec3 fPos_model;
 out vec2 fTexCoord;
 
+vec3 octahedralDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
 void main() {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-    mat4 normalMatrix = transpose(inverse(model));
-    fNormal = normalize(vec3(normalMatrix * vec4(aNorm, 0.0)));
-    fPos = vec3(model * vec4(aPos, 1.0));
-    fPos_model = aPos;
+    vec3 position = aPosOffset.xyz + aPos * aPosScale.xyz;
+#ifdef COMPACT_VERTICES
+    vec3 normal = octahedralDecode(aNorm.xy);
+#else
+    vec3 normal = aNorm;
+#endif
+    gl_Position = projection * view * model * vec4(position, 1.0);
+    fNormal = normalize(normalMatrix * normal);
+    fPos = vec3(model * vec4(position, 1.0));
+    fPos_model = position;
     fTexCoord = aTexCoord;
 }
@@ -9,9 +9,17 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "Transform.h"
+#include "ShaderBuffer.h"
 
 class Ray;
 
+/// std140 layout of FrameBlock in the shaders
+struct GPUFrame {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 eyePos;
+};
+
 /// Basic camera model
 class Camera : public Transform {
 public:
@@ -46,6 +54,12 @@ public:
         return proj_mat;
     }
 
+    /// Writes the matrices and eye position in a buffer block, uploaded only if they changed
+    inline void write(ShaderBuffer& buffer, size_t offset = 0) {
+        glm::mat4 view = computeViewMatrix();
+        buffer.write(offset, GPUFrame{view, computeProjectionMatrix(), inv_view_mat[3]});
+    }
+
 private:
     float m_fov = 45.f;
     float m_aspectRatio = 1.f;
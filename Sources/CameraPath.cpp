@@ -0,0 +1,298 @@
+#include "CameraPath.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+template <typename T>
+void sortByTime(std::vector<T>& items) {
+	std::stable_sort(items.begin(), items.end(), [](const T& a, const T& b) { return a.time < b.time; });
+}
+
+float average(const std::vector<float>& values) {
+	double total = 0.0;
+	for (float value : values) total += value;
+	return values.empty() ? 0.0f : float(total / values.size());
+}
+
+void writeSummary(std::ostream& out, const char* name, const FrameTimeSummary& summary) {
+	out << "\"" << name << "\": {\"avg\": " << summary.averageMs << ", \"min\": " << summary.minMs
+		<< ", \"p50\": " << summary.p50Ms << ", \"p95\": " << summary.p95Ms << ", \"p99\": " << summary.p99Ms
+		<< ", \"max\": " << summary.maxMs << ", \"hitches\": " << summary.hitches << "}";
+}
+
+}  // namespace
+
+bool CameraPath::load(const std::string& filename) {
+	std::ifstream in(filename);
+	if (!in) {
+		std::cerr << "[Camera Path] Cannot open " << filename << std::endl;
+		return false;
+	}
+	_cameraKeys.clear();
+	_parameters.clear();
+	_checkpoints.clear();
+	_lastParameters.clear();
+
+	std::string line;
+	while (std::getline(in, line)) {
+		std::istringstream stream(line);
+		std::string type;
+		double time;
+		if (!(stream >> type) || type[0] == '#' || !(stream >> time)) continue;
+		if (type == "camera") {
+			CameraKey key{time, {}, {}};
+			stream >> key.translation.x >> key.translation.y >> key.translation.z >> key.rotation.x >>
+				key.rotation.y >> key.rotation.z;
+			if (stream) _cameraKeys.push_back(key);
+		} else if (type == "param") {
+			ParameterChange change{time, {}, {}};
+			stream >> change.name;
+			float value;
+			while (stream >> value) change.values.push_back(value);
+			_parameters.push_back(change);
+		} else if (type == "checkpoint") {
+			std::string name;
+			std::getline(stream >> std::ws, name);
+			_checkpoints.push_back({time, name.empty() ? "checkpoint" : name});
+		}
+	}
+	sortByTime(_cameraKeys);
+	sortByTime(_parameters);
+	sortByTime(_checkpoints);
+	std::cout << "[Camera Path] Loaded " << filename << ": " << _cameraKeys.size() << " camera keys, "
+			  << _parameters.size() << " parameter changes, " << _checkpoints.size() << " checkpoints, "
+			  << duration() << " s" << std::endl;
+	return true;
+}
+
+bool CameraPath::save(const std::string& filename) const {
+	std::ofstream out(filename);
+	if (!out) {
+		std::cerr << "[Camera Path] Cannot write " << filename << std::endl;
+		return false;
+	}
+	out.precision(9);
+	out << "# PlanetGen camera path\n";
+	for (const CameraKey& key : _cameraKeys)
+		out << "camera " << key.time << " " << key.translation.x << " " << key.translation.y << " "
+			<< key.translation.z << " " << key.rotation.x << " " << key.rotation.y << " " << key.rotation.z << "\n";
+	for (const ParameterChange& change : _parameters) {
+		out << "param " << change.time << " " << change.name;
+		for (float value : change.values) out << " " << value;
+		out << "\n";
+	}
+	for (const PathCheckpoint& checkpoint : _checkpoints)
+		out << "checkpoint " << checkpoint.time << " " << checkpoint.name << "\n";
+	std::cout << "[Camera Path] Saved " << _cameraKeys.size() << " camera keys, " << _parameters.size()
+			  << " parameter changes and " << _checkpoints.size() << " checkpoints to " << filename << std::endl;
+	return bool(out);
+}
+
+void CameraPath::record(double time, const Camera& camera, const Material& material,
+						const std::vector<std::shared_ptr<AbstractLight>>& lights) {
+	const glm::vec3 translation = camera.getTranslation(), rotation = camera.getRotation();
+	if (_cameraKeys.empty() || _cameraKeys.back().translation != translation ||
+		_cameraKeys.back().rotation != rotation)
+		_cameraKeys.push_back({time, translation, rotation});
+
+	recordParameter(time, "material.albedo", {material.albedo().x, material.albedo().y, material.albedo().z});
+	recordParameter(time, "material.roughness", {material.roughness()});
+	recordParameter(time, "material.metalness", {material.metalness()});
+	recordParameter(time, "material.F0", {material.F0().x, material.F0().y, material.F0().z});
+
+	recordParameter(time, "lights.count", {float(lights.size())});
+	for (size_t i = 0; i < lights.size(); i++) {
+		const GPULight light = lights[i]->toGPU();
+		recordParameter(time, "light." + std::to_string(i),
+						{float(light.type), light.direction.x, light.direction.y, light.direction.z, light.color.r,
+						 light.color.g, light.color.b, light.intensity, light.ac, light.al, light.aq});
+	}
+}
+
+void CameraPath::recordParameter(double time, const std::string& name, const std::vector<float>& values) {
+	auto last = _lastParameters.find(name);
+	if (last != _lastParameters.end() && _parameters[last->second].values == values) return;
+	_lastParameters[name] = _parameters.size();
+	_parameters.push_back({time, name, values});
+}
+
+void CameraPath::addCheckpoint(double time, const std::string& name) {
+	_checkpoints.push_back({time, name});
+	std::cout << "[Camera Path] Checkpoint \"" << name << "\" at " << time << " s" << std::endl;
+}
+
+double CameraPath::duration() const {
+	double end = 0.0;
+	if (!_cameraKeys.empty()) end = std::max(end, _cameraKeys.back().time);
+	if (!_parameters.empty()) end = std::max(end, _parameters.back().time);
+	if (!_checkpoints.empty()) end = std::max(end, _checkpoints.back().time);
+	return end;
+}
+
+void CameraPath::sampleCamera(double time, Camera& camera) const {
+	if (_cameraKeys.empty()) return;
+	auto next = std::upper_bound(_cameraKeys.begin(), _cameraKeys.end(), time,
+								 [](double t, const CameraKey& key) { return t < key.time; });
+	if (next == _cameraKeys.begin() || next == _cameraKeys.end()) {
+		const CameraKey& key = next == _cameraKeys.end() ? _cameraKeys.back() : _cameraKeys.front();
+		camera.setTranslation(key.translation);
+		camera.setRotation(key.rotation);
+		return;
+	}
+	const CameraKey& previous = *(next - 1);
+	const float t = float((time - previous.time) / (next->time - previous.time));
+	camera.setTranslation(glm::mix(previous.translation, next->translation, t));
+	camera.setRotation(glm::mix(previous.rotation, next->rotation, t));
+}
+
+bool CameraPath::apply(const ParameterChange& change, Material& material,
+					   std::vector<std::shared_ptr<AbstractLight>>& lights) {
+	const std::vector<float>& v = change.values;
+	if (change.name == "material.albedo" && v.size() == 3) {
+		material.albedo() = glm::vec3(v[0], v[1], v[2]);
+	} else if (change.name == "material.roughness" && v.size() == 1) {
+		material.roughness() = v[0];
+	} else if (change.name == "material.metalness" && v.size() == 1) {
+		material.metalness() = v[0];
+	} else if (change.name == "material.F0" && v.size() == 3) {
+		material.F0() = glm::vec3(v[0], v[1], v[2]);
+	} else if (change.name == "lights.count" && v.size() == 1) {
+		lights.resize(size_t(v[0]));
+	} else if (change.name.compare(0, 6, "light.") == 0 && v.size() == 11) {
+		char* end = nullptr;
+		const size_t index = size_t(std::strtoul(change.name.c_str() + 6, &end, 10));
+		if (end == change.name.c_str() + 6 || *end != '\0') return false;
+		if (index >= lights.size()) lights.resize(index + 1);
+		const glm::vec3 vector(v[1], v[2], v[3]), color(v[4], v[5], v[6]);
+		std::shared_ptr<AbstractLight>& light = lights[index];
+		if (v[0] == 0.0f) {
+			auto directional = std::dynamic_pointer_cast<DirectionalLight>(light);
+			if (!directional) light = directional = std::make_shared<DirectionalLight>(color, v[7], vector);
+			directional->setDirection(vector);
+		} else {
+			auto point = std::dynamic_pointer_cast<PointLight>(light);
+			if (!point) light = point = std::make_shared<PointLight>(color, v[7], vector, v[8], v[9], v[10]);
+			point->setTranslation(vector);
+			point->attenuationConstant() = v[8];
+			point->attenuationLinear() = v[9];
+			point->attenuationQuadratic() = v[10];
+		}
+		light->color() = color;
+		light->baseIntensity() = v[7];
+	} else {
+		return false;
+	}
+	return true;
+}
+
+CameraPathPlayer::CameraPathPlayer(const CameraPath& path, double timestep) : _path(path), _timestep(timestep) {
+	_segments.emplace_back();
+}
+
+bool CameraPathPlayer::advance(Camera& camera, Material& material,
+							   std::vector<std::shared_ptr<AbstractLight>>& lights, bool poolIdle) {
+	if (_finished) return false;
+
+	if (_settling) {
+		ReplaySegment& segment = _segments.back();
+		segment.settleFrames++;
+		_settledFrames = poolIdle ? _settledFrames + 1 : 0;
+		if (_settledFrames < SettleFrames && segment.settleFrames < MaxSettleFrames) return true;
+
+		segment.settled = _settledFrames >= SettleFrames;
+		if (!segment.settled)
+			std::cerr << "[Replay] Checkpoint \"" << segment.name << "\" did not settle in " << MaxSettleFrames
+					  << " frames" << std::endl;
+		_settling = false;
+		_segments.emplace_back();
+		_segments.back().startTime = _time;
+	}
+
+	double time = _frame++ == 0 ? 0.0 : _time + _timestep;
+	const std::vector<PathCheckpoint>& checkpoints = _path.checkpoints();
+	if (_nextCheckpoint < checkpoints.size() && checkpoints[_nextCheckpoint].time <= time) {
+		// Stop exactly on the checkpoint until it settles
+		time = checkpoints[_nextCheckpoint].time;
+		_segments.back().name = checkpoints[_nextCheckpoint].name;
+		_segments.back().endTime = time;
+		_nextCheckpoint++;
+		_settling = true;
+		_settledFrames = 0;
+	} else if (time > _path.duration()) {
+		_segments.back().name = "end";
+		_segments.back().endTime = _time;
+		_finished = true;
+		return false;
+	}
+	_time = time;
+
+	_path.sampleCamera(_time, camera);
+	const std::vector<ParameterChange>& parameters = _path.parameters();
+	for (; _nextParameter < parameters.size() && parameters[_nextParameter].time <= _time; _nextParameter++) {
+		if (!CameraPath::apply(parameters[_nextParameter], material, lights))
+			std::cerr << "[Replay] Unknown parameter " << parameters[_nextParameter].name << std::endl;
+	}
+	return true;
+}
+
+void CameraPathPlayer::endFrame(float frameMs, float cpuMs, float gpuMs) {
+	if (_settling || _finished) return;
+	ReplaySegment& segment = _segments.back();
+	segment.frameMs.push_back(frameMs);
+	segment.cpuMs.push_back(cpuMs);
+	segment.gpuMs.push_back(gpuMs);
+}
+
+void CameraPathPlayer::printReport() const {
+	std::printf("[Replay] %-20s %15s %7s %8s %8s %8s %8s %8s %8s %8s %7s\n", "Segment", "Time (s)", "Frames", "Avg",
+				"p50", "p95", "p99", "Max", "CPU avg", "GPU avg", "Settle");
+	std::vector<float> allFrames, allCpu, allGpu;
+	for (const ReplaySegment& segment : _segments) {
+		const FrameTimeSummary summary = FrameStats::summarize(segment.frameMs);
+		std::printf("[Replay] %-20s %6.2f - %6.2f %7zu %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %6zu%s\n",
+					segment.name.c_str(), segment.startTime, segment.endTime, summary.frames, summary.averageMs,
+					summary.p50Ms, summary.p95Ms, summary.p99Ms, summary.maxMs, average(segment.cpuMs),
+					average(segment.gpuMs), segment.settleFrames, segment.settled ? "" : "!");
+		allFrames.insert(allFrames.end(), segment.frameMs.begin(), segment.frameMs.end());
+		allCpu.insert(allCpu.end(), segment.cpuMs.begin(), segment.cpuMs.end());
+		allGpu.insert(allGpu.end(), segment.gpuMs.begin(), segment.gpuMs.end());
+	}
+	const FrameTimeSummary total = FrameStats::summarize(allFrames);
+	std::printf("[Replay] %-20s %15s %7zu %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f\n", "total", "", total.frames,
+				total.averageMs, total.p50Ms, total.p95Ms, total.p99Ms, total.maxMs, average(allCpu),
+				average(allGpu));
+}
+
+bool CameraPathPlayer::writeReport(const std::string& filename) const {
+	std::ofstream out(filename);
+	if (!out) {
+		std::cerr << "[Replay] Cannot write " << filename << std::endl;
+		return false;
+	}
+	out << "{\n  \"timestep\": " << _timestep << ",\n  \"segments\": [\n";
+	std::vector<float> allFrames, allCpu, allGpu;
+	for (size_t i = 0; i < _segments.size(); i++) {
+		const ReplaySegment& segment = _segments[i];
+		out << "    {\"name\": \"" << segment.name << "\", \"start\": " << segment.startTime
+			<< ", \"end\": " << segment.endTime << ", \"frames\": " << segment.frameMs.size() << ", ";
+		writeSummary(out, "frame_ms", FrameStats::summarize(segment.frameMs));
+		out << ", \"cpu_avg_ms\": " << average(segment.cpuMs) << ", \"gpu_avg_ms\": " << average(segment.gpuMs)
+			<< ", \"settle_frames\": " << segment.settleFrames
+			<< ", \"settled\": " << (segment.settled ? "true" : "false") << "}"
+			<< (i + 1 < _segments.size() ? "," : "") << "\n";
+		allFrames.insert(allFrames.end(), segment.frameMs.begin(), segment.frameMs.end());
+		allCpu.insert(allCpu.end(), segment.cpuMs.begin(), segment.cpuMs.end());
+		allGpu.insert(allGpu.end(), segment.gpuMs.begin(), segment.gpuMs.end());
+	}
+	out << "  ],\n  \"total\": {\"frames\": " << allFrames.size() << ", ";
+	writeSummary(out, "frame_ms", FrameStats::summarize(allFrames));
+	out << ", \"cpu_avg_ms\": " << average(allCpu) << ", \"gpu_avg_ms\": " << average(allGpu) << "}\n}\n";
+	std::cout << "[Replay] Wrote the report to " << filename << std::endl;
+	return bool(out);
+}
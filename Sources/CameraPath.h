@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+#include "FrameStats.h"
+#include "Light.h"
+#include "Material.h"
+
+// Camera transform at a time of the path, in seconds
+struct CameraKey {
+	double time;
+	glm::vec3 translation;
+	glm::vec3 rotation;
+};
+
+// UI parameter change, e.g. "material.roughness" with one value. The light
+// list is recorded as "lights.count" and one "light.<index>" per light with
+// its type, direction or position, color, intensity and attenuation.
+struct ParameterChange {
+	double time;
+	std::string name;
+	std::vector<float> values;
+};
+
+// Point of the path where the replay waits for the mesh pool to go idle
+struct PathCheckpoint {
+	double time;
+	std::string name;
+};
+
+// Recorded camera motion and parameter changes, saved as text lines:
+//   camera <time> <tx> <ty> <tz> <rx> <ry> <rz>
+//   param <time> <name> <values...>
+//   checkpoint <time> <name>
+class CameraPath {
+   public:
+	bool load(const std::string& filename);
+	bool save(const std::string& filename) const;
+
+	// Adds the camera and the parameters that changed since the last record
+	void record(double time, const Camera& camera, const Material& material,
+				const std::vector<std::shared_ptr<AbstractLight>>& lights);
+	void addCheckpoint(double time, const std::string& name);
+
+	const std::vector<CameraKey>& cameraKeys() const { return _cameraKeys; }
+	const std::vector<ParameterChange>& parameters() const { return _parameters; }
+	const std::vector<PathCheckpoint>& checkpoints() const { return _checkpoints; }
+	double duration() const;
+
+	// Camera transform at a time, linearly interpolated between the keys
+	void sampleCamera(double time, Camera& camera) const;
+	// False if the parameter is unknown
+	static bool apply(const ParameterChange& change, Material& material,
+					  std::vector<std::shared_ptr<AbstractLight>>& lights);
+
+   private:
+	void recordParameter(double time, const std::string& name, const std::vector<float>& values);
+
+	std::vector<CameraKey> _cameraKeys;
+	std::vector<ParameterChange> _parameters;
+	std::vector<PathCheckpoint> _checkpoints;
+	// Last change of each parameter while recording
+	std::unordered_map<std::string, size_t> _lastParameters;
+};
+
+// Frames between two checkpoints of a replay
+struct ReplaySegment {
+	std::string name;	// Checkpoint that ends the segment, "end" for the last one
+	double startTime = 0.0;
+	double endTime = 0.0;
+	std::vector<float> frameMs;
+	std::vector<float> cpuMs;
+	std::vector<float> gpuMs;
+	size_t settleFrames = 0;	// Frames waited at the checkpoint for the mesh pool
+	bool settled = true;		// False if the wait timed out
+};
+
+// Plays a path back at a fixed timestep, so that every run renders the same
+// frames whatever the frame rate. Replays start once the chunks are all
+// streamed in; at each checkpoint, time stops until the caller reports that
+// the mesh pool is idle (no freed range waiting on a GPU fence), and those
+// frames are not measured.
+class CameraPathPlayer {
+   public:
+	static const size_t SettleFrames = 10;		// Idle frames before resuming
+	static const size_t MaxSettleFrames = 600;
+
+	CameraPathPlayer(const CameraPath& path, double timestep = 1.0 / 60.0);
+
+	// Applies the state of the next frame, false once the path has ended
+	bool advance(Camera& camera, Material& material, std::vector<std::shared_ptr<AbstractLight>>& lights,
+				 bool poolIdle);
+	// Measures the frame prepared by advance(), unless it was settling
+	void endFrame(float frameMs, float cpuMs, float gpuMs);
+
+	double time() const { return _time; }
+	double timestep() const { return _timestep; }
+	bool settling() const { return _settling; }
+	const std::vector<ReplaySegment>& segments() const { return _segments; }
+
+	void printReport() const;
+	bool writeReport(const std::string& filename) const;
+
+   private:
+	const CameraPath& _path;
+	double _timestep;
+	double _time = 0.0;
+	size_t _frame = 0;
+	size_t _nextParameter = 0;
+	size_t _nextCheckpoint = 0;
+
+	bool _settling = false;
+	size_t _settledFrames = 0;
+	bool _finished = false;
+
+	std::vector<ReplaySegment> _segments;
+};
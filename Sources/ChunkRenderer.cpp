@@ -0,0 +1,186 @@
+#include "ChunkRenderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "Error.h"
+#include "MemoryTracker.h"
+#include "ShaderBuffer.h"
+
+std::shared_ptr<ShaderProgram> ChunkRenderer::buildCullProgram(const std::string& shaderFolder) {
+	return ShaderProgram::genComputeShaderProgram(shaderFolder + "ChunkCull.comp");
+}
+
+ChunkRenderer::ChunkRenderer(const std::string& shaderFolder, MeshPool& pool)
+	: ChunkRenderer(buildCullProgram(shaderFolder), pool) {}
+
+ChunkRenderer::ChunkRenderer(std::shared_ptr<ShaderProgram> cullProgram, MeshPool& pool)
+	: _cullProgram(std::move(cullProgram)),
+	  _pool(pool),
+	  _poolGeneration(pool.generation()),
+	  _chunkBuffer(GL_SHADER_STORAGE_BUFFER, ChunkBufferBinding, sizeof(GPUChunk)) {
+	for (int i = 0; i < 6; i++)
+		_frustumPlanesHandle[i] = _cullProgram->handle("frustumPlanes[" + std::to_string(i) + "]");
+	_eyePosHandle = _cullProgram->handle("eyePos");
+	_occluderRadiusHandle = _cullProgram->handle("occluderRadius");
+	_chunkCountHandle = _cullProgram->handle("chunkCount");
+
+	GLint alignment = 256;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	_counterStride = std::max<size_t>(size_t(alignment), 2 * sizeof(uint32_t));
+	const GLbitfield readFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glCreateBuffers(1, &_counterBuffer);
+	glNamedBufferStorage(_counterBuffer, GLsizeiptr(_counterStride * CounterSlots), nullptr, readFlags);
+	MemoryTracker::trackBuffer(_counterBuffer, _counterStride * CounterSlots, MemoryCategory::Buffers);
+	_counters = static_cast<const uint32_t*>(
+		glMapNamedBufferRange(_counterBuffer, 0, GLsizeiptr(_counterStride * CounterSlots), readFlags));
+	glCheckError("Creating the chunk counters");
+}
+
+ChunkRenderer::~ChunkRenderer() {
+	for (GLsync& fence : _counterFences) {
+		if (fence) glDeleteSync(fence);
+	}
+	for (Chunk& chunk : _chunks) _pool.remove(chunk.allocation);
+	glUnmapNamedBuffer(_counterBuffer);
+	GLuint buffers[] = {_commandBuffer, _counterBuffer};
+	for (GLuint buffer : buffers) MemoryTracker::releaseBuffer(buffer);
+	glDeleteBuffers(2, buffers);
+}
+
+uint32_t ChunkRenderer::addChunk(const Mesh& mesh) {
+	const auto& positions = mesh.positions();
+	Chunk chunk;
+	{
+		MemoryScope memoryScope(MemoryCategory::Meshes);
+		chunk.allocation = _pool.add(positions, mesh.normals(), mesh.texCoords(), mesh.indices());
+	}
+
+	// Bounding sphere around the box center, and cone of directions from the planet center
+	glm::vec3 boxMin(std::numeric_limits<float>::max()), boxMax(-std::numeric_limits<float>::max()), axis(0.0f);
+	for (const auto& p : positions) {
+		boxMin = glm::min(boxMin, p);
+		boxMax = glm::max(boxMax, p);
+		axis += glm::normalize(p);
+	}
+	ChunkBounds bounds{(boxMin + boxMax) * 0.5f, 0.0f, glm::normalize(axis), 0.0f, 0.0f};
+	float minCos = 1.0f;
+	for (const auto& p : positions) {
+		bounds.radius = std::max(bounds.radius, glm::distance(p, bounds.center));
+		bounds.maxRadius = std::max(bounds.maxRadius, glm::length(p));
+		minCos = std::min(minCos, glm::dot(bounds.axis, glm::normalize(p)));
+		_occluderRadius = std::min(_occluderRadius, glm::length(p));
+	}
+	bounds.coneAngle = std::acos(glm::clamp(minCos, -1.0f, 1.0f));
+	chunk.bounds = bounds;
+
+	uint32_t id;
+	if (_freeIds.empty()) {
+		id = uint32_t(_chunks.size());
+		_chunks.push_back(chunk);
+	} else {
+		id = _freeIds.back();
+		_freeIds.pop_back();
+		_chunks[id] = chunk;
+	}
+	writeChunk(id);
+	_stats.chunks++;
+	return id;
+}
+
+void ChunkRenderer::removeChunk(uint32_t id) {
+	if (id >= _chunks.size() || !_chunks[id].allocation.valid()) return;
+	_pool.remove(_chunks[id].allocation);
+	writeChunk(id);
+	_freeIds.push_back(id);
+	_stats.chunks--;
+}
+
+// Removed chunks are written with no index, their commands draw nothing
+void ChunkRenderer::writeChunk(uint32_t id) {
+	const Chunk& chunk = _chunks[id];
+	GPUChunk gpuChunk{};
+	if (chunk.allocation.valid()) {
+		const ChunkBounds& bounds = chunk.bounds;
+		gpuChunk.sphere = glm::vec4(bounds.center, bounds.radius);
+		gpuChunk.cone = glm::vec4(bounds.axis, bounds.coneAngle);
+		gpuChunk.firstIndex = _pool.firstIndex(chunk.allocation);
+		gpuChunk.indexCount = chunk.allocation.indexCount;
+		gpuChunk.baseVertex = _pool.baseVertex(chunk.allocation);
+		gpuChunk.maxRadius = bounds.maxRadius;
+		gpuChunk.baseInstance = _pool.baseInstance(chunk.allocation);
+	}
+	_chunkBuffer.write(id * sizeof(GPUChunk), gpuChunk);
+}
+
+void ChunkRenderer::cull(const glm::mat4& viewProjection, const glm::vec3& eyePos) {
+	if (_chunks.empty()) return;
+
+	// Gribb-Hartmann frustum planes, normalized so that the distance test works with radii
+	const glm::mat4 m = glm::transpose(viewProjection);
+	const glm::vec4 planes[6] = {m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[3] + m[2], m[3] - m[2]};
+	for (int i = 0; i < 6; i++)
+		_cullProgram->set(_frustumPlanesHandle[i], planes[i] / glm::length(glm::vec3(planes[i])));
+	_cullProgram->set(_eyePosHandle, eyePos);
+	_cullProgram->set(_occluderRadiusHandle, _occluderRadius);
+	_cullProgram->set(_chunkCountHandle, unsigned(_chunks.size()));
+
+	// The pool moved the ranges when it was defragmented
+	if (_poolGeneration != _pool.generation()) {
+		for (uint32_t id = 0; id < _chunks.size(); id++) writeChunk(id);
+		_poolGeneration = _pool.generation();
+	}
+	_chunkBuffer.resize(std::max<size_t>(_chunks.size(), 1) * sizeof(GPUChunk));
+	_chunkBuffer.flush();
+
+	if (_chunks.size() > _commandCapacity) {
+		MemoryTracker::releaseBuffer(_commandBuffer);
+		glDeleteBuffers(1, &_commandBuffer);
+		_commandCapacity = std::max(_chunks.size(), _commandCapacity * 2);
+		glCreateBuffers(1, &_commandBuffer);
+		glNamedBufferStorage(_commandBuffer, GLsizeiptr(_commandCapacity * 5 * sizeof(uint32_t)), nullptr, 0);
+		MemoryTracker::trackBuffer(_commandBuffer, _commandCapacity * 5 * sizeof(uint32_t), MemoryCategory::Buffers);
+	}
+
+	const int slot = _frame % CounterSlots;
+	if (_counterFences[slot]) {
+		glDeleteSync(_counterFences[slot]);
+		_counterFences[slot] = nullptr;
+	}
+	const GLintptr counterOffset = GLintptr(slot * _counterStride);
+	glClearNamedBufferSubData(_counterBuffer, GL_R32UI, counterOffset, 2 * sizeof(uint32_t), GL_RED_INTEGER,
+							  GL_UNSIGNED_INT, nullptr);
+
+	_cullProgram->use();
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DrawCommandBufferBinding, _commandBuffer);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, DrawCounterBufferBinding, _counterBuffer, counterOffset,
+					  2 * sizeof(uint32_t));
+	glDispatchCompute(GLuint((_chunks.size() + 63) / 64), 1, 1);
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+	_counterFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	_chunkBuffer.fence();
+
+	readCounters();
+	_frame++;
+}
+
+// Reads the oldest slot if the GPU is done with it, without waiting
+void ChunkRenderer::readCounters() {
+	const int slot = (_frame + 1) % CounterSlots;
+	GLsync fence = _counterFences[slot];
+	if (!fence || glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) return;
+	const uint32_t* counters = _counters + slot * _counterStride / sizeof(uint32_t);
+	_stats.visibleChunks = counters[0];
+	_stats.visibleTriangles = counters[1];
+}
+
+void ChunkRenderer::draw() {
+	if (_chunks.empty()) return;
+	glBindVertexArray(_pool.vao());
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, GLsizei(_chunks.size()), 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindVertexArray(0);
+	_stats.drawCalls = 1;
+}
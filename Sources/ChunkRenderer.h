@@ -0,0 +1,104 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+#include "MeshPool.h"
+#include "ShaderBuffer.h"
+#include "ShaderProgram.h"
+
+struct ChunkRenderStats {
+	size_t drawCalls = 0;	// Draw submissions of the last frame
+	size_t chunks = 0;
+	// Results of the GPU culling, read back a couple of frames late to avoid stalls
+	size_t visibleChunks = 0;
+	size_t visibleTriangles = 0;
+};
+
+// Draws many terrain chunks with a single glMultiDrawElementsIndirect call.
+// The geometry of every chunk lives in ranges of a MeshPool, and a compute
+// pass writes one indirect command per chunk slot each frame, with zero
+// instances when the chunk is outside the frustum or below the horizon.
+// Chunks can be added and removed at any time, e.g. when streaming LODs.
+class ChunkRenderer {
+   public:
+	ChunkRenderer(const std::string& shaderFolder, MeshPool& pool);
+	// With a culling program built beforehand, e.g. on another context
+	ChunkRenderer(std::shared_ptr<ShaderProgram> cullProgram, MeshPool& pool);
+	~ChunkRenderer();
+
+	static std::shared_ptr<ShaderProgram> buildCullProgram(const std::string& shaderFolder);
+
+	// Uploads a chunk in the pool, returns its id
+	uint32_t addChunk(const Mesh& mesh);
+	// Frees the chunk's ranges, the id is reused by a later chunk
+	void removeChunk(uint32_t id);
+
+	// Culls the chunks for a camera, both in the chunks' space
+	void cull(const glm::mat4& viewProjection, const glm::vec3& eyePos);
+	// Draws the visible chunks with the currently bound program
+	void draw();
+
+	const ChunkRenderStats& stats() const { return _stats; }
+
+   private:
+	// std430 layout of Chunk in ChunkCull.comp
+	struct GPUChunk {
+		glm::vec4 sphere;	// Bounding sphere center and radius
+		glm::vec4 cone;		// Direction from the planet center and angular radius
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		int32_t baseVertex;
+		float maxRadius;	// Largest distance from the planet center
+		uint32_t baseInstance;	// Dequantization slot in the pool
+		uint32_t padding[3];
+	};
+
+	struct ChunkBounds {
+		glm::vec3 center;
+		float radius;
+		glm::vec3 axis;
+		float coneAngle;	// Largest angle between the axis and a vertex
+		float maxRadius;	// Largest distance from the planet center
+	};
+
+	struct Chunk {
+		MeshPool::Allocation allocation;
+		ChunkBounds bounds;
+	};
+
+	static const int CounterSlots = 3;
+
+	void writeChunk(uint32_t id);
+	void readCounters();
+
+	std::shared_ptr<ShaderProgram> _cullProgram;
+	UniformHandle _frustumPlanesHandle[6], _eyePosHandle, _occluderRadiusHandle, _chunkCountHandle;
+
+	MeshPool& _pool;
+	uint64_t _poolGeneration = 0;
+
+	std::vector<Chunk> _chunks;		// Indexed by id, removed chunks have no allocation
+	std::vector<uint32_t> _freeIds;
+	float _occluderRadius = std::numeric_limits<float>::max();	// Smallest vertex radius
+
+	ShaderBuffer _chunkBuffer;
+	GLuint _commandBuffer = 0;
+	size_t _commandCapacity = 0;	// In chunks
+
+	// Visible chunk and triangle counters, one slot per frame in flight
+	GLuint _counterBuffer = 0;
+	const uint32_t* _counters = nullptr;
+	size_t _counterStride = 0;
+	GLsync _counterFences[CounterSlots] = {};
+	int _frame = 0;
+
+	ChunkRenderStats _stats;
+};
@@ -0,0 +1,242 @@
+#include "CubeMapProjector.h"
+
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+
+#include <glm/ext.hpp>
+
+#include "IO.h"
+#include "MemoryTracker.h"
+#include "TaskScheduler.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CUBEMAP_USE_SSE2
+#endif
+
+namespace {
+
+// Face basis in OpenGL cube map order (+X, -X, +Y, -Y, +Z, -Z):
+// direction = origin + s * uAxis + t * vAxis, with s, t in [-1, 1]
+struct FaceBasis {
+	glm::vec3 origin;
+	glm::vec3 uAxis;
+	glm::vec3 vAxis;
+};
+
+const FaceBasis faceBases[6] = {
+	{{1, 0, 0}, {0, 0, -1}, {0, -1, 0}},
+	{{-1, 0, 0}, {0, 0, 1}, {0, -1, 0}},
+	{{0, 1, 0}, {1, 0, 0}, {0, 0, 1}},
+	{{0, -1, 0}, {1, 0, 0}, {0, 0, -1}},
+	{{0, 0, 1}, {1, 0, 0}, {0, -1, 0}},
+	{{0, 0, -1}, {-1, 0, 0}, {0, -1, 0}},
+};
+
+const char* faceNames[6] = {"posx", "negx", "posy", "negy", "posz", "negz"};
+
+const int blockSize = 32;
+
+// Bilinear blend of two horizontally adjacent RGBA8 texels on two rows.
+// fx and fy are 8-bit fixed point weights in [0, 256].
+inline uint32_t bilinear(const uint32_t* row0, const uint32_t* row1, int fx,
+						 int fy) {
+#ifdef CUBEMAP_USE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i wx = _mm_set1_epi32((fx << 16) | (256 - fx));
+	const __m128i wy = _mm_set1_epi32((fy << 16) | (256 - fy));
+	const __m128i round = _mm_set1_epi32(128);
+
+	// p0 p1 -> r0 r1 g0 g1 b0 b1 a0 a1, then horizontal lerp with madd
+	__m128i top = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row0));
+	__m128i bot = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row1));
+	top = _mm_unpacklo_epi8(top, _mm_srli_si128(top, 4));
+	bot = _mm_unpacklo_epi8(bot, _mm_srli_si128(bot, 4));
+	top = _mm_madd_epi16(_mm_unpacklo_epi8(top, zero), wx);
+	bot = _mm_madd_epi16(_mm_unpacklo_epi8(bot, zero), wx);
+	top = _mm_srli_epi32(_mm_add_epi32(top, round), 8);
+	bot = _mm_srli_epi32(_mm_add_epi32(bot, round), 8);
+
+	// Interleave top/bottom channels and lerp vertically
+	__m128i tb = _mm_unpacklo_epi16(_mm_packs_epi32(top, zero),
+									_mm_packs_epi32(bot, zero));
+	__m128i c = _mm_madd_epi16(tb, wy);
+	c = _mm_srli_epi32(_mm_add_epi32(c, round), 8);
+	c = _mm_packs_epi32(c, c);
+	c = _mm_packus_epi16(c, c);
+	return static_cast<uint32_t>(_mm_cvtsi128_si32(c));
+#else
+	uint32_t result = 0;
+	for (int shift = 0; shift < 32; shift += 8) {
+		int p00 = (row0[0] >> shift) & 0xFF, p01 = (row0[1] >> shift) & 0xFF;
+		int p10 = (row1[0] >> shift) & 0xFF, p11 = (row1[1] >> shift) & 0xFF;
+		int top = (p00 * (256 - fx) + p01 * fx + 128) >> 8;
+		int bot = (p10 * (256 - fx) + p11 * fx + 128) >> 8;
+		result |= uint32_t((top * (256 - fy) + bot * fy + 128) >> 8) << shift;
+	}
+	return result;
+#endif
+}
+
+}  // namespace
+
+CubeMapProjector::CubeMapProjector(int faceSize, int tileSize)
+	: _faceSize(faceSize), _tileSize(tileSize) {
+	// Texel centers, shared by rows and columns of every face
+	_coord.resize(faceSize);
+	_coordSq.resize(faceSize);
+	for (int i = 0; i < faceSize; i++) {
+		_coord[i] = 2.0f * (i + 0.5f) / float(faceSize) - 1.0f;
+		_coordSq[i] = _coord[i] * _coord[i];
+	}
+}
+
+void CubeMapProjector::beginLevel(int z) {
+	const int n = 1 << z;
+	_mosaicWidth = n * _tileSize;
+	_mosaicHeight = n * _tileSize;
+	_mosaic.assign(size_t(_mosaicWidth + 1) * (_mosaicHeight + 1), 0xFF000000u);
+}
+
+void CubeMapProjector::setTile(int x, int y, int width, int height,
+							   const std::vector<GLubyte>& rgbPixels) {
+	const int stride = _mosaicWidth + 1;
+	const int w = std::min(width, _tileSize);
+	const int h = std::min(height, _tileSize);
+	for (int j = 0; j < h; j++) {
+		uint32_t* dst = &_mosaic[size_t(y * _tileSize + j) * stride + x * _tileSize];
+		const GLubyte* src = &rgbPixels[size_t(j) * width * 3];
+		for (int i = 0; i < w; i++) {
+			dst[i] = uint32_t(src[i * 3 + 0]) | (uint32_t(src[i * 3 + 1]) << 8) |
+					 (uint32_t(src[i * 3 + 2]) << 16) | 0xFF000000u;
+		}
+	}
+}
+
+bool CubeMapProjector::fetchLevel(int z) {
+	beginLevel(z);
+	const int n = 1 << z;
+	// Tiles are downloaded and decoded concurrently, each into its own part of the mosaic
+	std::atomic<bool> ok{true};
+	parallelFor(0, size_t(n) * n, 1, [&](size_t begin, size_t end) {
+		for (size_t t = begin; t < end && ok; t++) {
+			const int x = int(t % n), y = int(t / n);
+			int width, height;
+			std::vector<GLubyte> pixels;
+			if (!IO::fetchTilePNG(z, x, y, width, height, pixels)) {
+				std::cerr << "Failed to fetch tile " << z << "/" << x << "/" << y
+						  << "\n";
+				ok = false;
+				return;
+			}
+			setTile(x, y, width, height, pixels);
+		}
+	});
+	return ok;
+}
+
+// Longitude wraps around, so the padding column repeats the first one; the
+// padding row clamps to the last one.
+void CubeMapProjector::padMosaic() {
+	const int stride = _mosaicWidth + 1;
+	for (int y = 0; y < _mosaicHeight; y++)
+		_mosaic[size_t(y) * stride + _mosaicWidth] = _mosaic[size_t(y) * stride];
+	std::memcpy(&_mosaic[size_t(_mosaicHeight) * stride],
+				&_mosaic[size_t(_mosaicHeight - 1) * stride],
+				stride * sizeof(uint32_t));
+}
+
+void CubeMapProjector::reprojectBlock(int face, int bx, int by) {
+	const FaceBasis& basis = faceBases[face];
+	const int stride = _mosaicWidth + 1;
+	const float invTwoPi = 0.5f / glm::pi<float>();
+	const float maxSinLat = 0.99999f;
+
+	const int x0 = bx * blockSize, x1 = std::min(x0 + blockSize, _faceSize);
+	const int y0 = by * blockSize, y1 = std::min(y0 + blockSize, _faceSize);
+
+	GLubyte* out = _faces[face].data();
+	for (int j = y0; j < y1; j++) {
+		const glm::vec3 rowDir = basis.origin + _coord[j] * basis.vAxis;
+		for (int i = x0; i < x1; i++) {
+			// |origin + s * u + t * v| = sqrt(1 + s^2 + t^2) for an orthonormal basis
+			const glm::vec3 dir = rowDir + _coord[i] * basis.uAxis;
+			const float invLen = 1.0f / std::sqrt(1.0f + _coordSq[i] + _coordSq[j]);
+
+			// Same lat/lon convention as WorldGen::generateMercatorTileMesh
+			float sinLat = glm::clamp(dir.y * invLen, -maxSinLat, maxSinLat);
+			float u = 0.5f + std::atan2(dir.z, dir.x) * invTwoPi;
+			float v = 0.5f - 0.5f * std::log((1.0f + sinLat) / (1.0f - sinLat)) * invTwoPi;
+
+			float px = u * _mosaicWidth - 0.5f;
+			float py = glm::clamp(v * _mosaicHeight - 0.5f, 0.0f,
+								  float(_mosaicHeight - 1));
+			int sx = int(std::floor(px));
+			int sy = int(py);
+			int fx = int((px - sx) * 256.0f + 0.5f);
+			int fy = int((py - sy) * 256.0f + 0.5f);
+			if (sx < 0) sx += _mosaicWidth;
+			if (sx >= _mosaicWidth) sx -= _mosaicWidth;
+
+			const uint32_t* row0 = &_mosaic[size_t(sy) * stride + sx];
+			uint32_t c = bilinear(row0, row0 + stride, fx, fy);
+
+			GLubyte* texel = out + (size_t(j) * _faceSize + i) * 3;
+			texel[0] = GLubyte(c);
+			texel[1] = GLubyte(c >> 8);
+			texel[2] = GLubyte(c >> 16);
+		}
+	}
+}
+
+void CubeMapProjector::reproject() {
+	padMosaic();
+	for (auto& face : _faces) face.resize(size_t(_faceSize) * _faceSize * 3);
+
+	const int blocksPerAxis = (_faceSize + blockSize - 1) / blockSize;
+	const int blocksPerFace = blocksPerAxis * blocksPerAxis;
+
+	// Idle workers steal ranges of blocks, whose cost varies with the mosaic tiles they sample
+	parallelFor(0, size_t(6 * blocksPerFace), 1, [&](size_t begin, size_t end) {
+		for (size_t b = begin; b < end; b++) {
+			int face = int(b) / blocksPerFace;
+			int block = int(b) % blocksPerFace;
+			reprojectBlock(face, block % blocksPerAxis, block / blocksPerAxis);
+		}
+	});
+}
+
+void CubeMapProjector::saveFaces(const std::string& prefix) const {
+	std::vector<glm::vec3> pixels(size_t(_faceSize) * _faceSize);
+	for (int f = 0; f < 6; f++) {
+		const GLubyte* src = _faces[f].data();
+		for (size_t p = 0; p < pixels.size(); p++)
+			pixels[p] = glm::vec3(src[p * 3 + 0], src[p * 3 + 1], src[p * 3 + 2]) / 255.0f;
+		IO::savePPM(prefix + faceNames[f] + ".ppm", _faceSize, _faceSize, pixels);
+	}
+}
+
+GLuint CubeMapProjector::toTexture() const {
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+	for (int f = 0; f < 6; f++) {
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, 0, GL_RGB8, _faceSize,
+					 _faceSize, 0, GL_RGB, GL_UNSIGNED_BYTE, _faces[f].data());
+	}
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+	MemoryTracker::trackTexture(textureID, size_t(6) * _faceSize * _faceSize * 4 * 4 / 3, MemoryCategory::Textures);
+
+	return textureID;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+
+// Reprojects a Web-Mercator slippy tile pyramid level onto the six faces of a
+// cube map. Faces follow the OpenGL cube map conventions, so the result can be
+// sampled directly with the model-space direction of a cube-sphere vertex.
+class CubeMapProjector {
+   public:
+	CubeMapProjector(int faceSize, int tileSize = 256);
+
+	// Prepares an empty source mosaic for the 2^z x 2^z tiles of zoom level z
+	void beginLevel(int z);
+	// Copies one decoded RGB8 tile into the source mosaic
+	void setTile(int x, int y, int width, int height,
+				 const std::vector<GLubyte>& rgbPixels);
+	// Fetches every tile of zoom level z and copies it into the mosaic
+	bool fetchLevel(int z);
+
+	// Resamples the mosaic into the six faces
+	void reproject();
+
+	int faceSize() const { return _faceSize; }
+	const std::vector<GLubyte>& face(int i) const { return _faces[i]; }
+
+	// Offline output: writes <prefix><face name>.ppm for each face
+	void saveFaces(const std::string& prefix) const;
+	// On-demand output: uploads the faces as a GL_TEXTURE_CUBE_MAP
+	GLuint toTexture() const;
+
+   private:
+	void padMosaic();
+	void reprojectBlock(int face, int bx, int by);
+
+	int _faceSize;
+	int _tileSize;
+
+	// Source mosaic, RGBA8 with one wrapped column and one clamped row of
+	// padding so that bilinear taps never need bound checks
+	std::vector<uint32_t> _mosaic;
+	int _mosaicWidth = 0;
+	int _mosaicHeight = 0;
+
+	// Face plane coordinate in [-1, 1] of every texel row/column, and its square
+	std::vector<float> _coord;
+	std::vector<float> _coordSq;
+
+	std::vector<GLubyte> _faces[6];
+};
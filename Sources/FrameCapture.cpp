@@ -0,0 +1,93 @@
+#include "FrameCapture.h"
+
+#include <iostream>
+
+#include "Error.h"
+#include "MemoryTracker.h"
+
+FrameCapture::FrameCapture(Callback onFrame, int slots) : _onFrame(std::move(onFrame)), _slots(size_t(slots)) {}
+
+FrameCapture::~FrameCapture() {
+	for (Slot& slot : _slots) {
+		if (slot.fence) glDeleteSync(slot.fence);
+		if (slot.buffer) {
+			glUnmapNamedBuffer(slot.buffer);
+			MemoryTracker::releaseBuffer(slot.buffer);
+			glDeleteBuffers(1, &slot.buffer);
+		}
+	}
+}
+
+void FrameCapture::reserve(Slot& slot, size_t size) {
+	if (size <= slot.capacity) return;
+	if (slot.buffer) {
+		glUnmapNamedBuffer(slot.buffer);
+		MemoryTracker::releaseBuffer(slot.buffer);
+		glDeleteBuffers(1, &slot.buffer);
+	}
+	const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glCreateBuffers(1, &slot.buffer);
+	glNamedBufferStorage(slot.buffer, GLsizeiptr(size), nullptr, flags);
+	MemoryTracker::trackBuffer(slot.buffer, size, MemoryCategory::RenderTargets);
+	slot.mapping = static_cast<const uint8_t*>(glMapNamedBufferRange(slot.buffer, 0, GLsizeiptr(size), flags));
+	slot.capacity = size;
+	glCheckError("Allocating a capture buffer");
+}
+
+void FrameCapture::capture(GLuint framebuffer, int width, int height, uint64_t tag) {
+	if (_pending == _slots.size()) {
+		_stalls++;
+		deliver(_slots[_oldest], true);
+	}
+	Slot& slot = _slots[_next];
+	reserve(slot, size_t(width) * height * 4);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	// Coherent mapping: the copy is visible to the CPU once the fence signals
+	glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+
+	slot.tag = tag;
+	slot.width = width;
+	slot.height = height;
+	_next = (_next + 1) % _slots.size();
+	_pending++;
+}
+
+bool FrameCapture::deliver(Slot& slot, bool wait) {
+	GLenum result = glClientWaitSync(slot.fence, 0, 0);
+	if (result == GL_TIMEOUT_EXPIRED) {
+		if (!wait) return false;
+		while ((result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000)) == GL_TIMEOUT_EXPIRED) {
+		}
+	}
+	if (result == GL_WAIT_FAILED) {
+		// The copy may still be running: keep the slot, or drain the GPU when it is needed now
+		std::cerr << "[Frame Capture] Fence wait failed for frame " << slot.tag << std::endl;
+		if (!wait) return false;
+		glFinish();
+	}
+	glDeleteSync(slot.fence);
+	slot.fence = nullptr;
+	_onFrame({slot.tag, slot.width, slot.height, slot.mapping});
+
+	_oldest = (_oldest + 1) % _slots.size();
+	_pending--;
+	_captured++;
+	return true;
+}
+
+void FrameCapture::poll() {
+	while (_pending > 0 && deliver(_slots[_oldest], false)) {
+	}
+}
+
+void FrameCapture::finish() {
+	while (_pending > 0) deliver(_slots[_oldest], true);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Pixels of a captured frame, bottom row first. Only valid during the callback.
+struct CapturedFrame {
+	uint64_t tag;	// Passed to capture()
+	int width;
+	int height;
+	const uint8_t* rgba;
+};
+
+// Asynchronous readback of framebuffers through a ring of persistently mapped
+// pixel pack buffers. capture() only queues the copy on the GPU, the pixels
+// are handed to the callback by a later poll(), once the copy's fence has
+// signaled, so that the readback overlaps the rendering of the next frames.
+// capture() only waits when every buffer of the ring is still in flight.
+class FrameCapture {
+   public:
+	using Callback = std::function<void(const CapturedFrame&)>;
+
+	FrameCapture(Callback onFrame, int slots = 3);
+	~FrameCapture();
+
+	FrameCapture(const FrameCapture&) = delete;
+	FrameCapture& operator=(const FrameCapture&) = delete;
+
+	// Queues the copy of the first color attachment of a framebuffer
+	void capture(GLuint framebuffer, int width, int height, uint64_t tag);
+	// Delivers the completed captures, without waiting
+	void poll();
+	// Waits for and delivers every pending capture
+	void finish();
+
+	size_t captured() const { return _captured; }
+	size_t stalls() const { return _stalls; }	// Captures that had to wait for a free buffer
+
+   private:
+	struct Slot {
+		GLuint buffer = 0;
+		const uint8_t* mapping = nullptr;
+		size_t capacity = 0;
+		GLsync fence = nullptr;	// Pending copy
+		uint64_t tag = 0;
+		int width = 0, height = 0;
+	};
+
+	// Delivers the slot's pixels, waiting for its copy if wait is set
+	bool deliver(Slot& slot, bool wait);
+	void reserve(Slot& slot, size_t size);
+
+	Callback _onFrame;
+	std::vector<Slot> _slots;
+	size_t _next = 0;		// Next slot to write
+	size_t _oldest = 0;		// Oldest pending slot
+	size_t _pending = 0;
+	size_t _captured = 0;
+	size_t _stalls = 0;
+};
@@ -0,0 +1,146 @@
+#include "FrameStats.h"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+float percentile(const std::vector<float>& sorted, float p) {
+	if (sorted.empty()) return 0.0f;
+	return sorted[std::min(sorted.size() - 1, size_t(p * (sorted.size() - 1) + 0.5f))];
+}
+
+}  // namespace
+
+void FrameStats::addStage(const char* name, double ms) {
+	auto stage = std::find_if(_stages.begin(), _stages.end(),
+							  [&](const FrameStage& stage) { return stage.name == name; });
+	if (stage == _stages.end()) {
+		_stages.push_back({name, std::vector<float>(HistorySize, 0.0f), 0.0f});
+		stage = _stages.end() - 1;
+	}
+	stage->currentMs += float(ms);
+}
+
+void FrameStats::endFrame(float frameMs, float cpuMs, const GpuProfiler& gpuProfiler) {
+	if (_medianMs > 0.0f && frameMs > HitchFactor * _medianMs) _totalHitches++;
+
+	_frameMs[_next] = frameMs;
+	_cpuMs[_next] = cpuMs;
+	for (FrameStage& stage : _stages) stage.history[_next] = stage.currentMs;
+	if (recording()) record(frameMs, cpuMs, gpuProfiler);
+	for (FrameStage& stage : _stages) stage.currentMs = 0.0f;
+
+	_next = (_next + 1) % HistorySize;
+	_samples = std::min(_samples + 1, HistorySize);
+	_frameCount++;
+	if (_frameCount % 30 == 0 || _samples < 30) _medianMs = summary().p50Ms;
+}
+
+FrameTimeSummary FrameStats::summary() const {
+	// Samples fill the ring from 0 until it wraps
+	return summarize(std::vector<float>(_frameMs.begin(), _frameMs.begin() + _samples));
+}
+
+FrameTimeSummary FrameStats::summarize(std::vector<float> sorted) {
+	FrameTimeSummary summary;
+	if (sorted.empty()) return summary;
+	std::sort(sorted.begin(), sorted.end());
+
+	summary.frames = sorted.size();
+	summary.minMs = sorted.front();
+	summary.maxMs = sorted.back();
+	double total = 0.0;
+	for (float ms : sorted) total += ms;
+	summary.averageMs = float(total / sorted.size());
+	summary.p50Ms = percentile(sorted, 0.50f);
+	summary.p95Ms = percentile(sorted, 0.95f);
+	summary.p99Ms = percentile(sorted, 0.99f);
+	summary.hitches = size_t(sorted.end() - std::upper_bound(sorted.begin(), sorted.end(), HitchFactor * summary.p50Ms));
+	return summary;
+}
+
+float FrameStats::stageAverageMs(const FrameStage& stage) const {
+	if (_samples == 0) return 0.0f;
+	double total = 0.0;
+	for (size_t i = 0; i < _samples; i++) total += stage.history[i];
+	return float(total / _samples);
+}
+
+float FrameStats::stageMaxMs(const FrameStage& stage) const {
+	return _samples ? *std::max_element(stage.history.begin(), stage.history.begin() + _samples) : 0.0f;
+}
+
+bool FrameStats::startRecording(const std::string& filename) {
+	stopRecording();
+	_csv.open(filename);
+	if (!_csv) {
+		std::cerr << "[Frame Stats] Cannot open " << filename << std::endl;
+		return false;
+	}
+	_csvFile = filename;
+	_csvStages.clear();
+	_csvPasses.clear();
+	_pendingRows.clear();
+	_recordedFrames = 0;
+	return true;
+}
+
+void FrameStats::stopRecording() {
+	if (!recording()) return;
+	// The GPU results of the last frames will not be read anymore
+	for (const PendingRow& row : _pendingRows) writeRow(row, nullptr);
+	_pendingRows.clear();
+	_csv.close();
+	std::cout << "[Frame Stats] Wrote " << _recordedFrames << " frames to " << _csvFile << std::endl;
+}
+
+void FrameStats::record(float frameMs, float cpuMs, const GpuProfiler& gpuProfiler) {
+	if (_recordedFrames == 0 && _pendingRows.empty()) {
+		_recordStartNs = traceClockNs();
+		_csv << "frame,time_s,frame_ms,cpu_ms,gpu_ms";
+		for (const FrameStage& stage : _stages) {
+			_csvStages.push_back(stage.name);
+			_csv << ",cpu_" << stage.name;
+		}
+		for (const GpuPassStats& pass : gpuProfiler.passes()) {
+			_csvPasses.push_back(pass.name);
+			_csv << ",gpu_" << pass.name;
+		}
+		_csv << "\n";
+	}
+
+	std::ostringstream head, stages;
+	head << _frameCount << "," << (traceClockNs() - _recordStartNs) / 1e9 << "," << frameMs << "," << cpuMs;
+	for (const std::string& name : _csvStages) {
+		auto stage = std::find_if(_stages.begin(), _stages.end(), [&](const FrameStage& s) { return s.name == name; });
+		stages << "," << stage->currentMs;
+	}
+	_pendingRows.push_back({gpuProfiler.frameIndex(), head.str(), stages.str()});
+
+	// Rows up to the frame resolved by the profiler are complete
+	while (!_pendingRows.empty() && _pendingRows.front().gpuFrame <= gpuProfiler.resolvedFrame()) {
+		const PendingRow& pending = _pendingRows.front();
+		const bool read = pending.gpuFrame == gpuProfiler.resolvedFrame() && gpuProfiler.resolvedFrameRead();
+		writeRow(pending, read ? &gpuProfiler : nullptr);
+		_pendingRows.pop_front();
+	}
+}
+
+void FrameStats::writeRow(const PendingRow& row, const GpuProfiler* gpuProfiler) {
+	_csv << row.head << ",";
+	if (gpuProfiler) _csv << gpuProfiler->frameMs();
+	_csv << row.stages;
+	for (const std::string& name : _csvPasses) {
+		_csv << ",";
+		if (!gpuProfiler) continue;
+		const auto& passes = gpuProfiler->passes();
+		const auto& passMs = gpuProfiler->resolvedPassMs();
+		auto pass = std::find_if(passes.begin(), passes.end(), [&](const GpuPassStats& p) { return p.name == name; });
+		size_t index = size_t(pass - passes.begin());
+		if (index < passMs.size() && passMs[index] >= 0.0) _csv << passMs[index];
+	}
+	_csv << "\n";
+	_recordedFrames++;
+}
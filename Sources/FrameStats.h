@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "GpuProfiler.h"
+#include "Trace.h"
+
+// Over the frames of the history
+struct FrameTimeSummary {
+	size_t frames = 0;
+	float minMs = 0.0f;
+	float averageMs = 0.0f;
+	float maxMs = 0.0f;
+	float p50Ms = 0.0f;
+	float p95Ms = 0.0f;
+	float p99Ms = 0.0f;
+	size_t hitches = 0;
+};
+
+struct FrameStage {
+	std::string name;
+	std::vector<float> history;	// Ring of CPU milliseconds, aligned with the frame history
+	float currentMs = 0.0f;		// Accumulated during the current frame
+};
+
+// Fixed-size history of the frame times with their CPU stage breakdown,
+// and optional per-frame CSV capture of the CPU and GPU timings. CSV rows
+// are held until the GPU results of their frame are read back, and keep
+// empty GPU columns when the profiler dropped that frame.
+class FrameStats {
+   public:
+	static constexpr size_t HistorySize = 600;
+	static constexpr float HitchFactor = 2.0f;	// A hitch takes twice the median frame time
+
+	// Adds CPU time to a stage of the current frame
+	void addStage(const char* name, double ms);
+	// Frame: start to start, CPU: start to swap. GPU times lag FrameLatency frames
+	// behind, the CSV writes them on the row of the frame they were measured for.
+	void endFrame(float frameMs, float cpuMs, const GpuProfiler& gpuProfiler);
+
+	FrameTimeSummary summary() const;
+	static FrameTimeSummary summarize(std::vector<float> frameMs);
+	size_t totalHitches() const { return _totalHitches; }
+	size_t frameCount() const { return _frameCount; }
+
+	// Rings, the oldest sample is at historyOffset()
+	const std::vector<float>& frameHistory() const { return _frameMs; }
+	const std::vector<float>& cpuHistory() const { return _cpuMs; }
+	size_t historyOffset() const { return _next; }
+	size_t samples() const { return _samples; }
+	const std::vector<FrameStage>& stages() const { return _stages; }
+	float stageAverageMs(const FrameStage& stage) const;
+	float stageMaxMs(const FrameStage& stage) const;
+
+	// Columns are fixed by the first recorded frame
+	bool startRecording(const std::string& filename);
+	void stopRecording();
+	bool recording() const { return _csv.is_open(); }
+	size_t recordedFrames() const { return _recordedFrames; }
+	const std::string& recordingFile() const { return _csvFile; }
+
+   private:
+	// CPU columns of a recorded frame waiting for its GPU times
+	struct PendingRow {
+		uint64_t gpuFrame;
+		std::string head;	// Up to cpu_ms
+		std::string stages;
+	};
+
+	void record(float frameMs, float cpuMs, const GpuProfiler& gpuProfiler);
+	// Writes a pending row with the resolved frame of gpuProfiler, or empty GPU columns if null
+	void writeRow(const PendingRow& row, const GpuProfiler* gpuProfiler);
+
+	std::vector<float> _frameMs = std::vector<float>(HistorySize, 0.0f);
+	std::vector<float> _cpuMs = std::vector<float>(HistorySize, 0.0f);
+	std::vector<FrameStage> _stages;
+	size_t _next = 0;
+	size_t _samples = 0;
+	size_t _frameCount = 0;
+
+	float _medianMs = 0.0f;	// Refreshed periodically to detect hitches
+	size_t _totalHitches = 0;
+
+	std::ofstream _csv;
+	std::string _csvFile;
+	std::vector<std::string> _csvStages, _csvPasses;
+	std::deque<PendingRow> _pendingRows;
+	size_t _recordedFrames = 0;
+	uint64_t _recordStartNs = 0;
+};
+
+// Adds the CPU time of its scope to a stage
+class FrameStageTimer {
+   public:
+	FrameStageTimer(FrameStats& stats, const char* name) : _stats(stats), _name(name), _start(traceClockNs()) {}
+	~FrameStageTimer() { _stats.addStage(_name, (traceClockNs() - _start) / 1e6); }
+
+   private:
+	FrameStats& _stats;
+	const char* _name;
+	uint64_t _start;
+};
@@ -2,34 +2,77 @@
 
 #include <glad/glad.h>
 
+#include <iostream>
+
+#include "MemoryTracker.h"
+
+// Offscreen render target: RGBA8 color texture and 24-bit depth renderbuffer
 class Framebuffer {
    public:
 	Framebuffer(int width, int height) : m_width(width), m_height(height) {}
-	~Framebuffer() { glDeleteFramebuffers(1, &m_fbo); }
+	~Framebuffer() { release(); }
 
-	void init() {
-		glGenFramebuffers(1, &m_fbo);
-		bind();
+	Framebuffer(const Framebuffer&) = delete;
+	Framebuffer& operator=(const Framebuffer&) = delete;
 
-		glGenTextures(1, &m_texture);
-		glBindTexture(GL_TEXTURE_2D, m_texture);
+	// Creates the attachments, false if the framebuffer is incomplete
+	bool init() {
+		glCreateFramebuffers(1, &m_fbo);
 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_width, m_height, 0, GL_RGB,
-					 GL_UNSIGNED_BYTE, NULL);
+		glCreateTextures(GL_TEXTURE_2D, 1, &m_texture);
+		glTextureStorage2D(m_texture, 1, GL_RGBA8, m_width, m_height);
+		MemoryTracker::trackTexture(m_texture, size_t(m_width) * m_height * 4, MemoryCategory::RenderTargets);
+		glTextureParameteri(m_texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(m_texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glNamedFramebufferTexture(m_fbo, GL_COLOR_ATTACHMENT0, m_texture, 0);
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glCreateRenderbuffers(1, &m_depth);
+		glNamedRenderbufferStorage(m_depth, GL_DEPTH_COMPONENT24, m_width, m_height);
+		MemoryTracker::trackRenderbuffer(m_depth, size_t(m_width) * m_height * 4, MemoryCategory::RenderTargets);
+		glNamedFramebufferRenderbuffer(m_fbo, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth);
+
+		GLenum status = glCheckNamedFramebufferStatus(m_fbo, GL_FRAMEBUFFER);
+		if (status != GL_FRAMEBUFFER_COMPLETE) {
+			std::cerr << "Framebuffer " << m_width << "x" << m_height << " incomplete: 0x" << std::hex << status
+					  << std::dec << std::endl;
+			return false;
+		}
+		return true;
+	}
 
-		glFramebufferTexture2D(GL_TEXTURE_2D, GL_COLOR_ATTACHMENT0,
-							   GL_TEXTURE_2D, m_texture, 0);
+	bool resize(int width, int height) {
+		if (m_fbo && width == m_width && height == m_height) return true;
+		release();
+		m_width = width;
+		m_height = height;
+		return init();
 	}
 
-	void bind() { glBindFramebuffer(GL_FRAMEBUFFER, m_fbo); }
+	// Binds the framebuffer for drawing, with a viewport covering it
+	void bind() {
+		glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+		glViewport(0, 0, m_width, m_height);
+	}
 	void unbind() { glBindFramebuffer(GL_FRAMEBUFFER, 0); }
 
+	GLuint id() const { return m_fbo; }
+	GLuint colorTexture() const { return m_texture; }
+	int width() const { return m_width; }
+	int height() const { return m_height; }
+
    private:
-	GLuint m_fbo;
-	GLuint m_texture;
+	void release() {
+		MemoryTracker::releaseTexture(m_texture);
+		MemoryTracker::releaseRenderbuffer(m_depth);
+		glDeleteFramebuffers(1, &m_fbo);
+		glDeleteTextures(1, &m_texture);
+		glDeleteRenderbuffers(1, &m_depth);
+		m_fbo = m_texture = m_depth = 0;
+	}
+
+	GLuint m_fbo = 0;
+	GLuint m_texture = 0;
+	GLuint m_depth = 0;
 	int m_width;
 	int m_height;
-};
\ No newline at end of file
+};
@@ -0,0 +1,159 @@
+#include "GpuArena.h"
+
+#include <algorithm>
+#include <iostream>
+
+GpuArena::GpuArena(size_t capacity) : _capacity(capacity) {
+	if (capacity > 0) addFreeBlock(0, capacity);
+}
+
+GpuArena::~GpuArena() {
+	for (PendingFree& pending : _pendingFrees) {
+		if (pending.fence) glDeleteSync(pending.fence);
+	}
+}
+
+GpuArena::Handle GpuArena::allocate(size_t size) {
+	if (size == 0) size = 1;
+	auto best = _freeBySize.lower_bound(size);
+	if (best == _freeBySize.end()) return InvalidHandle;
+
+	const size_t offset = best->second;
+	const size_t blockSize = best->first;
+	removeFreeBlock(_freeByOffset.find(offset));
+	if (blockSize > size) addFreeBlock(offset + size, blockSize - size);
+
+	Handle handle;
+	if (_unusedHandles.empty()) {
+		handle = Handle(_allocations.size());
+		_allocations.emplace_back();
+	} else {
+		handle = _unusedHandles.back();
+		_unusedHandles.pop_back();
+	}
+	_allocations[handle] = {offset, size, true};
+	_used += size;
+	return handle;
+}
+
+void GpuArena::free(Handle handle) {
+	if (handle == InvalidHandle || !_allocations[handle].live) return;
+	_allocations[handle].live = false;
+	_used -= _allocations[handle].size;
+	_pending += _allocations[handle].size;
+	if (_pendingFrees.empty() || _pendingFrees.back().fence) _pendingFrees.push_back({nullptr, {}});
+	_pendingFrees.back().handles.push_back(handle);
+}
+
+void GpuArena::endFrame() {
+	if (!_pendingFrees.empty() && !_pendingFrees.back().fence)
+		_pendingFrees.back().fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	// Fences signal in order, stop at the first one still running
+	size_t done = 0;
+	for (; done < _pendingFrees.size(); done++) {
+		PendingFree& pending = _pendingFrees[done];
+		const GLenum status = glClientWaitSync(pending.fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+			// On a failed wait the GPU may still read the ranges, they are kept until it succeeds
+			if (status == GL_WAIT_FAILED)
+				std::cerr << "[GPU Arena] Fence wait failed, keeping " << pending.handles.size()
+						  << " freed ranges" << std::endl;
+			break;
+		}
+		glDeleteSync(pending.fence);
+		for (Handle handle : pending.handles) release(handle);
+	}
+	_pendingFrees.erase(_pendingFrees.begin(), _pendingFrees.begin() + done);
+}
+
+void GpuArena::release(Handle handle) {
+	Allocation& allocation = _allocations[handle];
+	_pending -= allocation.size;
+	addFreeBlock(allocation.offset, allocation.size);
+	allocation = Allocation();
+	_unusedHandles.push_back(handle);
+}
+
+std::vector<GpuArena::Move> GpuArena::defragment(size_t newCapacity) {
+	for (PendingFree& pending : _pendingFrees) {
+		if (pending.fence) glDeleteSync(pending.fence);
+		for (Handle handle : pending.handles) {
+			_allocations[handle] = Allocation();
+			_unusedHandles.push_back(handle);
+		}
+	}
+	_pendingFrees.clear();
+	_pending = 0;
+
+	// Live allocations in offset order, packed from the start
+	std::vector<Handle> live;
+	for (Handle handle = 0; handle < _allocations.size(); handle++) {
+		if (_allocations[handle].live) live.push_back(handle);
+	}
+	std::sort(live.begin(), live.end(),
+			  [&](Handle a, Handle b) { return _allocations[a].offset < _allocations[b].offset; });
+
+	std::vector<Move> moves;
+	size_t offset = 0;
+	for (Handle handle : live) {
+		Allocation& allocation = _allocations[handle];
+		// Merge contiguous ranges into a single copy
+		if (!moves.empty() && moves.back().from + moves.back().size == allocation.offset)
+			moves.back().size += allocation.size;
+		else
+			moves.push_back({allocation.offset, offset, allocation.size});
+		allocation.offset = offset;
+		offset += allocation.size;
+	}
+
+	_capacity = std::max(newCapacity, _capacity);
+	_freeByOffset.clear();
+	_freeBySize.clear();
+	if (offset < _capacity) addFreeBlock(offset, _capacity - offset);
+	return moves;
+}
+
+GpuArenaStats GpuArena::stats() const {
+	GpuArenaStats stats;
+	stats.capacity = _capacity;
+	stats.used = _used;
+	stats.pending = _pending;
+	stats.freeBlocks = _freeByOffset.size();
+	stats.largestFree = _freeBySize.empty() ? 0 : _freeBySize.rbegin()->first;
+	stats.allocations = _allocations.size() - _unusedHandles.size();
+	size_t totalFree = _capacity - _used - _pending;
+	stats.fragmentation = totalFree > 0 ? 1.0f - float(stats.largestFree) / float(totalFree) : 0.0f;
+	return stats;
+}
+
+void GpuArena::addFreeBlock(size_t offset, size_t size) {
+	// Coalesce with the previous and next free blocks
+	auto next = _freeByOffset.lower_bound(offset);
+	if (next != _freeByOffset.begin()) {
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset) {
+			offset = previous->first;
+			size += previous->second;
+			removeFreeBlock(previous);
+		}
+	}
+	next = _freeByOffset.lower_bound(offset);
+	if (next != _freeByOffset.end() && offset + size == next->first) {
+		size += next->second;
+		removeFreeBlock(next);
+	}
+	_freeByOffset.emplace(offset, size);
+	_freeBySize.emplace(size, offset);
+}
+
+void GpuArena::removeFreeBlock(std::map<size_t, size_t>::iterator block) {
+	auto range = _freeBySize.equal_range(block->second);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second == block->first) {
+			_freeBySize.erase(it);
+			break;
+		}
+	}
+	_freeByOffset.erase(block);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+struct GpuArenaStats {
+	size_t capacity = 0;
+	size_t used = 0;		  // Live allocations
+	size_t pending = 0;		  // Freed, waiting for the GPU to stop reading them
+	size_t largestFree = 0;
+	size_t freeBlocks = 0;
+	size_t allocations = 0;
+	float fragmentation = 0.0f;	// 1 - largest free block / total free space
+};
+
+// Range allocator for the content of large GPU buffers, in abstract units
+// (vertices, indices...). Best-fit over a free list kept sorted by offset
+// and by size, with neighbouring free blocks coalesced. Freed ranges are
+// only reused once the frames that may still read them have completed.
+// The arena does not own any buffer: when it is defragmented or grown, the
+// owner copies the returned moves to a new buffer.
+class GpuArena {
+   public:
+	using Handle = uint32_t;
+	static const Handle InvalidHandle = ~0u;
+
+	struct Move {
+		size_t from, to, size;
+	};
+
+	GpuArena(size_t capacity);
+	~GpuArena();
+
+	GpuArena(const GpuArena&) = delete;
+	GpuArena& operator=(const GpuArena&) = delete;
+
+	// InvalidHandle if no free block is large enough
+	Handle allocate(size_t size);
+	// The range is released after the fence of the current frame
+	void free(Handle handle);
+
+	size_t offset(Handle handle) const { return _allocations[handle].offset; }
+	size_t size(Handle handle) const { return _allocations[handle].size; }
+
+	// Fences the frees of the frame and releases the ones the GPU is done with
+	void endFrame();
+
+	// Packs the live allocations at the start of a (possibly larger) new
+	// buffer. Pending frees are dropped since the old buffer keeps their data
+	// for the frames in flight. Returns the ranges to copy from the old buffer.
+	std::vector<Move> defragment(size_t newCapacity = 0);
+
+	size_t capacity() const { return _capacity; }
+	GpuArenaStats stats() const;
+
+   private:
+	struct Allocation {
+		size_t offset = 0;
+		size_t size = 0;
+		bool live = false;
+	};
+
+	struct PendingFree {
+		GLsync fence;	// nullptr until the end of the frame
+		std::vector<Handle> handles;
+	};
+
+	void addFreeBlock(size_t offset, size_t size);
+	void removeFreeBlock(std::map<size_t, size_t>::iterator block);
+	void release(Handle handle);
+
+	size_t _capacity;
+	size_t _used = 0;
+	size_t _pending = 0;
+
+	std::vector<Allocation> _allocations;
+	std::vector<Handle> _unusedHandles;
+
+	std::map<size_t, size_t> _freeByOffset;			// offset -> size
+	std::multimap<size_t, size_t> _freeBySize;		// size -> offset
+
+	std::vector<PendingFree> _pendingFrees;
+};
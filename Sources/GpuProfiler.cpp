@@ -0,0 +1,109 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <iostream>
+
+GpuProfiler::GpuProfiler() {
+	// Both clocks count nanoseconds, a single offset maps the GPU time to the trace clock
+	GLint64 gpuNow;
+	glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+	_gpuToCpuNs = int64_t(traceClockNs()) - int64_t(gpuNow);
+}
+
+GpuProfiler::~GpuProfiler() {
+	for (FrameQueries& frame : _frames) {
+		for (Query& query : frame.queries) {
+			GLuint ids[] = {query.elapsed, query.timestamp};
+			glDeleteQueries(2, ids);
+		}
+	}
+}
+
+void GpuProfiler::beginFrame() {
+	if (_active) end();
+	_frame = (_frame + 1) % FrameLatency;
+	FrameQueries& frame = _frames[_frame];
+	_resolvedFrame = frame.index;
+	_resolvedRead = false;
+	readBack(frame);
+	frame.used = 0;
+	frame.index = ++_frameIndex;
+}
+
+void GpuProfiler::begin(const std::string& pass) {
+	if (_active) {
+		std::cerr << "[GPU Profiler] Pass " << pass << " started inside another pass" << std::endl;
+		end();
+	}
+	auto found = _passIndices.find(pass);
+	if (found == _passIndices.end()) {
+		found = _passIndices.emplace(pass, _passes.size()).first;
+		GpuPassStats stats;
+		stats.name = pass;
+		stats.history.assign(HistorySize, 0.0f);
+		_passes.push_back(std::move(stats));
+	}
+
+	FrameQueries& frame = _frames[_frame];
+	if (frame.used == frame.queries.size()) {
+		Query query{};
+		glCreateQueries(GL_TIME_ELAPSED, 1, &query.elapsed);
+		glCreateQueries(GL_TIMESTAMP, 1, &query.timestamp);
+		frame.queries.push_back(query);
+	}
+	Query& query = frame.queries[frame.used++];
+	query.pass = found->second;
+	glQueryCounter(query.timestamp, GL_TIMESTAMP);
+	glBeginQuery(GL_TIME_ELAPSED, query.elapsed);
+	_active = true;
+}
+
+void GpuProfiler::end() {
+	if (!_active) return;
+	glEndQuery(GL_TIME_ELAPSED);
+	_active = false;
+}
+
+void GpuProfiler::readBack(FrameQueries& frame) {
+	if (frame.used == 0) return;
+	// Queries complete in order, the frame is ready once its last one is
+	GLint available = 0;
+	glGetQueryObjectiv(frame.queries[frame.used - 1].elapsed, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) {
+		_droppedFrames++;
+		return;
+	}
+
+	std::vector<double> passMs(_passes.size(), -1.0);
+	_frameMs = 0.0;
+	for (size_t i = 0; i < frame.used; i++) {
+		const Query& query = frame.queries[i];
+		GLuint64 elapsed = 0, timestamp = 0;
+		glGetQueryObjectui64v(query.elapsed, GL_QUERY_RESULT, &elapsed);
+		glGetQueryObjectui64v(query.timestamp, GL_QUERY_RESULT, &timestamp);
+		passMs[query.pass] = std::max(passMs[query.pass], 0.0) + elapsed / 1e6;
+		_frameMs += elapsed / 1e6;
+		if (_recording)
+			_recorded.push_back({_passes[query.pass].name, uint64_t(int64_t(timestamp) + _gpuToCpuNs), elapsed,
+								 GpuTraceThread});
+	}
+
+	_resolvedRead = true;
+	_resolvedPassMs = passMs;
+
+	for (size_t p = 0; p < _passes.size(); p++) {
+		if (passMs[p] < 0.0) continue;	// Pass not used this frame
+		GpuPassStats& stats = _passes[p];
+		stats.lastMs = passMs[p];
+		stats.history[stats.next] = float(passMs[p]);
+		stats.next = (stats.next + 1) % HistorySize;
+		stats.samples = std::min(stats.samples + 1, HistorySize);
+		double sum = 0.0, peak = 0.0;
+		for (float sample : stats.history) {
+			sum += sample;
+			peak = std::max(peak, double(sample));
+		}
+		stats.averageMs = sum / stats.samples;
+		stats.maxMs = peak;
+	}
+}
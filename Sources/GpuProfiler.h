@@ -0,0 +1,106 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Trace.h"
+
+struct GpuPassStats {
+	std::string name;
+	double lastMs = 0.0;
+	double averageMs = 0.0;	// Over the last HistorySize frames
+	double maxMs = 0.0;
+	std::vector<float> history;	// Ring of the last HistorySize times
+	size_t next = 0;
+	size_t samples = 0;
+};
+
+// Measures the GPU time of render passes with GL_TIME_ELAPSED queries.
+// Queries are double-buffered: the results of a frame are read two frames
+// later, only if the GPU already has them, so reading never stalls. Frames
+// whose results are not ready yet are dropped. Passes cannot be nested.
+// Each pass also records a GL_TIMESTAMP to place it in traces, converted to
+// the CPU trace clock.
+class GpuProfiler {
+   public:
+	static const int FrameLatency = 2;
+	static const size_t HistorySize = 120;
+
+	GpuProfiler();
+	~GpuProfiler();
+
+	GpuProfiler(const GpuProfiler&) = delete;
+	GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+	// Reads back the results of the frame using the same queries
+	void beginFrame();
+	void begin(const std::string& pass);
+	void end();
+
+	const std::vector<GpuPassStats>& passes() const { return _passes; }
+	double frameMs() const { return _frameMs; }	// Sum of the passes of the last read frame
+	size_t droppedFrames() const { return _droppedFrames; }
+
+	// Frames are numbered from 1 by beginFrame(). Each beginFrame() resolves the
+	// frame issued FrameLatency frames earlier: its results are read, or it is
+	// dropped. 0 when no frame was resolved yet.
+	uint64_t frameIndex() const { return _frameIndex; }
+	uint64_t resolvedFrame() const { return _resolvedFrame; }
+	bool resolvedFrameRead() const { return _resolvedRead; }
+	// Milliseconds of the resolved frame per pass, in passes() order, negative for passes it did not use
+	const std::vector<double>& resolvedPassMs() const { return _resolvedPassMs; }
+
+	// Recorded passes, on the GpuTraceThread track
+	void setRecording(bool recording) { _recording = recording; }
+	bool recording() const { return _recording; }
+	std::vector<TraceEvent>& recorded() { return _recorded; }
+
+	static const uint32_t GpuTraceThread = 0xFFFF;
+
+   private:
+	struct Query {
+		GLuint elapsed;
+		GLuint timestamp;
+		size_t pass;
+	};
+
+	struct FrameQueries {
+		std::vector<Query> queries;	// Created lazily, reused every FrameLatency frames
+		size_t used = 0;
+		uint64_t index = 0;	// Frame that issued the queries
+	};
+
+	void readBack(FrameQueries& frame);
+
+	FrameQueries _frames[FrameLatency];
+	int _frame = 0;
+	bool _active = false;
+
+	std::vector<GpuPassStats> _passes;
+	std::unordered_map<std::string, size_t> _passIndices;
+	double _frameMs = 0.0;
+	size_t _droppedFrames = 0;
+
+	uint64_t _frameIndex = 0;
+	uint64_t _resolvedFrame = 0;
+	bool _resolvedRead = false;
+	std::vector<double> _resolvedPassMs;
+
+	int64_t _gpuToCpuNs = 0;	// Trace clock - GL_TIMESTAMP
+	bool _recording = false;
+	std::vector<TraceEvent> _recorded;
+};
+
+// Measures the GPU time of the commands issued during its scope
+class GpuZone {
+   public:
+	GpuZone(GpuProfiler& profiler, const std::string& pass) : _profiler(profiler) { _profiler.begin(pass); }
+	~GpuZone() { _profiler.end(); }
+
+   private:
+	GpuProfiler& _profiler;
+};
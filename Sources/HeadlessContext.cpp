@@ -0,0 +1,96 @@
+#include "HeadlessContext.h"
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#ifdef PLANETGEN_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <iostream>
+
+#include "Error.h"
+
+HeadlessContext::HeadlessContext() {
+	_valid = createEGL() || createGLFW();
+	if (!_valid) {
+		std::cerr << "[Headless] Cannot create an OpenGL 4.5 context" << std::endl;
+		return;
+	}
+	std::cout << "[Headless] " << _api << " context: " << glGetString(GL_RENDERER) << ", "
+			  << glGetString(GL_VERSION) << std::endl;
+	glEnable(GL_DEBUG_OUTPUT);
+	glDebugMessageCallback(debugMessageCallback, nullptr);
+}
+
+HeadlessContext::~HeadlessContext() {
+#ifdef PLANETGEN_EGL
+	if (_eglContext) {
+		eglMakeCurrent(_eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(_eglDisplay, _eglContext);
+		eglTerminate(_eglDisplay);
+	}
+#endif
+	if (_window) {
+		glfwDestroyWindow(static_cast<GLFWwindow*>(_window));
+		glfwTerminate();
+	}
+}
+
+bool HeadlessContext::createEGL() {
+#ifdef PLANETGEN_EGL
+	EGLDisplay display = EGL_NO_DISPLAY;
+	auto getPlatformDisplay =
+		reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+	if (getPlatformDisplay) display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	if (display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) return false;
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		eglTerminate(display);
+		return false;
+	}
+	// No config and no surface (EGL_KHR_no_config_context, EGL_KHR_surfaceless_context)
+	const EGLint attributes[] = {EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 5,
+								 EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+								 EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE, EGL_NONE};
+	EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+	if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context) ||
+		!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress))) {
+		if (context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+		eglTerminate(display);
+		return false;
+	}
+	_eglDisplay = display;
+	_eglContext = context;
+	_api = "EGL surfaceless";
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool HeadlessContext::createGLFW() {
+	if (!glfwInit()) return false;
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* window = glfwCreateWindow(64, 64, "Planet Generation (headless)", nullptr, nullptr);
+	if (!window) {
+		glfwTerminate();
+		return false;
+	}
+	glfwMakeContextCurrent(window);
+	if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress))) {
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		return false;
+	}
+	_window = window;
+	_api = "hidden GLFW window";
+	return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+// OpenGL 4.5 core context for rendering without any visible window, e.g. on
+// render farms with a software driver. Built with PLANETGEN_EGL, the context
+// is created on an EGL surfaceless display (no display server needed), with
+// a fallback to a hidden GLFW window, which is the only option otherwise.
+// Rendering goes to offscreen framebuffers.
+class HeadlessContext {
+   public:
+	HeadlessContext();
+	~HeadlessContext();
+
+	HeadlessContext(const HeadlessContext&) = delete;
+	HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+	// The context is current and GL is loaded
+	bool valid() const { return _valid; }
+	const char* api() const { return _api; }
+
+   private:
+	bool createEGL();
+	bool createGLFW();
+
+	bool _valid = false;
+	const char* _api = "none";
+
+	void* _eglDisplay = nullptr;
+	void* _eglContext = nullptr;
+	void* _window = nullptr;	// GLFWwindow
+};
@@ -7,15 +7,22 @@
 #include <sstream>
 
 #include <algorithm>
+#include <cstdio>
 
 #include <curl/curl.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-#include <glad/glad.h>
+#include "Mesh.h"
+#include "Profiler.h"
+#include "TaskScheduler.h"
+#include "TileCache.h"
+
+std::string IO::s_tileURL = "https://tile.openstreetmap.org/{z}/{x}/{y}.png";
 
 std::string IO::file2String(const std::string& filename) {
+	PROFILE_SCOPE("IO::file2String");
 	std::ifstream input(filename.c_str());
 	if (!input)
 		throw std::ios_base::failure("[Shader Program][file2String] Error: cannot open " + filename);
@@ -45,9 +52,67 @@ void IO::savePPM(const std::string& filename, int width, int height, const std::
 	out.close();
 }
 
-bool decodePNG(const std::vector<unsigned char>& pngData,
-			   int& width, int& height,
-			   std::vector<GLubyte>& outPixels) {
+// Wavefront OBJ with the normals and texture coordinates the mesh has
+bool IO::saveOBJ(const std::string& filename, const Mesh& mesh) {
+	PROFILE_SCOPE("IO::saveOBJ");
+	std::ofstream out(filename);
+	if (!out) {
+		std::cerr << "Cannot open file " << filename << std::endl;
+		return false;
+	}
+	const bool hasNormals = mesh.normals().size() == mesh.positions().size();
+	const bool hasTexCoords = mesh.texCoords().size() == mesh.positions().size();
+
+	// Blocks of lines are formatted in parallel, then written in order
+	const size_t BlockLines = 8192;
+	auto write = [&](size_t count, auto formatLine) {
+		std::vector<std::string> blocks((count + BlockLines - 1) / BlockLines);
+		parallelFor(0, blocks.size(), 1, [&](size_t begin, size_t end) {
+			char line[128];
+			for (size_t b = begin; b < end; b++) {
+				for (size_t i = b * BlockLines; i < std::min(count, (b + 1) * BlockLines); i++)
+					blocks[b].append(line, formatLine(line, sizeof(line), i));
+			}
+		});
+		for (const std::string& block : blocks) out << block;
+	};
+	auto lineLength = [](int written, size_t size) { return std::min(size_t(std::max(written, 0)), size - 1); };
+
+	write(mesh.positions().size(), [&](char* line, size_t size, size_t i) {
+		const glm::vec3& p = mesh.positions()[i];
+		return lineLength(std::snprintf(line, size, "v %.6f %.6f %.6f\n", p.x, p.y, p.z), size);
+	});
+	if (hasTexCoords)
+		write(mesh.texCoords().size(), [&](char* line, size_t size, size_t i) {
+			const glm::vec2& t = mesh.texCoords()[i];
+			return lineLength(std::snprintf(line, size, "vt %.6f %.6f\n", t.x, t.y), size);
+		});
+	if (hasNormals)
+		write(mesh.normals().size(), [&](char* line, size_t size, size_t i) {
+			const glm::vec3& n = mesh.normals()[i];
+			return lineLength(std::snprintf(line, size, "vn %.6f %.6f %.6f\n", n.x, n.y, n.z), size);
+		});
+	// OBJ indices start at 1
+	const char* faceFormat = hasNormals && hasTexCoords ? "f %u/%u/%u %u/%u/%u %u/%u/%u\n"
+							 : hasNormals			   ? "f %u//%u %u//%u %u//%u\n"
+							 : hasTexCoords			   ? "f %u/%u %u/%u %u/%u\n"
+													   : "f %u %u %u\n";
+	const int perVertex = hasNormals && hasTexCoords ? 3 : hasNormals || hasTexCoords ? 2 : 1;
+	write(mesh.indices().size(), [&](char* line, size_t size, size_t i) {
+		const glm::uvec3 t = mesh.indices()[i] + 1u;
+		unsigned int v[9] = {};
+		for (int k = 0; k < 3; k++)
+			for (int j = 0; j < perVertex; j++) v[k * perVertex + j] = t[k];
+		return lineLength(std::snprintf(line, size, faceFormat, v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8]),
+						  size);
+	});
+	return bool(out);
+}
+
+bool IO::decodePNG(const std::vector<unsigned char>& pngData,
+				   int& width, int& height,
+				   std::vector<unsigned char>& outPixels) {
+	PROFILE_SCOPE("IO::decodePNG");
 	// stbi_set_flip_vertically_on_load(true);
 
 	int comp;
@@ -75,12 +140,15 @@ size_t IO::write_data(void* ptr, size_t size, size_t nmemb, void* userdata) {
 	return total;
 }
 
-bool IO::fetchTilePNG(int z, int x, int y, int& outWidth, int& outHeight, std::vector<GLubyte>& outPixels) {
+bool IO::fetchTilePNG(int z, int x, int y, int& outWidth, int& outHeight, std::vector<unsigned char>& outPixels) {
+	PROFILE_SCOPE("IO::fetchTilePNG");
 	// 1) Build the URL
-	char url[256];
-	std::snprintf(url, sizeof(url),
-				  "https://tile.openstreetmap.org/%d/%d/%d.png",
-				  z, x, y);
+	std::string url = s_tileURL;
+	const std::pair<const char*, int> fields[] = {{"{z}", z}, {"{x}", x}, {"{y}", y}};
+	for (const auto& field : fields) {
+		size_t pos = url.find(field.first);
+		if (pos != std::string::npos) url.replace(pos, 3, std::to_string(field.second));
+	}
 
 	// 2) Initialize curl
 	CURL* curl = curl_easy_init();
@@ -90,11 +158,11 @@ bool IO::fetchTilePNG(int z, int x, int y, int& outWidth, int& outHeight, std::v
 	}
 
 	// Buffer to hold the downloaded data
-	std::vector<GLubyte> pngData;
+	std::vector<unsigned char> pngData;
 
 	// 3) Set curl options
 	curl_easy_setopt(curl, CURLOPT_USERAGENT, "PlanetGen/1.0 (telo.philippe@gmail.com)");
-	curl_easy_setopt(curl, CURLOPT_URL, url);
+	curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
 	// Follow HTTP redirects if any
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
 	// Write callback into our buffer
@@ -104,7 +172,11 @@ bool IO::fetchTilePNG(int z, int x, int y, int& outWidth, int& outHeight, std::v
 	curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
 
 	// 4) Perform the request
-	CURLcode res = curl_easy_perform(curl);
+	CURLcode res;
+	{
+		PROFILE_SCOPE("IO::download");
+		res = curl_easy_perform(curl);
+	}
 	if (res != CURLE_OK) {
 		std::cerr << "curl_easy_perform() failed: "
 				  << curl_easy_strerror(res) << "\n";
@@ -128,25 +200,7 @@ bool IO::fetchTilePNG(int z, int x, int y, int& outWidth, int& outHeight, std::v
 	return true;
 }
 
-unsigned int IO::fetchTileToTexture(int z, int x, int y) {
-	int width, height;
-	std::vector<GLubyte> pixels;
-	if (!fetchTilePNG(z, x, y, width, height, pixels)) {
-		std::cerr << "Failed to fetch tile PNG\n";
-		return 0;
-	}
-
-	std::cout << "Fetched tile PNG: " << width << "x" << height << ", tot: " << pixels.size() << "\n";
-
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_2D, textureID);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glGenerateMipmap(GL_TEXTURE_2D);
-
-	return textureID;
+TileCache& IO::tileCache() {
+	static TileCache cache;
+	return cache;
 }
@@ -5,17 +5,24 @@
 #include <vector>
 #include <glm/glm.hpp>
 
-#include <glad/glad.h>
-
 class Mesh;
+class TileCache;
 
 class IO {
    private:
 	static size_t write_data(void* ptr, size_t size, size_t nmemb, void* userdata);
 
+	static std::string s_tileURL;
+
    public:
 	static std::string file2String(const std::string& filename);
 	static void savePPM(const std::string& filename, int width, int height, const std::vector<glm::vec3>& pixels);
-	static bool fetchTilePNG(int z, int x, int y, int& outWidth, int& outHeight, std::vector<GLubyte>& outPixels);
-	static unsigned int fetchTileToTexture(int z, int x, int y);
+	static bool saveOBJ(const std::string& filename, const Mesh& mesh);
+	// Tile source, with {z}, {x} and {y} placeholders
+	static void setTileURL(const std::string& urlTemplate) { s_tileURL = urlTemplate; }
+	// Decodes a PNG to tightly packed RGB8
+	static bool decodePNG(const std::vector<unsigned char>& pngData, int& width, int& height,
+						  std::vector<unsigned char>& outPixels);
+	static bool fetchTilePNG(int z, int x, int y, int& outWidth, int& outHeight, std::vector<unsigned char>& outPixels);
+	static TileCache& tileCache();
 };
\ No newline at end of file
@@ -1,11 +1,10 @@
 #include "Light.h"
 
-void DirectionalLight::setUniforms(ShaderProgram& program, std::string name) const {
+#include <cmath>
+#include <limits>
 
-    program.set(name + ".type", 0);
-    program.set(name + ".color", _color);
-    program.set(name + ".intensity", _intensity);
-    program.set(name + ".direction", _direction);
+GPULight DirectionalLight::toGPU() const {
+    return {_direction, 0, _color, _intensity, 0.0f, 0.0f, 0.0f};
 }
 
 void DirectionalLight::setDirection(const glm::vec3& direction) {
@@ -17,20 +16,20 @@ void DirectionalLight::setDirection(const glm::vec3& direction) {
     setRotation(glm::eulerAngles(glm::quat(rotationMatrix)));
 }
 
-void PointLight::setUniforms(ShaderProgram& program, std::string name) const {
-
-    glm::vec3 origin = getTranslation();
-
-    program.set(name + ".type", 1);
-    program.set(name + ".color", _color);
-    program.set(name + ".intensity", _intensity);
-    program.set(name + ".direction", origin);
-    program.set(name + ".ac", ac);
-    program.set(name + ".al", al);
-    program.set(name + ".aq", aq);
+GPULight PointLight::toGPU() const {
+    return {getTranslation(), 1, _color, _intensity, ac, al, aq};
 }
 
 float PointLight::intensity(glm::vec3 pos) const {
     float distance = glm::length(getTranslation() - pos);
     return _intensity / (ac + al * distance + aq * distance * distance);
+}
+
+float PointLight::radius(float cutoff) const {
+    // Solve ac + al * d + aq * d^2 = intensity * color / cutoff
+    float k = _intensity * glm::max(_color.r, glm::max(_color.g, _color.b)) / cutoff;
+    if (k <= ac) return 0.0f;
+    if (aq > 0.0f) return (-al + std::sqrt(al * al + 4.0f * aq * (k - ac))) / (2.0f * aq);
+    if (al > 0.0f) return (k - ac) / al;
+    return std::numeric_limits<float>::infinity();
 }
\ No newline at end of file
@@ -5,9 +5,20 @@
 
 #include <string>
 
-#include "ShaderProgram.h"
+#include "ShaderBuffer.h"
 #include "Transform.h"
 
+// std430 layout of LightSource in PlanetShader.frag
+struct GPULight {
+    glm::vec3 direction; // Directional light: direction, Point light: position
+    int type;
+    glm::vec3 color;
+    float intensity;
+    float ac, al, aq;
+    float padding = 0.0f;
+};
+static_assert(sizeof(GPULight) == 48, "GPULight must match the std430 layout");
+
 class AbstractLight : public Transform {
 protected:
     glm::vec3 _color;
@@ -15,7 +26,9 @@ protected:
     int _type = -1;
 public:
     AbstractLight(const glm::vec3& color, float intensity, int type) : Transform(), _color(color), _intensity(intensity), _type(type) {}
-    virtual void setUniforms(ShaderProgram& program, std::string name) const = 0;
+    virtual GPULight toGPU() const = 0;
+    // Writes the light at offset in a buffer block, unchanged lights are not uploaded again
+    void write(ShaderBuffer& buffer, size_t offset) const { buffer.write(offset, toGPU()); }
     //int getType() const { return type; }
     const int getType() const { return _type; }
 
@@ -37,7 +50,7 @@ public:
     DirectionalLight(const glm::vec3& color, float intensity, const glm::vec3& direction) : AbstractLight(color, intensity, 0) {
         _direction = glm::normalize(direction);
     }
-    void setUniforms(ShaderProgram& program, std::string name) const override;
+    GPULight toGPU() const override;
 
     void setDirection(const glm::vec3& direction);
     glm::vec3 getDirection() const { return _direction; }
@@ -57,9 +70,11 @@ public:
     PointLight(const glm::vec3& color, float intensity, const glm::vec3& origin, float ac, float al, float aq) : AbstractLight(color, intensity, 1), ac(ac), al(al), aq(aq) {
         setTranslation(origin);
     }
-    void setUniforms(ShaderProgram& program, std::string name) const override;
+    GPULight toGPU() const override;
 
     float intensity(glm::vec3 pos) const override;
+    // Distance beyond which the brightest channel falls under cutoff, infinite without attenuation
+    float radius(float cutoff) const;
     glm::vec3 wi(glm::vec3 pos) const override { return glm::normalize(getTranslation() - pos); }
     float distance(glm::vec3 pos) const override { return glm::length(getTranslation() - pos); }
 
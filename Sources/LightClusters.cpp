@@ -0,0 +1,237 @@
+#include "LightClusters.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+#include "TaskScheduler.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CLUSTERS_USE_SSE2
+#endif
+
+LightClusters::LightClusters()
+	: _clusterBuffer(std::make_unique<ShaderBuffer>(GL_SHADER_STORAGE_BUFFER, ClusterBufferBinding,
+													sizeof(Header) + GridX * GridY * GridZ * sizeof(glm::uvec2))),
+	  _indexBuffer(std::make_unique<ShaderBuffer>(GL_SHADER_STORAGE_BUFFER, ClusterIndexBufferBinding)),
+	  _cells(GridX * GridY * GridZ) {}
+
+void LightClusters::computeClusterBounds(const Camera& camera) {
+	_fov = camera.getFoV();
+	_aspectRatio = camera.getAspectRatio();
+	_near = camera.getNear();
+	_far = camera.getFar();
+
+	const float tanHalfY = std::tan(glm::radians(_fov) * 0.5f);
+	const float tanHalfX = tanHalfY * _aspectRatio;
+	for (std::vector<float>* coordinate : {&_bounds.minX, &_bounds.minY, &_bounds.minZ, &_bounds.maxX,
+										   &_bounds.maxY, &_bounds.maxZ})
+		coordinate->assign(GridX * GridY * GridZ + 3, 0.0f);
+	for (int k = 0; k < GridZ; k++) {
+		// Exponential slices: constant ratio between the far and near depth of a slice
+		const float d0 = _near * std::pow(_far / _near, float(k) / GridZ);
+		const float d1 = _near * std::pow(_far / _near, float(k + 1) / GridZ);
+		for (int j = 0; j < GridY; j++) {
+			const float y0 = -1.0f + 2.0f * j / GridY, y1 = -1.0f + 2.0f * (j + 1) / GridY;
+			for (int i = 0; i < GridX; i++) {
+				const float x0 = -1.0f + 2.0f * i / GridX, x1 = -1.0f + 2.0f * (i + 1) / GridX;
+				glm::vec3 boxMin(std::numeric_limits<float>::max()), boxMax(-std::numeric_limits<float>::max());
+				for (float d : {d0, d1}) {
+					for (float x : {x0, x1}) {
+						for (float y : {y0, y1}) {
+							glm::vec3 corner(x * tanHalfX * d, y * tanHalfY * d, -d);
+							boxMin = glm::min(boxMin, corner);
+							boxMax = glm::max(boxMax, corner);
+						}
+					}
+				}
+				const int cluster = (k * GridY + j) * GridX + i;
+				_bounds.minX[cluster] = boxMin.x;
+				_bounds.minY[cluster] = boxMin.y;
+				_bounds.minZ[cluster] = boxMin.z;
+				_bounds.maxX[cluster] = boxMax.x;
+				_bounds.maxY[cluster] = boxMax.y;
+				_bounds.maxZ[cluster] = boxMax.z;
+			}
+		}
+	}
+}
+
+void LightClusters::build(const std::vector<const PointLight*>& pointLights, uint32_t firstIndex,
+						  const glm::mat4& view, const Camera& camera, int viewportWidth, int viewportHeight) {
+	auto start = std::chrono::high_resolution_clock::now();
+	if (camera.getFoV() != _fov || camera.getAspectRatio() != _aspectRatio || camera.getNear() != _near ||
+		camera.getFar() != _far)
+		computeClusterBounds(camera);
+
+	const float tanHalfY = std::tan(glm::radians(_fov) * 0.5f);
+	const float tanHalfX = tanHalfY * _aspectRatio;
+	const float logRatio = std::log(_far / _near);
+	auto slice = [&](float depth) {
+		return std::clamp(int(std::log(depth / _near) / logRatio * GridZ), 0, GridZ - 1);
+	};
+	auto tile = [](float ndc, int count) { return std::clamp(int((ndc + 1.0f) * 0.5f * count), 0, count - 1); };
+
+	const int lightCount = int(pointLights.size());
+	_lightCells.resize(lightCount);
+	parallelFor(0, size_t(lightCount), 64, [&](size_t begin, size_t end) {
+		for (int l = int(begin); l < int(end); l++) {
+			std::vector<uint32_t>& cells = _lightCells[l];
+			cells.clear();
+			float r = pointLights[l]->radius(LightCutoff);
+			if (r <= 0.0f) continue;
+			r = std::min(r, 2.0f * _far);
+			const glm::vec3 p = glm::vec3(view * glm::vec4(pointLights[l]->getTranslation(), 1.0f));
+
+			const float dMin = -p.z - r, dMax = -p.z + r;
+			if (dMax < _near || dMin > _far) continue;
+			const int k0 = slice(std::max(dMin, _near)), k1 = slice(std::min(dMax, _far));
+
+			// Screen rectangle of the sphere's bounding box, the whole screen if it crosses the near plane
+			int i0 = 0, i1 = GridX - 1, j0 = 0, j1 = GridY - 1;
+			if (dMin > _near) {
+				float xMin = std::numeric_limits<float>::max(), xMax = -xMin, yMin = xMin, yMax = -xMin;
+				for (float d : {dMin, dMax}) {
+					for (float s : {-r, r}) {
+						xMin = std::min(xMin, (p.x + s) / (d * tanHalfX));
+						xMax = std::max(xMax, (p.x + s) / (d * tanHalfX));
+						yMin = std::min(yMin, (p.y + s) / (d * tanHalfY));
+						yMax = std::max(yMax, (p.y + s) / (d * tanHalfY));
+					}
+				}
+				if (xMax < -1.0f || xMin > 1.0f || yMax < -1.0f || yMin > 1.0f) continue;
+				i0 = tile(xMin, GridX), i1 = tile(xMax, GridX);
+				j0 = tile(yMin, GridY), j1 = tile(yMax, GridY);
+			}
+
+			for (int k = k0; k <= k1; k++) {
+				for (int j = j0; j <= j1; j++) {
+					const uint32_t row = uint32_t((k * GridY + j) * GridX);
+					overlapRow(p, r * r, row + uint32_t(i0), row + uint32_t(i1), cells);
+				}
+			}
+		}
+	});
+
+	// Counting sort of the (cluster, light) pairs into per-cluster index ranges
+	std::fill(_cells.begin(), _cells.end(), glm::uvec2(0));
+	for (const auto& cells : _lightCells)
+		for (uint32_t cluster : cells) _cells[cluster].y++;
+	uint32_t offset = 0;
+	size_t maxPerCluster = 0;
+	for (auto& cell : _cells) {
+		cell.x = offset;
+		offset += cell.y;
+		maxPerCluster = std::max<size_t>(maxPerCluster, cell.y);
+		cell.y = 0;
+	}
+	_indices.resize(offset);
+	for (int l = 0; l < lightCount; l++) {
+		for (uint32_t cluster : _lightCells[l]) {
+			glm::uvec2& cell = _cells[cluster];
+			_indices[cell.x + cell.y++] = firstIndex + uint32_t(l);
+		}
+	}
+
+	Header header{{GridX, GridY, GridZ, 0},
+				  GridZ / logRatio,
+				  -GridZ * std::log(_near) / logRatio,
+				  float(viewportWidth) / GridX,
+				  float(viewportHeight) / GridY};
+	_clusterBuffer->write(0, header);
+	_clusterBuffer->write(sizeof(Header), _cells.data(), _cells.size() * sizeof(glm::uvec2));
+	_indexBuffer->resize(std::max<size_t>(_indices.size(), 1) * sizeof(uint32_t));
+	_indexBuffer->write(0, _indices.data(), _indices.size() * sizeof(uint32_t));
+
+	_stats.pointLights = pointLights.size();
+	_stats.references = _indices.size();
+	_stats.maxPerCluster = maxPerCluster;
+	_stats.buildSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void LightClusters::overlapRow(const glm::vec3& center, float radiusSq, uint32_t first, uint32_t last,
+							   std::vector<uint32_t>& cells) const {
+#ifdef CLUSTERS_USE_SSE2
+	const __m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+	const __m128 r2 = _mm_set1_ps(radiusSq), zero = _mm_setzero_ps();
+	for (uint32_t c = first; c <= last; c += 4) {
+		// Distance from the center to the box along each axis, 0 inside
+		__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&_bounds.minX[c]), cx),
+										  _mm_sub_ps(cx, _mm_loadu_ps(&_bounds.maxX[c]))),
+							   zero);
+		__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&_bounds.minY[c]), cy),
+										  _mm_sub_ps(cy, _mm_loadu_ps(&_bounds.maxY[c]))),
+							   zero);
+		__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&_bounds.minZ[c]), cz),
+										  _mm_sub_ps(cz, _mm_loadu_ps(&_bounds.maxZ[c]))),
+							   zero);
+		__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		int mask = _mm_movemask_ps(_mm_cmple_ps(d2, r2));
+		// Lanes past the last cluster of the run
+		if (last - c < 3) mask &= (1 << (last - c + 1)) - 1;
+		for (int lane = 0; lane < 4; lane++)
+			if (mask & (1 << lane)) cells.push_back(c + uint32_t(lane));
+	}
+#else
+	for (uint32_t c = first; c <= last; c++) {
+		glm::vec3 d = glm::max(glm::max(glm::vec3(_bounds.minX[c], _bounds.minY[c], _bounds.minZ[c]) - center,
+										 center - glm::vec3(_bounds.maxX[c], _bounds.maxY[c], _bounds.maxZ[c])),
+							   glm::vec3(0.0f));
+		if (glm::dot(d, d) <= radiusSq) cells.push_back(c);
+	}
+#endif
+}
+
+void LightClusters::flush() {
+	_clusterBuffer->flush();
+	_indexBuffer->flush();
+}
+
+void LightClusters::fence() {
+	_clusterBuffer->fence();
+	_indexBuffer->fence();
+}
+
+void LightStressBenchmark::spawnCityLights(std::vector<std::shared_ptr<AbstractLight>>& lights, int count,
+										   unsigned seed) {
+	std::mt19937 rng(seed);
+	std::normal_distribution<float> normal;
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	for (int i = 0; i < count; i++) {
+		glm::vec3 direction(normal(rng), normal(rng), normal(rng));
+		if (glm::dot(direction, direction) == 0.0f) direction = glm::vec3(0.0f, 1.0f, 0.0f);
+		glm::vec3 color = glm::mix(glm::vec3(1.0f, 0.6f, 0.25f), glm::vec3(1.0f, 0.9f, 0.7f), uniform(rng));
+		lights.push_back(std::make_shared<PointLight>(color, 0.05f, glm::normalize(direction) * 1.02f,
+													  1.0f, 0.0f, 200.0f));
+	}
+}
+
+void LightStressBenchmark::frame(std::vector<std::shared_ptr<AbstractLight>>& lights, float deltaTime,
+								 const ClusterStats& stats) {
+	static const int counts[] = {0, 250, 1000, 4000, 16000};
+	if (_step < 0) return;
+
+	if (_frame == 0) {
+		lights.erase(std::remove_if(lights.begin(), lights.end(),
+									[](const std::shared_ptr<AbstractLight>& light) { return light->getType() == 1; }),
+					 lights.end());
+		spawnCityLights(lights, counts[_step], 1234u);
+		_frameSeconds = 0.0;
+		_buildSeconds = 0.0;
+	} else if (_frame > WarmupFrames) {
+		_frameSeconds += deltaTime;
+		_buildSeconds += stats.buildSeconds;
+	}
+
+	if (++_frame > WarmupFrames + MeasuredFrames) {
+		std::cout << "[Light Stress] " << counts[_step] << " point lights: " << 1000.0 * _frameSeconds / MeasuredFrames
+				  << " ms/frame, clustering " << 1000.0 * _buildSeconds / MeasuredFrames << " ms, "
+				  << stats.references << " light references, max " << stats.maxPerCluster << " per cluster"
+				  << std::endl;
+		_frame = 0;
+		if (++_step == int(sizeof(counts) / sizeof(counts[0]))) _step = -1;
+	}
+}
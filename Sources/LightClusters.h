@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+#include "Light.h"
+#include "ShaderBuffer.h"
+
+struct ClusterStats {
+	double buildSeconds = 0.0;
+	size_t pointLights = 0;
+	size_t references = 0;	// Light indices over all clusters
+	size_t maxPerCluster = 0;
+};
+
+// Clustered forward lighting: the view frustum is split in a screen-space
+// grid of tiles and exponential depth slices, and every point light is
+// binned in the clusters its attenuation sphere overlaps. Fragments then
+// only evaluate the lights of their cluster.
+class LightClusters {
+   public:
+	static const int GridX = 16;
+	static const int GridY = 9;
+	static const int GridZ = 24;
+	// Radiance under which a point light is considered to have no effect
+	static constexpr float LightCutoff = 0.01f;
+
+	LightClusters();
+
+	// Bins the point lights, which are stored from firstIndex on in the light buffer
+	void build(const std::vector<const PointLight*>& pointLights, uint32_t firstIndex, const glm::mat4& view,
+			   const Camera& camera, int viewportWidth, int viewportHeight);
+
+	void flush();
+	void fence();
+
+	const ClusterStats& stats() const { return _stats; }
+
+   private:
+	// std430 header of ClusterBlock, followed by one (offset, count) pair per cluster
+	struct Header {
+		uint32_t gridSize[4];
+		float zScale, zBias, tileWidth, tileHeight;
+	};
+
+	// View-space cluster boxes, one array per coordinate so that four
+	// consecutive clusters of a row are tested at once. Padded by three
+	// entries so that the last group of a row can be loaded whole.
+	struct ClusterBounds {
+		std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+	};
+
+	void computeClusterBounds(const Camera& camera);
+	// Appends the clusters first..last of a row whose box the sphere overlaps
+	void overlapRow(const glm::vec3& center, float radiusSq, uint32_t first, uint32_t last,
+					std::vector<uint32_t>& cells) const;
+
+	std::unique_ptr<ShaderBuffer> _clusterBuffer;
+	std::unique_ptr<ShaderBuffer> _indexBuffer;
+
+	// View-space bounds of every cluster, rebuilt when the projection changes
+	ClusterBounds _bounds;
+	float _fov = 0.0f, _aspectRatio = 0.0f, _near = 0.0f, _far = 0.0f;
+
+	std::vector<std::vector<uint32_t>> _lightCells;	// Clusters overlapped by each light
+	std::vector<glm::uvec2> _cells;
+	std::vector<uint32_t> _indices;
+
+	ClusterStats _stats;
+};
+
+// Frame time sweep over increasing point light counts, results go to stdout
+class LightStressBenchmark {
+   public:
+	void start() { _step = 0, _frame = 0; }
+	bool running() const { return _step >= 0; }
+
+	// Call once per frame, replaces the point lights of the scene at every step
+	void frame(std::vector<std::shared_ptr<AbstractLight>>& lights, float deltaTime, const ClusterStats& stats);
+
+	// Random small lights just above the surface of the unit sphere
+	static void spawnCityLights(std::vector<std::shared_ptr<AbstractLight>>& lights, int count, unsigned seed);
+
+   private:
+	static const int WarmupFrames = 30;
+	static const int MeasuredFrames = 120;
+
+	int _step = -1;
+	int _frame = 0;
+	double _frameSeconds = 0.0;
+	double _buildSeconds = 0.0;
+};
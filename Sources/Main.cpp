@@ -10,24 +10,45 @@
 #include <string>
 #include <vector>
 #include <cmath>
+#include <chrono>
+#include <atomic>
+#include <thread>
 
 #include "ShaderProgram.h"
+#include "ShaderVariants.h"
 
 #include "Camera.h"
 #include "Mesh.h"
+#include "ChunkRenderer.h"
 #include "Light.h"
+#include "LightClusters.h"
 #include "Material.h"
 
 #include "editors/UIManager.h"
 #include "editors/DebugEditor.h"
 #include "editors/LightsEditor.h"
 #include "editors/MaterialEditor.h"
+#include "editors/ProfilerEditor.h"
+#include "editors/MemoryEditor.h"
 
 #include "Error.h"
 
 #include "WorldGen.h"
 
 #include "IO.h"
+#include "CubeMapProjector.h"
+#include "TextureIO.h"
+#include "TileBaker.h"
+#include "TileServer.h"
+#include "GpuProfiler.h"
+#include "Profiler.h"
+#include "MemoryTracker.h"
+#include "StartupTimeline.h"
+#include "FrameStats.h"
+#include "CameraPath.h"
+#include "Framebuffer.h"
+#include "HeadlessContext.h"
+#include "ThumbnailRenderer.h"
 
 // Function prototypes
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -35,7 +56,41 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 // Global variables
 GLuint VAO, VBO, EBO;
 float deltaTime = 0.0f, lastFrame = 0.0f;
+float cpuFrameTime = 0.0f;	// Frame start to buffer swap
 std::shared_ptr<ShaderProgram> shader;
+std::shared_ptr<ShaderVariants> planetShaders;
+
+// Light counts up to which the planet shader is specialized. Above that, point
+// lights go through clustered culling, and directional lights through the
+// generic variant looping over the light buffer.
+const int MaxSpecializedLights = 8;
+
+// Handles of the per-frame uniforms, resolved again when the shader is reloaded
+struct FrameUniforms {
+	ShaderProgram* program = nullptr;
+	UniformHandle model, normalMatrix, texDiffuse;
+
+	void resolve(ShaderProgram& p) {
+		program = &p;
+		model = p.handle("model");
+		normalMatrix = p.handle("normalMatrix");
+		texDiffuse = p.handle("tex_diffuse");
+	}
+} frameUniforms;
+
+// Variant of the planet shader specialized for a light setup
+ShaderDefines planetShaderDefines(VertexFormat format, int numDirLights, int numPointLights) {
+	ShaderDefines defines;
+	if (format == VertexFormat::Compact) defines["COMPACT_VERTICES"] = "1";
+	if (numDirLights <= MaxSpecializedLights) {
+		defines["NUM_DIR_LIGHTS"] = std::to_string(numDirLights);
+		if (numPointLights <= MaxSpecializedLights)
+			defines["NUM_POINT_LIGHTS"] = std::to_string(numPointLights);
+		else
+			defines["CLUSTERED_LIGHTING"] = "1";
+	}
+	return defines;
+}
 
 std::shared_ptr<Camera> cameraPtr;
 
@@ -44,6 +99,16 @@ Material material{glm::vec3(1.0f), 0.8f, 0.5f, glm::vec3(1.0f)};
 
 static std::shared_ptr<UIManager> uiManager;
 
+// Camera path recorded with --record, C adds a checkpoint
+static std::unique_ptr<CameraPath> recordedPath;
+static double recordStart = 0.0;
+
+// Seconds since startup, also available without GLFW (headless replays)
+static double clockSeconds() {
+	static const uint64_t start = traceClockNs();
+	return (traceClockNs() - start) / 1e9;
+}
+
 static bool isRotating(false);
 static bool isPanning(false);
 static bool isZooming(false);
@@ -59,14 +124,19 @@ void keyCallback(GLFWwindow* windowPtr, int key, int scancode, int action,
 			glfwSetWindowShouldClose(windowPtr, true);
 		}
 		if (action == GLFW_PRESS && key == GLFW_KEY_F11) {
-			std::string shaders_folder = "../Resources/Shaders/";
-			shader = ShaderProgram::genBasicShaderProgram(
-				shaders_folder + "PlanetShader.vert", shaders_folder + "PlanetShader.frag");
+			// Variants are rebuilt lazily from the new sources
+			planetShaders->clear();
+			shader = nullptr;
+			frameUniforms.program = nullptr;
 		}
 		if (action == GLFW_PRESS && key == GLFW_KEY_W) {
 			isWireframe = !isWireframe;
 			glPolygonMode(GL_FRONT_AND_BACK, isWireframe ? GL_LINE : GL_FILL);
 		}
+		if (action == GLFW_PRESS && key == GLFW_KEY_C && recordedPath) {
+			recordedPath->addCheckpoint(clockSeconds() - recordStart,
+										"checkpoint" + std::to_string(recordedPath->checkpoints().size() + 1));
+		}
 	}
 }
 
@@ -133,15 +203,118 @@ void windowSizeCallback(GLFWwindow* windowPtr, int width, int height) {
 							  static_cast<float>(height));
 }
 
-int main() {
+// Headless tile pyramid bake:
+// PlanetGen --bake <directory | file.pgtiles> <minZoom> <maxZoom> [seed]
+int runBake(int argc, char** argv) {
+	if (argc < 5) {
+		std::cerr << "Usage: " << argv[0] << " --bake <directory | file.pgtiles> <minZoom> <maxZoom> [seed]" << std::endl;
+		return -1;
+	}
+	std::string output = argv[2];
+	BakeOptions options;
+	options.minZoom = std::stoi(argv[3]);
+	options.maxZoom = std::max(options.minZoom, std::stoi(argv[4]));
+	WorldGen worldGen(argc > 5 ? std::stoi(argv[5]) : 0);
+
+	std::unique_ptr<TileSink> sink;
+	if (output.size() > 8 && output.compare(output.size() - 8, 8, ".pgtiles") == 0)
+		sink = std::make_unique<ArchiveTileSink>(output);
+	else
+		sink = std::make_unique<DirectoryTileSink>(output);
+
+	TileBaker baker(worldGen, options);
+	BakeStats stats = baker.bake(*sink);
+	sink.reset();
+
+	std::cout << "Baked " << stats.tiles << " tiles (z" << options.minZoom << "-z" << options.maxZoom
+			  << ") in " << stats.seconds << " s: " << stats.tilesPerSecond << " tiles/s, peak tile memory "
+			  << stats.peakBytes / (1024.0 * 1024.0) << " MiB" << std::endl;
+	MemoryTracker::printSummary();
+	MemoryTracker::writeSnapshot("PlanetGenMemory.json");
+	return 0;
+}
+
+// Headless tile server on localhost:
+// PlanetGen --serve [port] [cacheDirectory] [seed]
+int runServer(int argc, char** argv) {
+	TileServerOptions options;
+	if (argc > 2) options.port = std::stoi(argv[2]);
+	if (argc > 3) options.cacheDirectory = argv[3];
+	WorldGen worldGen(argc > 4 ? std::stoi(argv[4]) : 0);
+
+	TileServer server(worldGen, options);
+	if (!server.start()) return -1;
+	server.run();
+	return 0;
+}
+
+// Offline reprojection of a streamed zoom level onto the six cube map faces:
+// PlanetGen --cubemap <zoom> <faceSize> <outputPrefix> [tileUrl]
+int runCubeMap(int argc, char** argv) {
+	if (argc < 5) {
+		std::cerr << "Usage: " << argv[0] << " --cubemap <zoom> <faceSize> <outputPrefix> [tileUrl]" << std::endl;
+		return -1;
+	}
+	const int zoom = std::max(0, std::stoi(argv[2]));
+	const int faceSize = std::max(1, std::stoi(argv[3]));
+	const std::string prefix = argv[4];
+	if (argc > 5) IO::setTileURL(argv[5]);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	CubeMapProjector projector(faceSize);
+	if (!projector.fetchLevel(zoom)) return -1;
+	auto fetched = std::chrono::high_resolution_clock::now();
+	projector.reproject();
+	auto reprojected = std::chrono::high_resolution_clock::now();
+	projector.saveFaces(prefix);
+
+	std::cout << "[CubeMap] z" << zoom << " (" << (1 << zoom) * (1 << zoom) << " tiles) to 6 faces of " << faceSize
+			  << "x" << faceSize << ": fetch " << std::chrono::duration<double>(fetched - start).count()
+			  << " s, reprojection " << std::chrono::duration<double>(reprojected - fetched).count() << " s, written to "
+			  << prefix << "*.ppm" << std::endl;
+	return 0;
+}
+
+// PlanetGen --thumbnails <directory> <count> [size] [firstSeed]
+int runThumbnails(int argc, char** argv) {
+	if (argc < 4) {
+		std::cerr << "Usage: " << argv[0] << " --thumbnails <directory> <count> [size] [firstSeed]" << std::endl;
+		return -1;
+	}
+	ThumbnailOptions options;
+	options.outputDirectory = argv[2];
+	const int count = std::stoi(argv[3]);
+	if (argc > 4) options.size = std::stoi(argv[4]);
+	const int firstSeed = argc > 5 ? std::stoi(argv[5]) : 0;
+
+	HeadlessContext context;
+	if (!context.valid()) return -1;
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_CULL_FACE);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	{
+		ThumbnailRenderer renderer("../Resources/Shaders/", options);
+		for (int i = 0; i < count; i++) renderer.render(firstSeed + i);
+		renderer.finish();
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		std::cout << "[Thumbnails] " << renderer.written() << " planets of " << options.size << "x" << options.size
+				  << " in " << seconds << " s (" << renderer.written() / seconds << " per second, "
+				  << renderer.captureStalls() << " readback stalls) to " << options.outputDirectory << std::endl;
+	}
+	return 0;
+}
+
+// Viewer window with an OpenGL 4.5 core context, current and loaded
+GLFWwindow* createWindow() {
 	if (!glfwInit()) {
 		std::cerr << "Failed to initialize GLFW" << std::endl;
-		return -1;
+		return nullptr;
 	}
 
 	// OpenGL context setup
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 	// Enable debug options
@@ -152,7 +325,7 @@ int main() {
 	if (!windowPtr) {
 		std::cerr << "Failed to create GLFW window" << std::endl;
 		glfwTerminate();
-		return -1;
+		return nullptr;
 	}
 	glfwMakeContextCurrent(windowPtr);
 	glfwSetFramebufferSizeCallback(windowPtr, framebuffer_size_callback);
@@ -164,8 +337,70 @@ int main() {
 
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
 		std::cerr << "Failed to initialize GLAD" << std::endl;
+		return nullptr;
+	}
+	return windowPtr;
+}
+
+// Hidden window whose context shares the objects of the viewer's, made
+// current on a loader thread. Null if it cannot be created.
+GLFWwindow* createLoaderContext(GLFWwindow* windowPtr) {
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* loaderPtr = glfwCreateWindow(1, 1, "Loader", NULL, windowPtr);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+	if (!loaderPtr) std::cerr << "[Startup] No loader context, building the shaders on the main thread" << std::endl;
+	return loaderPtr;
+}
+
+int main(int argc, char** argv) {
+	if (argc > 1 && std::string(argv[1]) == "--bake") return runBake(argc, argv);
+	if (argc > 1 && std::string(argv[1]) == "--serve") return runServer(argc, argv);
+	if (argc > 1 && std::string(argv[1]) == "--thumbnails") return runThumbnails(argc, argv);
+	if (argc > 1 && std::string(argv[1]) == "--cubemap") return runCubeMap(argc, argv);
+
+	PROFILE_THREAD("Main");
+	StartupTimeline startup;
+
+	// Viewer options:
+	//   --record <path>: records the camera and parameters, C adds a checkpoint
+	//   --replay <path> [--report <file.json>] [--headless]: plays a path back at a fixed timestep
+	std::string recordFile, replayFile, reportFile;
+	bool headless = false;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--tile-url" && hasValue) IO::setTileURL(argv[++i]);
+		else if (arg == "--record" && hasValue) recordFile = argv[++i];
+		else if (arg == "--replay" && hasValue) replayFile = argv[++i];
+		else if (arg == "--report" && hasValue) reportFile = argv[++i];
+		else if (arg == "--headless") headless = true;
+	}
+
+	CameraPath replayPath;
+	std::unique_ptr<CameraPathPlayer> replay;
+	if (!replayFile.empty()) {
+		if (!replayPath.load(replayFile)) return -1;
+		replay = std::make_unique<CameraPathPlayer>(replayPath);
+	} else if (headless) {
+		std::cerr << "--headless needs --replay" << std::endl;
 		return -1;
 	}
+	if (!recordFile.empty()) recordedPath = std::make_unique<CameraPath>();
+
+	startup.begin("Context");
+	// Headless replays render offscreen, without UI
+	const int HeadlessWidth = 800, HeadlessHeight = 600;
+	std::unique_ptr<HeadlessContext> headlessContext;
+	GLFWwindow* windowPtr = nullptr;
+	if (headless) {
+		headlessContext = std::make_unique<HeadlessContext>();
+		if (!headlessContext->valid()) return -1;
+	} else {
+		windowPtr = createWindow();
+		if (!windowPtr) return -1;
+		// Replays measure the frames, not the display refresh
+		if (replay) glfwSwapInterval(0);
+	}
 
 	glEnable(GL_DEBUG_OUTPUT);
 	glDebugMessageCallback(debugMessageCallback, nullptr);
@@ -173,15 +408,37 @@ int main() {
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_CULL_FACE);
 	glCullFace(GL_BACK);
+	startup.end("Context");
 
-	std::vector<glm::vec3> pixels;
+	std::unique_ptr<Framebuffer> offscreen;
+	if (headless) {
+		offscreen = std::make_unique<Framebuffer>(HeadlessWidth, HeadlessHeight);
+		if (!offscreen->init()) return -1;
+	}
 
-	GLuint textureID = IO::fetchTileToTexture(0, 0, 0);
-	std::cout << "Texture ID: " << textureID << std::endl;
+	// Staged startup: the first frames show the UI, then a coarse planet with a
+	// placeholder texture, while the tile, the shaders and the detailed chunks
+	// are prepared concurrently. Each of them is swapped in once ready.
+
+	// Fetched, decoded and compressed on its own thread, uploaded by the frame loop.
+	// Not a scheduler task: a frame waiting on the scheduler could pick up the
+	// blocking download, and it would hold a compute worker meanwhile.
+	GLuint textureID = TextureIO::solidTexture(glm::u8vec3(90, 110, 140));
+	TileImage tile;
+	std::atomic<bool> tileFetched{false};
+	bool tileUploaded = false;
+	const bool compressTile = TextureIO::supportsBC1();
+	startup.begin("Tile fetch");
+	std::thread tileThread([&] {
+		PROFILE_THREAD("Tile fetch");
+		TextureIO::fetchTile(0, 0, 0, compressTile, tile);
+		startup.end("Tile fetch");
+		tileFetched.store(true, std::memory_order_release);
+	});
 
 	// Camera setup
-	int width, height;
-	glfwGetWindowSize(windowPtr, &width, &height);
+	int width = HeadlessWidth, height = HeadlessHeight;
+	if (windowPtr) glfwGetWindowSize(windowPtr, &width, &height);
 
 	cameraPtr = std::make_shared<Camera>();
 	cameraPtr->setAspectRatio(static_cast<float>(width) /
@@ -204,77 +461,328 @@ int main() {
 
 	// Load shaders
 	std::string shaders_folder = "../Resources/Shaders/";
-	shader = ShaderProgram::genBasicShaderProgram(
+	planetShaders = std::make_shared<ShaderVariants>(
 		shaders_folder + "PlanetShader.vert",
 		shaders_folder + "PlanetShader.frag");
+	int variantDirLights = -1, variantPointLights = -1;
 
 	WorldGen worldGen{};
 
-	// Generate sphere mesh
-	Mesh sphereMesh;
-	// worldGen.generateSphereMesh(400, sphereMesh.positions(), sphereMesh.indices());
-	worldGen.generateMercatorTileMesh(4, sphereMesh.texCoords(), sphereMesh.positions(), sphereMesh.indices());
-
-	sphereMesh.recomputePerVertexNormals();
-
-	sphereMesh.toGPU();
-
-	uiManager = std::make_shared<UIManager>();
-	uiManager->init(windowPtr);
+	// Planet chunks: one patch per Mercator tile of ChunkZoom, drawn by a single indirect call
+	const int ChunkZoom = 5, ChunkSubdivisions = 8;
+	const int PlaceholderSubdivisions = 2;	// Until the detailed chunks are uploaded
+	const size_t ChunkUploadsPerFrame = 128;
+	auto meshPool = std::make_unique<MeshPool>();
+	std::unique_ptr<ChunkRenderer> chunkRenderer;	// Created once the culling program is built
+
+	// The programs of the first frames are built on a hidden context sharing the
+	// objects of the main one, so that the compilation does not hold the frames
+	int numDirLights = 0, numPointLights = 0;
+	for (const auto& light : lights) (light->getType() == 0 ? numDirLights : numPointLights)++;
+	const ShaderDefines firstDefines = planetShaderDefines(meshPool->format(), numDirLights, numPointLights);
+	std::shared_ptr<ShaderProgram> cullProgram, firstVariant;
+	auto buildShaders = [&] {
+		PROFILE_SCOPE("Shader build");
+		cullProgram = ChunkRenderer::buildCullProgram(shaders_folder);
+		firstVariant = ShaderProgram::genBasicShaderProgram(shaders_folder + "PlanetShader.vert",
+															shaders_folder + "PlanetShader.frag", firstDefines);
+	};
+	std::atomic<bool> shadersBuilt{false};
+	GLFWwindow* loaderPtr = windowPtr ? createLoaderContext(windowPtr) : nullptr;
+	std::thread shaderThread;
+	startup.begin("Shaders");
+	if (loaderPtr) {
+		shaderThread = std::thread([&] {
+			PROFILE_THREAD("Shader loader");
+			glfwMakeContextCurrent(loaderPtr);
+			buildShaders();
+			// Complete before the main context uses them
+			glFinish();
+			glfwMakeContextCurrent(NULL);
+			startup.end("Shaders");
+			shadersBuilt.store(true, std::memory_order_release);
+		});
+	} else {
+		buildShaders();
+		startup.end("Shaders");
+		shadersBuilt = true;
+	}
 
-	uiManager->add(std::make_shared<DebugEditor>(deltaTime));
-	uiManager->add(std::make_shared<LightsEditor>(lights));
-	uiManager->add(std::make_shared<MaterialEditor>(material));
+	auto generateChunk = [&](size_t index, int subdivisions, Mesh& chunk) {
+		const int tx = int(index) % (1 << ChunkZoom), ty = int(index) >> ChunkZoom;
+		worldGen.generateMercatorPatch(ChunkZoom, tx, ty, subdivisions, chunk.texCoords(), chunk.positions(),
+									   chunk.indices());
+		chunk.recomputePerVertexNormals();
+	};
+	std::vector<Mesh> placeholders(size_t(1) << (2 * ChunkZoom));
+	{
+		PROFILE_SCOPE("Placeholder generation");
+		MemoryScope memoryScope(MemoryCategory::Meshes);
+		for (size_t i = 0; i < placeholders.size(); i++) generateChunk(i, PlaceholderSubdivisions, placeholders[i]);
+	}
+	std::vector<uint32_t> chunkIds;	// Placeholders first, replaced one by one
+	std::vector<Mesh> chunks(placeholders.size());
+	std::atomic<bool> chunksGenerated{false};
+	size_t chunksUploaded = 0;
+	// Serially on its own thread, for the same reason as the tile: split into
+	// scheduler tasks, its ranges could run inside a frame waiting on parallelFor
+	startup.begin("Chunk generation");
+	std::thread chunkThread([&] {
+		PROFILE_THREAD("Chunk generation");
+		PROFILE_SCOPE("Chunk generation");
+		MemoryScope memoryScope(MemoryCategory::Meshes);
+		for (size_t i = 0; i < chunks.size(); i++) generateChunk(i, ChunkSubdivisions, chunks[i]);
+		startup.end("Chunk generation");
+		chunksGenerated.store(true, std::memory_order_release);
+	});
+
+	auto frameBuffer = std::make_unique<ShaderBuffer>(GL_UNIFORM_BUFFER, FrameBufferBinding, sizeof(GPUFrame));
+	auto materialBuffer = std::make_unique<ShaderBuffer>(GL_UNIFORM_BUFFER, MaterialBufferBinding, sizeof(GPUMaterial));
+	auto lightBuffer = std::make_unique<ShaderBuffer>(GL_SHADER_STORAGE_BUFFER, LightBufferBinding);
+	const size_t LightArrayOffset = 16;	// int numOfLights, then the std430 array
+	auto lightClusters = std::make_unique<LightClusters>();
+	std::vector<const PointLight*> pointLights;
+	LightStressBenchmark lightStress;
+
+	auto gpuProfiler = std::make_unique<GpuProfiler>();
+	FrameStats frameStats;
+
+	if (windowPtr) {
+		uiManager = std::make_shared<UIManager>();
+		uiManager->init(windowPtr);
+
+		uiManager->add(std::make_shared<LightsEditor>(lights, lightClusters->stats(), lightStress));
+		uiManager->add(std::make_shared<MaterialEditor>(material));
+		uiManager->add(std::make_shared<ProfilerEditor>(*gpuProfiler));
+		uiManager->add(std::make_shared<MemoryEditor>());
+	}
 
-	while (!glfwWindowShouldClose(windowPtr)) {
-		float currentFrame = static_cast<float>(glfwGetTime());
-		deltaTime = currentFrame - lastFrame;
+	// Swaps in the startup stages that finished, at the start of a frame
+	auto updateStartup = [&] {
+		if (!chunkRenderer && shadersBuilt.load(std::memory_order_acquire)) {
+			PROFILE_SCOPE("Placeholder upload");
+			if (shaderThread.joinable()) shaderThread.join();
+			if (loaderPtr) glfwDestroyWindow(loaderPtr);
+			loaderPtr = nullptr;
+			planetShaders->add(firstDefines, firstVariant);
+			chunkRenderer = std::make_unique<ChunkRenderer>(cullProgram, *meshPool);
+			for (const Mesh& placeholder : placeholders) chunkIds.push_back(chunkRenderer->addChunk(placeholder));
+			placeholders.clear();
+			if (uiManager)
+				uiManager->add(std::make_shared<DebugEditor>(frameStats, chunkRenderer->stats(), *meshPool, *gpuProfiler));
+		}
+		if (!tileUploaded && tileFetched.load(std::memory_order_acquire)) {
+			tileThread.join();
+			GLuint tileTexture = TextureIO::uploadTile(tile);
+			if (tileTexture) {
+				MemoryTracker::releaseTexture(textureID);
+				glDeleteTextures(1, &textureID);
+				textureID = tileTexture;
+			}
+			std::cout << "Texture ID: " << textureID << std::endl;
+			tile = TileImage();
+			tileUploaded = true;
+		}
+		// A few chunks per frame, each one replacing its placeholder
+		if (chunkRenderer && chunksUploaded < chunks.size() && chunksGenerated.load(std::memory_order_acquire)) {
+			PROFILE_SCOPE("Chunk upload");
+			if (chunksUploaded == 0) {
+				chunkThread.join();
+				startup.begin("Chunk upload");
+			}
+			const size_t last = std::min(chunks.size(), chunksUploaded + ChunkUploadsPerFrame);
+			for (; chunksUploaded < last; chunksUploaded++) {
+				chunkRenderer->removeChunk(chunkIds[chunksUploaded]);
+				chunkIds[chunksUploaded] = chunkRenderer->addChunk(chunks[chunksUploaded]);
+				chunks[chunksUploaded] = Mesh();
+			}
+			if (chunksUploaded == chunks.size()) {
+				startup.end("Chunk upload");
+				const MeshPoolStats poolStats = meshPool->stats();
+				std::cout << "[Mesh Pool] " << vertexFormatName(meshPool->format()) << " vertices, "
+						  << poolStats.vertexStride << " bytes each, " << poolStats.vertices.used << " vertices in "
+						  << poolStats.vertices.used * poolStats.vertexStride / 1024 << " KiB. Max errors: position "
+						  << poolStats.precision.position << ", normal " << poolStats.precision.normal
+						  << " deg, texcoord " << poolStats.precision.texCoord << std::endl;
+			}
+		}
+		if (tileUploaded && chunkRenderer && chunksUploaded == chunks.size()) startup.fullDetail();
+	};
+
+	recordStart = clockSeconds();
+	lastFrame = static_cast<float>(clockSeconds());
+	while (!windowPtr || !glfwWindowShouldClose(windowPtr)) {
+		updateStartup();
+		// Replays start from the full detail, so that every run measures the same frames.
+		// Checkpoints then wait until the pool released the ranges of the replaced meshes.
+		const MeshPoolStats pool = meshPool->stats();
+		const bool poolIdle = pool.vertices.pending == 0 && pool.indices.pending == 0;
+		const bool replaying = replay && startup.isFullDetail();
+		if (replaying && !replay->advance(*cameraPtr, material, lights, poolIdle)) break;
+
+		PROFILE_FRAME();
+		PROFILE_SCOPE("Frame");
+		float currentFrame = static_cast<float>(clockSeconds());
+		float frameTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
-
+		// Replays simulate at their fixed timestep
+		deltaTime = replay ? static_cast<float>(replay->timestep()) : frameTime;
+		if (recordedPath) recordedPath->record(currentFrame - recordStart, *cameraPtr, material, lights);
+		lightStress.frame(lights, deltaTime, lightClusters->stats());
+		gpuProfiler->beginFrame();
+		if (offscreen) offscreen->bind();
+
+		gpuProfiler->begin("Clear");
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		shader->use();
-
-		// Constant rotation of the sphere around the y-axis
-		float time = static_cast<float>(glfwGetTime());
-		glm::mat4 model = glm::rotate(glm::mat4(1.0f), time * 0.2f * 0.0f,
-									  glm::vec3(0.0f, 1.0f, 0.0f));
-
-		shader->set("model", model);
-		shader->set("view", cameraPtr->computeViewMatrix());
-		shader->set("projection", cameraPtr->computeProjectionMatrix());
-
-		for (size_t i = 0; i < lights.size(); i++) {
-			lights[i]->setUniforms(*shader,
-								   "lights[" + std::to_string(i) + "]");
+		gpuProfiler->end();
+
+		// The planet passes start once the shaders are built
+		if (chunkRenderer) {
+			// Pick the variant specialized for the current light setup
+			numDirLights = 0;
+			numPointLights = 0;
+			for (const auto& light : lights) (light->getType() == 0 ? numDirLights : numPointLights)++;
+			if (!shader || numDirLights != variantDirLights || numPointLights != variantPointLights) {
+				PROFILE_SCOPE("Shader variant");
+				shader = planetShaders->get(planetShaderDefines(meshPool->format(), numDirLights, numPointLights));
+				variantDirLights = numDirLights;
+				variantPointLights = numPointLights;
+			}
+
+			// Constant rotation of the sphere around the y-axis
+			float time = replay ? static_cast<float>(replay->time()) : currentFrame;
+			glm::mat4 model = glm::rotate(glm::mat4(1.0f), time * 0.2f * 0.0f,
+										  glm::vec3(0.0f, 1.0f, 0.0f));
+
+			// GPU culling of the chunks, in model space
+			glm::mat4 view = cameraPtr->computeViewMatrix();
+			glm::mat4 modelViewProjection = cameraPtr->computeProjectionMatrix() * view * model;
+			{
+				PROFILE_SCOPE("Culling");
+				FrameStageTimer stage(frameStats, "Culling");
+				gpuProfiler->begin("Culling");
+				chunkRenderer->cull(modelViewProjection, glm::vec3(glm::inverse(view * model)[3]));
+				gpuProfiler->end();
+			}
+
+			gpuProfiler->begin("Uploads");
+			ShaderProgram::resetUniformStats();
+			auto uniformStart = std::chrono::high_resolution_clock::now();
+			shader->use();
+			if (frameUniforms.program != shader.get()) frameUniforms.resolve(*shader);
+
+			shader->set(frameUniforms.model, model);
+			shader->set(frameUniforms.normalMatrix, glm::mat3(glm::transpose(glm::inverse(model))));
+
+			// Buffer blocks, only the bytes that changed since the last frame are uploaded.
+			// Lights are sorted by type, directional ones first, as the specialized variants expect.
+			cameraPtr->write(*frameBuffer);
+			material.write(*materialBuffer);
+			const int numOfLights = (int)lights.size();
+			lightBuffer->resize(LightArrayOffset + lights.size() * sizeof(GPULight));
+			lightBuffer->write(0, numOfLights);
+			size_t slot = 0;
+			pointLights.clear();
+			for (int type = 0; type < 2; type++) {
+				for (const auto& light : lights) {
+					if (light->getType() != type) continue;
+					light->write(*lightBuffer, LightArrayOffset + slot++ * sizeof(GPULight));
+					if (type == 1) pointLights.push_back(static_cast<const PointLight*>(light.get()));
+				}
+			}
+			const bool clustered = numDirLights <= MaxSpecializedLights && numPointLights > MaxSpecializedLights;
+			if (clustered) {
+				PROFILE_SCOPE("Light clusters");
+				int viewportWidth = HeadlessWidth, viewportHeight = HeadlessHeight;
+				if (windowPtr) glfwGetFramebufferSize(windowPtr, &viewportWidth, &viewportHeight);
+				lightClusters->build(pointLights, uint32_t(numDirLights), view, *cameraPtr,
+									 viewportWidth, viewportHeight);
+				lightClusters->flush();
+			}
+			frameBuffer->flush();
+			materialBuffer->flush();
+			lightBuffer->flush();
+
+			shader->set(frameUniforms.texDiffuse, 0);
+			ShaderProgram::uniformStats().seconds = std::chrono::duration<double>(
+				std::chrono::high_resolution_clock::now() - uniformStart).count();
+			frameStats.addStage("Uploads", ShaderProgram::uniformStats().seconds * 1000.0);	// Light clusters included
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, textureID);
+			gpuProfiler->end();
+
+			{
+				PROFILE_SCOPE("Planet");
+				FrameStageTimer stage(frameStats, "Planet");
+				gpuProfiler->begin("Planet");
+				chunkRenderer->draw();
+				gpuProfiler->end();
+			}
+
+			if (clustered) lightClusters->fence();
+			frameBuffer->fence();
+			materialBuffer->fence();
+			lightBuffer->fence();
 		}
-		shader->set("numOfLights", (int)lights.size());
-
-		material.setUniforms(*shader, "material");
-
-		glm::vec3 eyePos = glm::inverse(cameraPtr->computeViewMatrix())[3];
-		shader->set("eyePos", eyePos);
-
-		shader->set("tex_diffuse", 0);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-
-		sphereMesh.render();
+		meshPool->endFrame();
 
 		// ImGui UI
-		uiManager->renderUIs();
+		if (uiManager) {
+			PROFILE_SCOPE("UI");
+			FrameStageTimer stage(frameStats, "UI");
+			gpuProfiler->begin("UI");
+			uiManager->renderUIs();
+			gpuProfiler->end();
+		}
 
-		glfwSwapBuffers(windowPtr);
-		glfwPollEvents();
+		cpuFrameTime = static_cast<float>(clockSeconds()) - currentFrame;
+		if (windowPtr) {
+			PROFILE_SCOPE("Swap");
+			FrameStageTimer stage(frameStats, "Swap");
+			glfwSwapBuffers(windowPtr);
+			glfwPollEvents();
+		}
+		frameStats.endFrame(frameTime * 1000.0f, cpuFrameTime * 1000.0f, *gpuProfiler);
+		startup.firstFrame();
+		if (chunkRenderer) startup.firstPlanetFrame();
+		// Replay frames: start to swap, GPU times lag GpuProfiler::FrameLatency frames behind
+		if (replaying)
+			replay->endFrame(static_cast<float>(clockSeconds()) * 1000.0f - currentFrame * 1000.0f,
+							 cpuFrameTime * 1000.0f, static_cast<float>(gpuProfiler->frameMs()));
+	}
+	frameStats.stopRecording();
+	// Closed during the startup, the stages still use the state of main()
+	if (chunkThread.joinable()) chunkThread.join();
+	if (tileThread.joinable()) tileThread.join();
+	if (shaderThread.joinable()) shaderThread.join();
+	if (loaderPtr) glfwDestroyWindow(loaderPtr);
+	if (recordedPath) recordedPath->save(recordFile);
+	if (replay) {
+		replay->printReport();
+		if (!reportFile.empty()) replay->writeReport(reportFile);
 	}
+	// Snapshot while the GPU resources are still alive
+	MemoryTracker::printSummary();
+	MemoryTracker::writeSnapshot("PlanetGenMemory.json");
 
 	// Cleanup
+	MemoryTracker::releaseTexture(textureID);
 	glDeleteTextures(1, &textureID);
 	glDeleteVertexArrays(1, &VAO);
 	glDeleteBuffers(1, &VBO);
-	uiManager->shutdown();
-	glfwDestroyWindow(windowPtr);
-	glfwTerminate();
+	frameBuffer.reset();
+	materialBuffer.reset();
+	lightBuffer.reset();
+	lightClusters.reset();
+	chunkRenderer.reset();
+	meshPool.reset();
+	gpuProfiler.reset();
+	offscreen.reset();
+	if (uiManager) uiManager->shutdown();
+	if (windowPtr) {
+		glfwDestroyWindow(windowPtr);
+		glfwTerminate();
+	}
 	return 0;
 }
 
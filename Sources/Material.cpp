@@ -1,8 +1,5 @@
 #include "Material.h"
 
-void Material::setUniforms(ShaderProgram& program, std::string name) const {
-	program.set(name + ".albedo", _albedo);
-	program.set(name + ".roughness", _roughness);
-	program.set(name + ".metalness", _metalness);
-	program.set(name + ".F0", _F0);
+void Material::write(ShaderBuffer& buffer, size_t offset) const {
+	buffer.write(offset, GPUMaterial{_albedo, _roughness, _F0, _metalness});
 }
\ No newline at end of file
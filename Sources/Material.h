@@ -5,7 +5,15 @@
 
 #include <string>
 
-#include "ShaderProgram.h"
+#include "ShaderBuffer.h"
+
+// std140 layout of Material in PlanetShader.frag
+struct GPUMaterial {
+	glm::vec3 albedo;
+	float roughness;
+	glm::vec3 F0;
+	float metalness;
+};
 
 class Material {
    public:
@@ -17,7 +25,8 @@ class Material {
 		  _metalness(metalness),
 		  _F0(F0) {}
 
-	void setUniforms(ShaderProgram& program, std::string name) const;
+	// Writes the material at offset in a buffer block, uploaded only if it changed
+	void write(ShaderBuffer& buffer, size_t offset = 0) const;
 
 	inline glm::vec3& albedo() { return _albedo; }
 	inline const glm::vec3& albedo() const { return _albedo; }
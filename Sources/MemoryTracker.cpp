@@ -0,0 +1,244 @@
+#include "MemoryTracker.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+
+namespace {
+
+const size_t CategoryCount = size_t(MemoryCategory::Count);
+
+struct AtomicCounters {
+	std::atomic<size_t> bytes{0};
+	std::atomic<size_t> peakBytes{0};
+	std::atomic<size_t> allocations{0};
+	std::atomic<size_t> totalAllocations{0};
+
+	void add(size_t size) {
+		const size_t live = bytes.fetch_add(size, std::memory_order_relaxed) + size;
+		size_t peak = peakBytes.load(std::memory_order_relaxed);
+		while (live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+		}
+		allocations.fetch_add(1, std::memory_order_relaxed);
+		totalAllocations.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void remove(size_t size) {
+		bytes.fetch_sub(size, std::memory_order_relaxed);
+		allocations.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	MemoryCounters load() const {
+		return {bytes.load(std::memory_order_relaxed), peakBytes.load(std::memory_order_relaxed),
+				allocations.load(std::memory_order_relaxed), totalAllocations.load(std::memory_order_relaxed)};
+	}
+};
+
+// Zero-initialized before any dynamic initialization, so usable by operator new at startup
+AtomicCounters cpuCounters[CategoryCount];
+AtomicCounters cpuTotalCounters;
+AtomicCounters gpuCounters[CategoryCount];
+AtomicCounters gpuTotalCounters;
+thread_local MemoryCategory threadCategory = MemoryCategory::General;
+
+enum class GpuObject : uint64_t { Buffer, Texture, Renderbuffer };
+
+struct GpuAllocation {
+	size_t bytes;
+	MemoryCategory category;
+};
+
+std::mutex& gpuMutex() {
+	static std::mutex mutex;
+	return mutex;
+}
+
+std::unordered_map<uint64_t, GpuAllocation>& gpuObjects() {
+	static std::unordered_map<uint64_t, GpuAllocation> objects;
+	return objects;
+}
+
+void trackGpu(GpuObject kind, unsigned int name, size_t bytes, MemoryCategory category) {
+	if (!name) return;
+	std::lock_guard<std::mutex> lock(gpuMutex());
+	GpuAllocation& allocation = gpuObjects()[(uint64_t(kind) << 32) | name];
+	if (allocation.bytes) {
+		// Storage respecified without deleting the object
+		gpuCounters[size_t(allocation.category)].remove(allocation.bytes);
+		gpuTotalCounters.remove(allocation.bytes);
+	}
+	allocation = {bytes, category};
+	gpuCounters[size_t(category)].add(bytes);
+	gpuTotalCounters.add(bytes);
+}
+
+void releaseGpu(GpuObject kind, unsigned int name) {
+	std::lock_guard<std::mutex> lock(gpuMutex());
+	auto it = gpuObjects().find((uint64_t(kind) << 32) | name);
+	if (it == gpuObjects().end()) return;
+	gpuCounters[size_t(it->second.category)].remove(it->second.bytes);
+	gpuTotalCounters.remove(it->second.bytes);
+	gpuObjects().erase(it);
+}
+
+void writeCounters(std::ostream& out, const MemoryCounters& counters) {
+	out << "{\"bytes\": " << counters.bytes << ", \"peak_bytes\": " << counters.peakBytes
+		<< ", \"allocations\": " << counters.allocations << ", \"total_allocations\": " << counters.totalAllocations
+		<< "}";
+}
+
+double mib(size_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+}  // namespace
+
+#if PLANETGEN_MEMORY_TRACKING
+
+namespace {
+
+// Precedes every tracked block, keeps the user pointer 16-byte aligned
+struct alignas(16) BlockHeader {
+	size_t size;
+	uint32_t offset;	// From the start of the malloc block to the user pointer
+	MemoryCategory category;
+};
+static_assert(sizeof(BlockHeader) == 16, "The header must keep the default new alignment");
+
+void* trackedAllocate(size_t size, size_t alignment) {
+	alignment = alignment < sizeof(BlockHeader) ? sizeof(BlockHeader) : alignment;
+	const size_t extra = alignment == sizeof(BlockHeader) ? sizeof(BlockHeader) : alignment + sizeof(BlockHeader);
+	uint8_t* raw = static_cast<uint8_t*>(std::malloc(size + extra));
+	if (!raw) return nullptr;
+	const uintptr_t user = (uintptr_t(raw) + sizeof(BlockHeader) + alignment - 1) & ~uintptr_t(alignment - 1);
+
+	BlockHeader* header = reinterpret_cast<BlockHeader*>(user) - 1;
+	header->size = size;
+	header->offset = uint32_t(user - uintptr_t(raw));
+	header->category = threadCategory;
+	cpuCounters[size_t(header->category)].add(size);
+	cpuTotalCounters.add(size);
+	return reinterpret_cast<void*>(user);
+}
+
+void trackedFree(void* pointer) {
+	if (!pointer) return;
+	BlockHeader* header = static_cast<BlockHeader*>(pointer) - 1;
+	cpuCounters[size_t(header->category)].remove(header->size);
+	cpuTotalCounters.remove(header->size);
+	std::free(static_cast<uint8_t*>(pointer) - header->offset);
+}
+
+void* allocateOrThrow(size_t size, size_t alignment) {
+	for (;;) {
+		if (void* pointer = trackedAllocate(size, alignment)) return pointer;
+		std::new_handler handler = std::get_new_handler();
+		if (!handler) throw std::bad_alloc();
+		handler();
+	}
+}
+
+}  // namespace
+
+void* operator new(size_t size) { return allocateOrThrow(size, 0); }
+void* operator new[](size_t size) { return allocateOrThrow(size, 0); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return trackedAllocate(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return trackedAllocate(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment) { return allocateOrThrow(size, size_t(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocateOrThrow(size, size_t(alignment)); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	return trackedAllocate(size, size_t(alignment));
+}
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	return trackedAllocate(size, size_t(alignment));
+}
+
+void operator delete(void* pointer) noexcept { trackedFree(pointer); }
+void operator delete[](void* pointer) noexcept { trackedFree(pointer); }
+void operator delete(void* pointer, size_t) noexcept { trackedFree(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { trackedFree(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { trackedFree(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { trackedFree(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { trackedFree(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { trackedFree(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept { trackedFree(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { trackedFree(pointer); }
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { trackedFree(pointer); }
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { trackedFree(pointer); }
+
+#endif
+
+const char* MemoryTracker::name(MemoryCategory category) {
+	static const char* names[CategoryCount] = {"General", "Meshes",	 "Tile cache", "Textures",
+											   "Noise",	  "Baking", "Buffers",	  "Render targets"};
+	return names[size_t(category)];
+}
+
+MemoryCategory MemoryTracker::currentCategory() { return threadCategory; }
+
+void MemoryTracker::setCurrentCategory(MemoryCategory category) { threadCategory = category; }
+
+MemoryCounters MemoryTracker::cpu(MemoryCategory category) { return cpuCounters[size_t(category)].load(); }
+
+MemoryCounters MemoryTracker::cpuTotal() { return cpuTotalCounters.load(); }
+
+void MemoryTracker::trackBuffer(unsigned int buffer, size_t bytes, MemoryCategory category) {
+	trackGpu(GpuObject::Buffer, buffer, bytes, category);
+}
+
+void MemoryTracker::releaseBuffer(unsigned int buffer) { releaseGpu(GpuObject::Buffer, buffer); }
+
+void MemoryTracker::trackTexture(unsigned int texture, size_t bytes, MemoryCategory category) {
+	trackGpu(GpuObject::Texture, texture, bytes, category);
+}
+
+void MemoryTracker::releaseTexture(unsigned int texture) { releaseGpu(GpuObject::Texture, texture); }
+
+void MemoryTracker::trackRenderbuffer(unsigned int renderbuffer, size_t bytes, MemoryCategory category) {
+	trackGpu(GpuObject::Renderbuffer, renderbuffer, bytes, category);
+}
+
+void MemoryTracker::releaseRenderbuffer(unsigned int renderbuffer) {
+	releaseGpu(GpuObject::Renderbuffer, renderbuffer);
+}
+
+MemoryCounters MemoryTracker::gpu(MemoryCategory category) { return gpuCounters[size_t(category)].load(); }
+
+MemoryCounters MemoryTracker::gpuTotal() { return gpuTotalCounters.load(); }
+
+void MemoryTracker::printSummary() {
+	const MemoryCounters cpu = cpuTotal(), gpu = gpuTotal();
+	std::cout << "[Memory] CPU " << mib(cpu.bytes) << " MiB (peak " << mib(cpu.peakBytes) << " MiB), GPU "
+			  << mib(gpu.bytes) << " MiB (peak " << mib(gpu.peakBytes) << " MiB)" << std::endl;
+	for (size_t c = 0; c < CategoryCount; c++) {
+		const MemoryCounters cpuCategory = cpuCounters[c].load(), gpuCategory = gpuCounters[c].load();
+		if (!cpuCategory.peakBytes && !gpuCategory.peakBytes) continue;
+		std::cout << "[Memory]   " << name(MemoryCategory(c)) << ": CPU peak " << mib(cpuCategory.peakBytes)
+				  << " MiB, GPU peak " << mib(gpuCategory.peakBytes) << " MiB" << std::endl;
+	}
+}
+
+bool MemoryTracker::writeSnapshot(const std::string& filename) {
+	std::ofstream out(filename);
+	if (!out) {
+		std::cerr << "[Memory] Cannot write " << filename << std::endl;
+		return false;
+	}
+	out << "{\n  \"cpu_tracked\": " << (tracksCPU() ? "true" : "false") << ",\n  \"cpu\": ";
+	writeCounters(out, cpuTotal());
+	out << ",\n  \"gpu\": ";
+	writeCounters(out, gpuTotal());
+	out << ",\n  \"categories\": {\n";
+	for (size_t c = 0; c < CategoryCount; c++) {
+		out << "    \"" << name(MemoryCategory(c)) << "\": {\"cpu\": ";
+		writeCounters(out, cpuCounters[c].load());
+		out << ", \"gpu\": ";
+		writeCounters(out, gpuCounters[c].load());
+		out << "}" << (c + 1 < CategoryCount ? "," : "") << "\n";
+	}
+	out << "  }\n}\n";
+	std::cout << "[Memory] Wrote the snapshot to " << filename << std::endl;
+	return bool(out);
+}
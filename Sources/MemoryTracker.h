@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Set to 0 (PLANETGEN_MEMORY_TRACKING CMake option) to keep the default operator new
+#ifndef PLANETGEN_MEMORY_TRACKING
+#define PLANETGEN_MEMORY_TRACKING 1
+#endif
+
+enum class MemoryCategory : uint8_t {
+	General,
+	Meshes,
+	TileCache,
+	Textures,
+	Noise,
+	Baking,
+	Buffers,
+	RenderTargets,
+	Count
+};
+
+struct MemoryCounters {
+	size_t bytes = 0;
+	size_t peakBytes = 0;
+	size_t allocations = 0;		// Live
+	size_t totalAllocations = 0;	// Since startup
+};
+
+// Memory use per subsystem. CPU allocations are counted by the global
+// operator new, in the category of the innermost MemoryScope of the
+// allocating thread, and frees go back to the category of the allocation.
+// GPU buffers, textures and renderbuffers are counted where they are created.
+class MemoryTracker {
+   public:
+	static const char* name(MemoryCategory category);
+	static bool tracksCPU() { return PLANETGEN_MEMORY_TRACKING != 0; }
+
+	static MemoryCategory currentCategory();
+	static void setCurrentCategory(MemoryCategory category);
+	static MemoryCounters cpu(MemoryCategory category);
+	static MemoryCounters cpuTotal();
+
+	// GL object names, released with the same kind
+	static void trackBuffer(unsigned int buffer, size_t bytes, MemoryCategory category);
+	static void releaseBuffer(unsigned int buffer);
+	static void trackTexture(unsigned int texture, size_t bytes, MemoryCategory category);
+	static void releaseTexture(unsigned int texture);
+	static void trackRenderbuffer(unsigned int renderbuffer, size_t bytes, MemoryCategory category);
+	static void releaseRenderbuffer(unsigned int renderbuffer);
+	static MemoryCounters gpu(MemoryCategory category);
+	static MemoryCounters gpuTotal();
+
+	static void printSummary();
+	static bool writeSnapshot(const std::string& filename);
+};
+
+// Attributes the allocations of the current thread to a category during its scope
+class MemoryScope {
+   public:
+	explicit MemoryScope(MemoryCategory category) : _previous(MemoryTracker::currentCategory()) {
+		MemoryTracker::setCurrentCategory(category);
+	}
+	~MemoryScope() { MemoryTracker::setCurrentCategory(_previous); }
+
+	MemoryScope(const MemoryScope&) = delete;
+	MemoryScope& operator=(const MemoryScope&) = delete;
+
+   private:
+	MemoryCategory _previous;
+};
@@ -2,19 +2,23 @@
 
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
-#include <glad/glad.h>
 
 #include <vector>
 
+// CPU geometry of a planet or chunk. GPU copies live in a MeshPool, see
+// ChunkRenderer::addChunk.
 class Mesh {
    public:
+
 	std::vector<glm::vec3> &positions() { return _positions; }
 	std::vector<glm::vec3> &normals() { return _normals; }
 	std::vector<glm::vec2> &texCoords() { return _texCoords; }
 	std::vector<glm::uvec3> &indices() { return _indices; }
 
-	void toGPU();
-	void render();
+	const std::vector<glm::vec3> &positions() const { return _positions; }
+	const std::vector<glm::vec3> &normals() const { return _normals; }
+	const std::vector<glm::vec2> &texCoords() const { return _texCoords; }
+	const std::vector<glm::uvec3> &indices() const { return _indices; }
 
 	void recomputePerVertexNormals();
 
@@ -23,10 +27,4 @@ class Mesh {
 	std::vector<glm::vec3> _normals;
 	std::vector<glm::vec2> _texCoords;
 	std::vector<glm::uvec3> _indices;
-
-	GLuint _vao;
-	GLuint _posVbo;
-	GLuint _normVbo;
-	GLuint _texVbo;
-	GLuint _ebo;
 };
\ No newline at end of file
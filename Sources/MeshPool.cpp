@@ -0,0 +1,168 @@
+#include "MeshPool.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+
+#include "Error.h"
+#include "MemoryTracker.h"
+
+namespace {
+
+const size_t IndexSize = sizeof(uint32_t);
+
+// Vertex attributes, matching PlanetShader.vert
+enum Attribute : GLuint { PositionAttribute, NormalAttribute, TexCoordAttribute, OffsetAttribute, ScaleAttribute };
+enum BindingIndex : GLuint { VertexBinding, QuantizationBinding };
+
+GLuint createBuffer(size_t size) {
+	GLuint buffer;
+	glCreateBuffers(1, &buffer);
+	glNamedBufferStorage(buffer, GLsizeiptr(std::max<size_t>(size, 4)), nullptr, GL_DYNAMIC_STORAGE_BIT);
+	MemoryTracker::trackBuffer(buffer, std::max<size_t>(size, 4), MemoryCategory::Meshes);
+	return buffer;
+}
+
+void deleteBuffer(GLuint buffer) {
+	MemoryTracker::releaseBuffer(buffer);
+	glDeleteBuffers(1, &buffer);
+}
+
+void copyMoves(GLuint from, GLuint to, const std::vector<GpuArena::Move>& moves, size_t elementSize) {
+	for (const GpuArena::Move& move : moves) {
+		glCopyNamedBufferSubData(from, to, GLintptr(move.from * elementSize), GLintptr(move.to * elementSize),
+								 GLsizeiptr(move.size * elementSize));
+	}
+}
+
+}  // namespace
+
+MeshPool::MeshPool(VertexFormat format, size_t vertexCapacity, size_t indexCapacity)
+	: _format(format), _stride(vertexStride(format)), _vertexArena(vertexCapacity), _indexArena(indexCapacity) {
+	glCreateVertexArrays(1, &_vao);
+	auto setAttribute = [&](GLuint attrib, GLint size, GLenum type, GLboolean normalized, GLuint offset,
+							GLuint binding) {
+		glEnableVertexArrayAttrib(_vao, attrib);
+		glVertexArrayAttribFormat(_vao, attrib, size, type, normalized, offset);
+		glVertexArrayAttribBinding(_vao, attrib, binding);
+	};
+	if (format == VertexFormat::Compact) {
+		setAttribute(PositionAttribute, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(CompactVertex, position), VertexBinding);
+		setAttribute(NormalAttribute, 2, GL_SHORT, GL_TRUE, offsetof(CompactVertex, normal), VertexBinding);
+		setAttribute(TexCoordAttribute, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(CompactVertex, texCoord), VertexBinding);
+	} else {
+		setAttribute(PositionAttribute, 3, GL_FLOAT, GL_FALSE, 0, VertexBinding);
+		setAttribute(NormalAttribute, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), VertexBinding);
+		setAttribute(TexCoordAttribute, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(float), VertexBinding);
+	}
+	setAttribute(OffsetAttribute, 4, GL_FLOAT, GL_FALSE, offsetof(VertexQuantization, offset), QuantizationBinding);
+	setAttribute(ScaleAttribute, 4, GL_FLOAT, GL_FALSE, offsetof(VertexQuantization, scale), QuantizationBinding);
+	glVertexArrayBindingDivisor(_vao, QuantizationBinding, 1);
+
+	createBuffers(vertexCapacity, indexCapacity);
+	reserveSlots(256);
+}
+
+MeshPool::~MeshPool() {
+	for (GLuint buffer : {_vbo, _ebo, _quantizationBuffer}) deleteBuffer(buffer);
+	glDeleteVertexArrays(1, &_vao);
+}
+
+void MeshPool::createBuffers(size_t vertexCapacity, size_t indexCapacity) {
+	_vbo = createBuffer(vertexCapacity * _stride);
+	_ebo = createBuffer(indexCapacity * IndexSize);
+	glVertexArrayVertexBuffer(_vao, VertexBinding, _vbo, 0, GLsizei(_stride));
+	glVertexArrayElementBuffer(_vao, _ebo);
+}
+
+// Allocation handles are dense, the slots grow with the largest one
+void MeshPool::reserveSlots(size_t count) {
+	if (count <= _slotCapacity) return;
+	size_t capacity = std::max<size_t>(_slotCapacity, 1);
+	while (capacity < count) capacity *= 2;
+	GLuint buffer = createBuffer(capacity * sizeof(VertexQuantization));
+	if (_quantizationBuffer) {
+		glCopyNamedBufferSubData(_quantizationBuffer, buffer, 0, 0,
+								 GLsizeiptr(_slotCapacity * sizeof(VertexQuantization)));
+		deleteBuffer(_quantizationBuffer);
+	}
+	_quantizationBuffer = buffer;
+	_slotCapacity = capacity;
+	glVertexArrayVertexBuffer(_vao, QuantizationBinding, _quantizationBuffer, 0, sizeof(VertexQuantization));
+}
+
+MeshPool::Allocation MeshPool::add(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals,
+								   const std::vector<glm::vec2>& texCoords, const std::vector<glm::uvec3>& indices) {
+	Allocation allocation;
+	allocation.vertexCount = uint32_t(positions.size());
+	allocation.indexCount = uint32_t(indices.size() * 3);
+
+	allocation.vertices = _vertexArena.allocate(allocation.vertexCount);
+	allocation.indices = _indexArena.allocate(allocation.indexCount);
+	if (allocation.vertices == GpuArena::InvalidHandle || allocation.indices == GpuArena::InvalidHandle) {
+		_vertexArena.free(allocation.vertices);
+		_indexArena.free(allocation.indices);
+		// Compact first, and double the capacity when even the compacted buffer is too small
+		GpuArenaStats vertexStats = _vertexArena.stats(), indexStats = _indexArena.stats();
+		size_t vertexCapacity = vertexStats.capacity, indexCapacity = indexStats.capacity;
+		while (vertexStats.used + allocation.vertexCount > vertexCapacity) vertexCapacity *= 2;
+		while (indexStats.used + allocation.indexCount > indexCapacity) indexCapacity *= 2;
+		defragment(vertexCapacity, indexCapacity);
+		allocation.vertices = _vertexArena.allocate(allocation.vertexCount);
+		allocation.indices = _indexArena.allocate(allocation.indexCount);
+	}
+
+	VertexQuantization quantization = encodeVertices(_format, positions, normals, texCoords, _staging, _precision);
+	reserveSlots(size_t(allocation.vertices) + 1);
+	glNamedBufferSubData(_quantizationBuffer, GLintptr(allocation.vertices * sizeof(VertexQuantization)),
+						 sizeof(VertexQuantization), &quantization);
+	glNamedBufferSubData(_vbo, GLintptr(_vertexArena.offset(allocation.vertices) * _stride),
+						 GLsizeiptr(_staging.size()), _staging.data());
+	glNamedBufferSubData(_ebo, GLintptr(_indexArena.offset(allocation.indices) * IndexSize),
+						 GLsizeiptr(allocation.indexCount * IndexSize), indices.data());
+	return allocation;
+}
+
+void MeshPool::remove(Allocation& allocation) {
+	if (!allocation.valid()) return;
+	_vertexArena.free(allocation.vertices);
+	_indexArena.free(allocation.indices);
+	allocation = Allocation();
+}
+
+void MeshPool::endFrame() {
+	_vertexArena.endFrame();
+	_indexArena.endFrame();
+}
+
+// The live ranges are copied to new buffers, the old ones are deleted right
+// away but the driver keeps them alive for the draws still in flight
+void MeshPool::defragment(size_t vertexCapacity, size_t indexCapacity) {
+	GLuint oldVbo = _vbo, oldEbo = _ebo;
+	std::vector<GpuArena::Move> vertexMoves = _vertexArena.defragment(vertexCapacity);
+	std::vector<GpuArena::Move> indexMoves = _indexArena.defragment(indexCapacity);
+	createBuffers(_vertexArena.capacity(), _indexArena.capacity());
+
+	copyMoves(oldVbo, _vbo, vertexMoves, _stride);
+	copyMoves(oldEbo, _ebo, indexMoves, IndexSize);
+	deleteBuffer(oldVbo);
+	deleteBuffer(oldEbo);
+	glCheckError("Defragmenting the mesh pool");
+
+	_generation++;
+	_defragmentations++;
+	std::cout << "[Mesh Pool] Defragmented, " << vertexMoves.size() + indexMoves.size() << " copies, capacity "
+			  << _vertexArena.capacity() << " vertices, " << _indexArena.capacity() << " indices" << std::endl;
+}
+
+MeshPoolStats MeshPool::stats() const {
+	MeshPoolStats stats;
+	stats.vertices = _vertexArena.stats();
+	stats.indices = _indexArena.stats();
+	stats.defragmentations = _defragmentations;
+	stats.bytes = stats.vertices.capacity * _stride + stats.indices.capacity * IndexSize +
+				  _slotCapacity * sizeof(VertexQuantization);
+	stats.vertexStride = _stride;
+	stats.precision = _precision;
+	return stats;
+}
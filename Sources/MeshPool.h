@@ -0,0 +1,94 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "GpuArena.h"
+#include "VertexFormat.h"
+
+struct MeshPoolStats {
+	GpuArenaStats vertices;	// In vertices
+	GpuArenaStats indices;	// In indices
+	size_t defragmentations = 0;
+	size_t bytes = 0;		// GPU memory of the pool
+	size_t vertexStride = 0;
+	VertexPrecision precision;	// Worst decoding errors of the meshes added so far
+};
+
+// Shared vertex and index buffers for every mesh. Meshes get ranges of the
+// buffers (a base vertex and a first index) instead of their own buffer
+// objects, so streaming meshes in and out does not churn driver allocations,
+// and any number of meshes can be drawn with the single vertex array.
+// Vertices are interleaved in the pool's VertexFormat. Each allocation also
+// has a slot with its position dequantization, read as per-instance vertex
+// attributes: draws use the slot as their base instance.
+// When an allocation does not fit, the pool is defragmented and grown if
+// needed, which moves the ranges: users compare generation() to refresh
+// the offsets they keep on the GPU.
+class MeshPool {
+   public:
+	struct Allocation {
+		GpuArena::Handle vertices = GpuArena::InvalidHandle;
+		GpuArena::Handle indices = GpuArena::InvalidHandle;
+		uint32_t vertexCount = 0;
+		uint32_t indexCount = 0;
+
+		bool valid() const { return vertices != GpuArena::InvalidHandle; }
+	};
+
+	MeshPool(VertexFormat format = VertexFormat::Compact, size_t vertexCapacity = size_t(1) << 20,
+			 size_t indexCapacity = size_t(1) << 22);
+	~MeshPool();
+
+	MeshPool(const MeshPool&) = delete;
+	MeshPool& operator=(const MeshPool&) = delete;
+
+	Allocation add(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals,
+				   const std::vector<glm::vec2>& texCoords, const std::vector<glm::uvec3>& indices);
+	// The ranges are reused once the frames in flight are done with them
+	void remove(Allocation& allocation);
+
+	int32_t baseVertex(const Allocation& allocation) const {
+		return int32_t(_vertexArena.offset(allocation.vertices));
+	}
+	uint32_t firstIndex(const Allocation& allocation) const {
+		return uint32_t(_indexArena.offset(allocation.indices));
+	}
+	// Base instance selecting the allocation's dequantization
+	uint32_t baseInstance(const Allocation& allocation) const { return allocation.vertices; }
+
+	// Call once per frame, after the draws
+	void endFrame();
+	// Packs the allocations, growing the buffers to the given capacities
+	void defragment(size_t vertexCapacity = 0, size_t indexCapacity = 0);
+
+	// Incremented each time the allocations move
+	uint64_t generation() const { return _generation; }
+	GLuint vao() const { return _vao; }
+	VertexFormat format() const { return _format; }
+	MeshPoolStats stats() const;
+
+   private:
+	void createBuffers(size_t vertexCapacity, size_t indexCapacity);
+	void reserveSlots(size_t count);
+
+	VertexFormat _format;
+	size_t _stride;
+	GpuArena _vertexArena;
+	GpuArena _indexArena;
+
+	GLuint _vao = 0;
+	GLuint _vbo = 0, _ebo = 0;
+	GLuint _quantizationBuffer = 0;	// One VertexQuantization per vertex allocation handle
+	size_t _slotCapacity = 0;
+
+	std::vector<uint8_t> _staging;
+	VertexPrecision _precision;
+
+	uint64_t _generation = 0;
+	size_t _defragmentations = 0;
+};
@@ -0,0 +1,303 @@
+#include "PerfCounters.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+
+#include "TaskScheduler.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const size_t CounterCount = size_t(HardwareCounter::Count);
+
+struct ThreadCounters {
+	long tid = 0;
+	int leader = -1;				  // Group read through the first event opened
+	int fds[CounterCount] = {-1, -1, -1, -1};
+	HardwareCounter order[CounterCount];	// Of the values in a group read
+	size_t opened = 0;
+};
+
+std::mutex countersMutex;
+std::vector<ThreadCounters> threads;
+std::atomic<bool> enabledFlag{false};
+bool availableFlag = false;
+bool eventAvailable[CounterCount] = {};
+std::string reasonText = "Hardware counters are disabled";
+PerfCounterValues retired;	// Threads unregistered while enabled, so that read() never goes back
+
+std::mutex stagesMutex;
+std::vector<PerfStage> stageTotals;
+
+PerfCounterValues withAvailability(PerfCounterValues values) {
+	for (size_t i = 0; i < CounterCount; i++) values.available[i] = eventAvailable[i];
+	return values;
+}
+
+#ifdef __linux__
+
+long currentTid() { return long(syscall(SYS_gettid)); }
+
+uint64_t eventConfig(HardwareCounter counter) {
+	switch (counter) {
+		case HardwareCounter::Cycles: return PERF_COUNT_HW_CPU_CYCLES;
+		case HardwareCounter::Instructions: return PERF_COUNT_HW_INSTRUCTIONS;
+		case HardwareCounter::CacheMisses: return PERF_COUNT_HW_CACHE_MISSES;
+		default: return PERF_COUNT_HW_BRANCH_MISSES;
+	}
+}
+
+int openEvent(HardwareCounter counter, long tid, int groupFd) {
+	perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = eventConfig(counter);
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	attr.disabled = groupFd < 0;	// The whole group starts at once
+	attr.exclude_kernel = 1;		// Allowed with the default perf_event_paranoid
+	attr.exclude_hv = 1;
+	return int(syscall(SYS_perf_event_open, &attr, pid_t(tid), -1, groupFd, 0));
+}
+
+std::string explain(int error) {
+	switch (error) {
+		case EACCES:
+		case EPERM: {
+			std::ifstream paranoid("/proc/sys/kernel/perf_event_paranoid");
+			std::string level;
+			paranoid >> level;
+			return "perf_event_open is not permitted (kernel.perf_event_paranoid = " +
+				   (level.empty() ? std::string("?") : level) + ")";
+		}
+		case ENOENT:
+		case ENODEV:
+		case EOPNOTSUPP: return "No hardware counters on this CPU, e.g. in a VM or a container without a PMU";
+		case ENOSYS: return "perf_event_open is not supported by this kernel";
+		default: return std::string("perf_event_open failed: ") + std::strerror(error);
+	}
+}
+
+// Returns the errno of the first failure when nothing could be opened
+int openThread(ThreadCounters& thread) {
+	int error = 0;
+	for (size_t i = 0; i < CounterCount; i++) {
+		const HardwareCounter counter = HardwareCounter(i);
+		int fd = openEvent(counter, thread.tid, thread.leader);
+		if (fd < 0) {
+			if (!error) error = errno;
+			continue;
+		}
+		if (thread.leader < 0) thread.leader = fd;
+		thread.fds[i] = fd;
+		thread.order[thread.opened++] = counter;
+	}
+	if (thread.leader < 0) return error ? error : ENODEV;
+	ioctl(thread.leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(thread.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	return 0;
+}
+
+void closeThread(ThreadCounters& thread) {
+	for (int& fd : thread.fds) {
+		if (fd >= 0) close(fd);
+		fd = -1;
+	}
+	thread.leader = -1;
+	thread.opened = 0;
+}
+
+// Scaled by the running time when the kernel multiplexed the group
+PerfCounterValues readThread(const ThreadCounters& thread) {
+	PerfCounterValues values;
+	if (thread.leader < 0) return values;
+	uint64_t buffer[3 + CounterCount] = {};
+	if (read(thread.leader, buffer, sizeof(buffer)) <= 0) return values;
+	const uint64_t count = std::min<uint64_t>(buffer[0], thread.opened);
+	const uint64_t enabled = buffer[1], running = buffer[2];
+	const double scale = running > 0 && running < enabled ? double(enabled) / double(running) : 1.0;
+	for (uint64_t i = 0; i < count; i++)
+		values.values[size_t(thread.order[i])] = uint64_t(double(buffer[3 + i]) * scale);
+	return values;
+}
+
+#else
+
+long currentTid() { return 0; }
+int openThread(ThreadCounters&) { return -1; }
+void closeThread(ThreadCounters&) {}
+PerfCounterValues readThread(const ThreadCounters&) { return PerfCounterValues(); }
+std::string explain(int) { return "Hardware counters need Linux perf_event_open"; }
+
+#endif
+
+void recordStage(const char* name, const PerfCounterValues& delta) {
+	std::lock_guard<std::mutex> lock(stagesMutex);
+	for (PerfStage& stage : stageTotals) {
+		if (stage.name != name) continue;
+		stage.calls++;
+		stage.totals += delta;
+		return;
+	}
+	PerfStage stage;
+	stage.name = name;
+	stage.calls = 1;
+	stage.totals = delta;
+	stageTotals.push_back(stage);
+}
+
+}  // namespace
+
+double PerfCounterValues::instructionsPerCycle() const {
+	const uint64_t cycles = (*this)[HardwareCounter::Cycles];
+	return cycles ? double((*this)[HardwareCounter::Instructions]) / double(cycles) : 0.0;
+}
+
+double PerfCounterValues::perKiloInstruction(HardwareCounter counter) const {
+	const uint64_t instructions = (*this)[HardwareCounter::Instructions];
+	return instructions ? 1000.0 * double((*this)[counter]) / double(instructions) : 0.0;
+}
+
+PerfCounterValues PerfCounterValues::operator-(const PerfCounterValues& other) const {
+	PerfCounterValues result = *this;
+	// Clamped, the counters may have been restarted in between
+	for (size_t i = 0; i < CounterCount; i++)
+		result.values[i] = values[i] > other.values[i] ? values[i] - other.values[i] : 0;
+	return result;
+}
+
+PerfCounterValues& PerfCounterValues::operator+=(const PerfCounterValues& other) {
+	for (size_t i = 0; i < CounterCount; i++) {
+		values[i] += other.values[i];
+		available[i] = available[i] || other.available[i];
+	}
+	return *this;
+}
+
+const char* PerfCounters::name(HardwareCounter counter) {
+	static const char* names[] = {"Cycles", "Instructions", "Cache misses", "Branch misses"};
+	return names[size_t(counter)];
+}
+
+bool PerfCounters::setEnabled(bool enabled) {
+	std::lock_guard<std::mutex> lock(countersMutex);
+	for (ThreadCounters& thread : threads) closeThread(thread);
+	retired = PerfCounterValues();
+	availableFlag = false;
+	for (bool& available : eventAvailable) available = false;
+	enabledFlag = false;
+	if (!enabled) {
+		reasonText = "Hardware counters are disabled";
+		return false;
+	}
+
+	const long tid = currentTid();
+	bool registered = false;
+	for (const ThreadCounters& thread : threads) registered = registered || thread.tid == tid;
+	if (!registered) {
+		threads.emplace_back();
+		threads.back().tid = tid;
+	}
+	// The calling thread decides: the others are alike
+	for (ThreadCounters& thread : threads) {
+		if (thread.tid != tid) continue;
+		const int error = openThread(thread);
+		if (error) {
+			reasonText = explain(error);
+			return false;
+		}
+		for (size_t i = 0; i < CounterCount; i++) eventAvailable[i] = thread.fds[i] >= 0;
+	}
+	for (ThreadCounters& thread : threads)
+		if (thread.tid != tid) openThread(thread);
+	availableFlag = true;
+	reasonText.clear();
+	enabledFlag = true;
+	return true;
+}
+
+bool PerfCounters::enabled() { return enabledFlag.load(std::memory_order_relaxed); }
+
+bool PerfCounters::available() {
+	std::lock_guard<std::mutex> lock(countersMutex);
+	return availableFlag;
+}
+
+std::string PerfCounters::reason() {
+	std::lock_guard<std::mutex> lock(countersMutex);
+	return reasonText;
+}
+
+void PerfCounters::registerThread() {
+	std::lock_guard<std::mutex> lock(countersMutex);
+	ThreadCounters thread;
+	thread.tid = currentTid();
+	if (enabledFlag) openThread(thread);
+	threads.push_back(thread);
+}
+
+void PerfCounters::unregisterThread() {
+	std::lock_guard<std::mutex> lock(countersMutex);
+	const long tid = currentTid();
+	for (size_t i = 0; i < threads.size(); i++) {
+		if (threads[i].tid != tid) continue;
+		retired += readThread(threads[i]);
+		closeThread(threads[i]);
+		threads.erase(threads.begin() + i);
+		return;
+	}
+}
+
+PerfCounterValues PerfCounters::read() {
+	std::lock_guard<std::mutex> lock(countersMutex);
+	PerfCounterValues total = retired;
+	if (enabledFlag)
+		for (const ThreadCounters& thread : threads) total += readThread(thread);
+	return withAvailability(total);
+}
+
+std::vector<PerfStage> PerfCounters::stages() {
+	std::lock_guard<std::mutex> lock(stagesMutex);
+	return stageTotals;
+}
+
+void PerfCounters::resetStages() {
+	std::lock_guard<std::mutex> lock(stagesMutex);
+	stageTotals.clear();
+}
+
+void PerfCounters::printSummary() {
+	if (!available()) {
+		std::printf("[Perf] Hardware counters unavailable: %s\n", reason().c_str());
+		return;
+	}
+	std::printf("[Perf] %-36s %7s %12s %6s %14s %15s\n", "Stage", "calls", "Mcycles", "IPC", "cache miss/kI",
+				"branch miss/kI");
+	for (const PerfStage& stage : stages()) {
+		const PerfCounterValues& t = stage.totals;
+		std::printf("[Perf] %-36s %7zu %12.2f %6.2f %14.2f %15.2f\n", stage.name.c_str(), stage.calls,
+					t[HardwareCounter::Cycles] / 1e6, t.instructionsPerCycle(),
+					t.perKiloInstruction(HardwareCounter::CacheMisses),
+					t.perKiloInstruction(HardwareCounter::BranchMisses));
+	}
+}
+
+PerfScope::PerfScope(const char* name)
+	: _name(name), _active(PerfCounters::enabled() && TaskScheduler::workerIndex() < 0) {
+	if (_active) _start = PerfCounters::read();
+}
+
+PerfScope::~PerfScope() {
+	if (_active) recordStage(_name, PerfCounters::read() - _start);
+}
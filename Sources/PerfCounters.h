@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class HardwareCounter : uint8_t { Cycles, Instructions, CacheMisses, BranchMisses, Count };
+
+struct PerfCounterValues {
+	uint64_t values[size_t(HardwareCounter::Count)] = {};
+	bool available[size_t(HardwareCounter::Count)] = {};	// False for the events the CPU does not count
+
+	uint64_t operator[](HardwareCounter counter) const { return values[size_t(counter)]; }
+	bool has(HardwareCounter counter) const { return available[size_t(counter)]; }
+	double instructionsPerCycle() const;
+	// Per thousand instructions, the usual unit to compare loops of different sizes
+	double perKiloInstruction(HardwareCounter counter) const;
+
+	PerfCounterValues operator-(const PerfCounterValues& other) const;
+	PerfCounterValues& operator+=(const PerfCounterValues& other);
+};
+
+struct PerfStage {
+	std::string name;
+	size_t calls = 0;
+	PerfCounterValues totals;
+};
+
+// Hardware performance counters from Linux perf_event_open, for the calling
+// thread and the task scheduler workers, summed. They are off by default and
+// cost nothing then. When the kernel refuses them (containers, VMs without a
+// virtual PMU, perf_event_paranoid), available() is false and reason() says
+// why; every read then returns zeros.
+class PerfCounters {
+   public:
+	static const char* name(HardwareCounter counter);
+
+	// Opens the counters of the registered threads, the caller included
+	static bool setEnabled(bool enabled);
+	static bool enabled();
+	static bool available();
+	static std::string reason();
+
+	// Threads whose work is counted, e.g. the scheduler workers at their start and exit
+	static void registerThread();
+	static void unregisterThread();
+
+	// Since the counters were enabled, summed over the registered threads
+	static PerfCounterValues read();
+
+	// Totals of the PerfScope stages since the last reset
+	static std::vector<PerfStage> stages();
+	static void resetStages();
+	static void printSummary();
+};
+
+// Counts the work of the whole process during its scope, under a stage name.
+// Scopes opened on scheduler workers are ignored: they run inside a parallel
+// stage that its caller measures as a whole. Names must be string literals.
+class PerfScope {
+   public:
+	explicit PerfScope(const char* name);
+	~PerfScope();
+
+	PerfScope(const PerfScope&) = delete;
+	PerfScope& operator=(const PerfScope&) = delete;
+
+   private:
+	const char* _name;
+	bool _active;
+	PerfCounterValues _start;
+};
@@ -0,0 +1,151 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+namespace {
+
+struct Zone {
+	const char* name;
+	uint64_t startNs;
+	uint64_t endNs;
+};
+
+// Written by its thread only. Readers copy the ring, then drop the zones
+// that the writer may have overwritten in the meantime.
+struct ThreadRing {
+	uint32_t id;
+	std::string name;	// Guarded by registryMutex
+	std::vector<Zone> zones = std::vector<Zone>(Profiler::RingSize);
+	std::atomic<uint64_t> count{0};
+};
+
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ThreadRing>> rings;	// Kept after their thread exits
+std::deque<uint64_t> frameStarts;				// Guarded by registryMutex
+thread_local ThreadRing* threadRing = nullptr;
+
+ThreadRing& currentRing() {
+	if (threadRing) return *threadRing;
+	std::lock_guard<std::mutex> lock(registryMutex);
+	auto ring = std::make_unique<ThreadRing>();
+	ring->id = uint32_t(rings.size());
+	ring->name = "Thread " + std::to_string(ring->id);
+	threadRing = ring.get();
+	rings.push_back(std::move(ring));
+	return *threadRing;
+}
+
+std::vector<Zone> snapshot(const ThreadRing& ring, uint64_t sinceNs) {
+	const uint64_t end = ring.count.load(std::memory_order_acquire);
+	const uint64_t begin = end > Profiler::RingSize ? end - Profiler::RingSize : 0;
+	std::vector<Zone> zones;
+	zones.reserve(size_t(end - begin));
+	for (uint64_t i = begin; i < end; i++) zones.push_back(ring.zones[i & (Profiler::RingSize - 1)]);
+
+	const uint64_t after = ring.count.load(std::memory_order_acquire);
+	const uint64_t overwritten = after > Profiler::RingSize ? after - Profiler::RingSize : 0;
+	if (overwritten > begin) zones.erase(zones.begin(), zones.begin() + std::min<size_t>(zones.size(), overwritten - begin));
+	zones.erase(std::remove_if(zones.begin(), zones.end(), [&](const Zone& zone) { return zone.startNs < sinceNs; }),
+				zones.end());
+	return zones;
+}
+
+}  // namespace
+
+void Profiler::setThreadName(const std::string& name) {
+	ThreadRing& ring = currentRing();
+	std::lock_guard<std::mutex> lock(registryMutex);
+	ring.name = name;
+}
+
+void Profiler::record(const char* name, uint64_t startNs, uint64_t endNs) {
+	ThreadRing& ring = currentRing();
+	const uint64_t index = ring.count.load(std::memory_order_relaxed);
+	ring.zones[index & (RingSize - 1)] = {name, startNs, endNs};
+	ring.count.store(index + 1, std::memory_order_release);
+}
+
+void Profiler::frameMark() {
+	std::lock_guard<std::mutex> lock(registryMutex);
+	frameStarts.push_back(traceClockNs());
+	if (frameStarts.size() > 1024) frameStarts.pop_front();
+}
+
+size_t Profiler::frames(uint64_t sinceNs) {
+	std::lock_guard<std::mutex> lock(registryMutex);
+	return size_t(frameStarts.end() - std::lower_bound(frameStarts.begin(), frameStarts.end(), sinceNs));
+}
+
+std::vector<TraceEvent> Profiler::events(uint64_t sinceNs) {
+	std::vector<const ThreadRing*> threads;
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		for (const auto& ring : rings) threads.push_back(ring.get());
+	}
+	std::vector<TraceEvent> events;
+	for (const ThreadRing* ring : threads) {
+		for (const Zone& zone : snapshot(*ring, sinceNs))
+			events.push_back({zone.name, zone.startNs, zone.endNs - zone.startNs, ring->id});
+	}
+	return events;
+}
+
+std::map<uint32_t, std::string> Profiler::threadNames() {
+	std::lock_guard<std::mutex> lock(registryMutex);
+	std::map<uint32_t, std::string> names;
+	for (const auto& ring : rings) names[ring->id] = ring->name;
+	return names;
+}
+
+std::vector<ThreadProfile> Profiler::summary(uint64_t sinceNs) {
+	std::vector<ThreadProfile> profiles;
+	std::map<uint32_t, std::string> names = threadNames();
+	std::vector<const ThreadRing*> threads;
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		for (const auto& ring : rings) threads.push_back(ring.get());
+	}
+
+	for (const ThreadRing* ring : threads) {
+		std::vector<Zone> zones = snapshot(*ring, sinceNs);
+		if (zones.empty()) continue;
+		// Parents first: earlier start, then longer zone
+		std::sort(zones.begin(), zones.end(), [](const Zone& a, const Zone& b) {
+			return a.startNs != b.startNs ? a.startNs < b.startNs : a.endNs > b.endNs;
+		});
+
+		ThreadProfile profile{ring->id, names[ring->id], {}};
+		// Open zones, the nodes are ancestors of each other so appending a child never moves them
+		std::vector<std::pair<ProfileNode*, uint64_t>> stack;
+		for (const Zone& zone : zones) {
+			while (!stack.empty() && zone.startNs >= stack.back().second) stack.pop_back();
+			ProfileNode& parent = stack.empty() ? profile.root : *stack.back().first;
+			auto child = std::find_if(parent.children.begin(), parent.children.end(),
+									  [&](const ProfileNode& node) { return node.name == zone.name; });
+			if (child == parent.children.end()) {
+				parent.children.push_back({zone.name, 0.0, 0, {}});
+				child = parent.children.end() - 1;
+			}
+			const double ms = (zone.endNs - zone.startNs) / 1e6;
+			child->totalMs += ms;
+			child->calls++;
+			if (stack.empty()) profile.root.totalMs += ms;
+			stack.emplace_back(&*child, zone.endNs);
+		}
+		profiles.push_back(std::move(profile));
+	}
+	return profiles;
+}
+
+bool Profiler::writeTrace(const std::string& filename, uint64_t sinceNs, const std::vector<TraceEvent>& extraEvents,
+						  const std::map<uint32_t, std::string>& extraThreads) {
+	std::vector<TraceEvent> all = events(sinceNs);
+	all.insert(all.end(), extraEvents.begin(), extraEvents.end());
+	std::map<uint32_t, std::string> names = threadNames();
+	names.insert(extraThreads.begin(), extraThreads.end());
+	return writeChromeTrace(filename, all, names);
+}
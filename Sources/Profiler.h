@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Trace.h"
+
+// Set to 0 (PLANETGEN_PROFILER CMake option) to compile the zones out
+#ifndef PLANETGEN_PROFILER
+#define PLANETGEN_PROFILER 1
+#endif
+
+// Zones nested by time, aggregated by name under their parent
+struct ProfileNode {
+	std::string name;
+	double totalMs = 0.0;
+	size_t calls = 0;
+	std::vector<ProfileNode> children;
+};
+
+struct ThreadProfile {
+	uint32_t thread;
+	std::string name;
+	ProfileNode root;	// totalMs: sum of the top-level zones
+};
+
+// CPU instrumentation. Each thread records its zones in its own ring buffer,
+// without locks, keeping the last RingSize zones. The rings can be exported
+// as a Chrome trace or summarized as a flame tree at any time.
+// Zone names must be string literals (or live as long as the program).
+class Profiler {
+   public:
+	static const size_t RingSize = size_t(1) << 16;	// Zones kept per thread
+
+	// Names the calling thread in traces. Scheduler workers name themselves.
+	static void setThreadName(const std::string& name);
+	static void record(const char* name, uint64_t startNs, uint64_t endNs);
+	// Marks the start of a frame, to express summaries per frame
+	static void frameMark();
+
+	// Zones of every thread that started after sinceNs
+	static std::vector<TraceEvent> events(uint64_t sinceNs = 0);
+	static std::map<uint32_t, std::string> threadNames();
+	// Frames marked after sinceNs
+	static size_t frames(uint64_t sinceNs);
+	static std::vector<ThreadProfile> summary(uint64_t sinceNs);
+
+	// Writes the zones and extra events (e.g. GPU passes) as a Chrome trace
+	static bool writeTrace(const std::string& filename, uint64_t sinceNs = 0,
+						   const std::vector<TraceEvent>& extraEvents = {},
+						   const std::map<uint32_t, std::string>& extraThreads = {});
+};
+
+// Records the duration of its scope
+class ProfileZone {
+   public:
+	explicit ProfileZone(const char* name) : _name(name), _start(traceClockNs()) {}
+	~ProfileZone() { Profiler::record(_name, _start, traceClockNs()); }
+
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+   private:
+	const char* _name;
+	uint64_t _start;
+};
+
+#if PLANETGEN_PROFILER
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_THREAD(name) Profiler::setThreadName(name)
+#define PROFILE_FRAME() Profiler::frameMark()
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#define PROFILE_FRAME() ((void)0)
+#endif
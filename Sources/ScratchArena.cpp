@@ -0,0 +1,55 @@
+#include "ScratchArena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+ScratchArena& ScratchArena::local() {
+	thread_local ScratchArena arena;
+	return arena;
+}
+
+void* ScratchArena::allocate(size_t bytes, size_t alignment) {
+	for (;;) {
+		if (_block < _blocks.size()) {
+			Block& block = _blocks[_block];
+			const uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+			const size_t offset = size_t((base + _offset + alignment - 1) / alignment * alignment - base);
+			if (offset + bytes <= block.size) {
+				_offset = offset + bytes;
+				size_t consumed = _offset;
+				for (size_t b = 0; b < _block; b++) consumed += _blocks[b].size;
+				_peakBytes = std::max(_peakBytes, consumed);
+				return block.data.get() + offset;
+			}
+			if (_block + 1 < _blocks.size()) {
+				_block++;
+				_offset = 0;
+				continue;
+			}
+		}
+		// Only while the arena grows, see release()
+		Block block;
+		block.size = std::max(DefaultBlockSize, bytes + alignment);
+		block.data.reset(new unsigned char[block.size]);
+		_blocks.push_back(std::move(block));
+		_block = _blocks.size() - 1;
+		_offset = 0;
+	}
+}
+
+void ScratchArena::release(const Mark& mark) {
+	_block = mark.block;
+	_offset = mark.offset;
+	if (_block != 0 || _offset != 0 || _blocks.size() < 2) return;
+	Block merged;
+	merged.size = capacity();
+	merged.data.reset(new unsigned char[merged.size]);
+	_blocks.clear();
+	_blocks.push_back(std::move(merged));
+}
+
+size_t ScratchArena::capacity() const {
+	size_t total = 0;
+	for (const Block& block : _blocks) total += block.size;
+	return total;
+}
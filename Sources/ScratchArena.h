@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Per-thread bump allocator for the temporary arrays of the generation code.
+// Allocations are released all at once by ScratchScope. The memory is kept
+// between runs: once a run of a given size has been seen, the following
+// runs do not touch the heap.
+class ScratchArena {
+   public:
+	static constexpr size_t DefaultBlockSize = size_t(1) << 20;
+
+	struct Mark {
+		size_t block = 0;
+		size_t offset = 0;
+	};
+
+	// Arena of the calling thread
+	static ScratchArena& local();
+
+	ScratchArena() = default;
+	ScratchArena(const ScratchArena&) = delete;
+	ScratchArena& operator=(const ScratchArena&) = delete;
+
+	void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+	// Uninitialized array of a trivial type
+	template <typename T>
+	T* allocate(size_t count) {
+		return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+	}
+
+	Mark mark() const { return {_block, _offset}; }
+	// Frees everything allocated since the mark. Back at the start, the
+	// blocks are merged into one so that the next run fits in a single block.
+	void release(const Mark& mark);
+
+	size_t capacity() const;
+	size_t peakBytes() const { return _peakBytes; }
+
+   private:
+	struct Block {
+		std::unique_ptr<unsigned char[]> data;
+		size_t size = 0;
+	};
+
+	std::vector<Block> _blocks;
+	size_t _block = 0;	// Current block and offset in it
+	size_t _offset = 0;
+	size_t _peakBytes = 0;	// Blocks before the current one count as full
+};
+
+// Releases the allocations of the scope from the arena of the thread
+class ScratchScope {
+   public:
+	ScratchScope() : _arena(ScratchArena::local()), _mark(_arena.mark()) {}
+	~ScratchScope() { _arena.release(_mark); }
+
+	ScratchScope(const ScratchScope&) = delete;
+	ScratchScope& operator=(const ScratchScope&) = delete;
+
+	template <typename T>
+	T* allocate(size_t count) {
+		return _arena.allocate<T>(count);
+	}
+
+   private:
+	ScratchArena& _arena;
+	ScratchArena::Mark _mark;
+};
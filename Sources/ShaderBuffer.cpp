@@ -0,0 +1,122 @@
+#include "ShaderBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Error.h"
+#include "MemoryTracker.h"
+
+ShaderBuffer::ShaderBuffer(GLenum target, GLuint binding, size_t size)
+	: _target(target), _binding(binding) {
+	resize(size);
+}
+
+ShaderBuffer::~ShaderBuffer() { release(); }
+
+void ShaderBuffer::resize(size_t size) {
+	_size = size;
+	if (size > _shadow.size()) _shadow.resize(size, 0);
+	if (size > _capacity) allocate(std::max(size, _capacity * 2));
+}
+
+void ShaderBuffer::write(size_t offset, const void* data, size_t size) {
+	if (offset + size > _size) resize(offset + size);
+
+	// Only the bytes that differ from the shadow are marked dirty
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint8_t* shadow = _shadow.data() + offset;
+	size_t begin = 0;
+	while (begin < size && bytes[begin] == shadow[begin]) begin++;
+	if (begin == size) return;
+	size_t end = size;
+	while (bytes[end - 1] == shadow[end - 1]) end--;
+
+	std::memcpy(shadow + begin, bytes + begin, end - begin);
+	for (Region& region : _regions) addRange(region.dirty, offset + begin, offset + end);
+}
+
+void ShaderBuffer::flush() {
+	_current = (_current + 1) % RegionCount;
+	Region& region = _regions[_current];
+	const size_t base = _regionStride * _current;
+
+	_flushedBytes = 0;
+	if (!region.dirty.empty()) {
+		if (region.fence) {
+			glClientWaitSync(region.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+			glDeleteSync(region.fence);
+			region.fence = nullptr;
+		}
+		for (const auto& range : region.dirty) {
+			std::memcpy(_mapping + base + range.first, _shadow.data() + range.first, range.second - range.first);
+			glFlushMappedNamedBufferRange(_buffer, GLintptr(base + range.first), GLsizeiptr(range.second - range.first));
+			_flushedBytes += range.second - range.first;
+		}
+		region.dirty.clear();
+	}
+	glBindBufferRange(_target, _binding, _buffer, GLintptr(base), GLsizeiptr(std::max<size_t>(_size, 4)));
+}
+
+void ShaderBuffer::fence() {
+	Region& region = _regions[_current];
+	if (region.fence) glDeleteSync(region.fence);
+	region.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void ShaderBuffer::allocate(size_t capacity) {
+	release();
+
+	GLint alignment = 256;
+	glGetIntegerv(_target == GL_UNIFORM_BUFFER ? GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+											   : GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT,
+				  &alignment);
+	_capacity = capacity;
+	_regionStride = (capacity + alignment - 1) / alignment * alignment;
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT;
+	glCreateBuffers(1, &_buffer);
+	glNamedBufferStorage(_buffer, GLsizeiptr(_regionStride * RegionCount), nullptr, flags);
+	MemoryTracker::trackBuffer(_buffer, _regionStride * RegionCount, MemoryCategory::Buffers);
+	_mapping = static_cast<uint8_t*>(glMapNamedBufferRange(
+		_buffer, 0, GLsizeiptr(_regionStride * RegionCount), flags | GL_MAP_FLUSH_EXPLICIT_BIT));
+	glCheckError("Allocating shader buffer");
+	if (!_mapping) exitOnCriticalError("Cannot map shader buffer");
+
+	// A new buffer has to be filled entirely
+	_shadow.resize(capacity, 0);
+	for (Region& region : _regions) {
+		region.dirty.clear();
+		region.dirty.emplace_back(0, capacity);
+	}
+}
+
+void ShaderBuffer::release() {
+	for (Region& region : _regions) {
+		if (region.fence) glDeleteSync(region.fence);
+		region.fence = nullptr;
+	}
+	if (_buffer) {
+		glUnmapNamedBuffer(_buffer);
+		MemoryTracker::releaseBuffer(_buffer);
+		glDeleteBuffers(1, &_buffer);	// Deletion is deferred while the GPU still uses it
+	}
+	_buffer = 0;
+	_mapping = nullptr;
+}
+
+// Keeps the ranges sorted and merges the overlapping or adjacent ones
+void ShaderBuffer::addRange(std::vector<std::pair<size_t, size_t>>& ranges, size_t begin, size_t end) {
+	auto it = std::lower_bound(ranges.begin(), ranges.end(), std::make_pair(begin, end));
+	if (it != ranges.begin() && std::prev(it)->second >= begin) --it;
+	if (it == ranges.end() || it->first > end) {
+		ranges.insert(it, {begin, end});
+		return;
+	}
+	it->first = std::min(it->first, begin);
+	it->second = std::max(it->second, end);
+	auto next = std::next(it);
+	while (next != ranges.end() && next->first <= it->second) {
+		it->second = std::max(it->second, next->second);
+		next = ranges.erase(next);
+	}
+}
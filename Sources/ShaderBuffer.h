@@ -0,0 +1,80 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Binding points of the buffer blocks, must match the shaders
+enum ShaderBufferBinding : GLuint {
+	FrameBufferBinding = 0,		// std140 uniform FrameBlock
+	MaterialBufferBinding = 1,	// std140 uniform MaterialBlock
+	LightBufferBinding = 2,		// std430 buffer LightBlock
+	ClusterBufferBinding = 3,	// std430 buffer ClusterBlock
+	ClusterIndexBufferBinding = 4,	// std430 buffer ClusterIndexBlock
+	ChunkBufferBinding = 5,		// std430 buffer ChunkBlock (ChunkCull.comp)
+	DrawCommandBufferBinding = 6,	// std430 buffer CommandBlock (ChunkCull.comp)
+	DrawCounterBufferBinding = 7,	// std430 buffer DrawCounterBlock (ChunkCull.comp)
+};
+
+// Uniform or shader storage buffer written through a persistent mapping.
+// Writes go to a CPU shadow copy and only the bytes that actually changed are
+// marked dirty. The GPU buffer holds a ring of regions so that a region is
+// only rewritten once the frame reading it has completed (fenced), and only
+// its dirty ranges are copied and explicitly flushed.
+class ShaderBuffer {
+   public:
+	ShaderBuffer(GLenum target, GLuint binding, size_t size = 256);
+	~ShaderBuffer();
+
+	ShaderBuffer(const ShaderBuffer&) = delete;
+	ShaderBuffer& operator=(const ShaderBuffer&) = delete;
+
+	// Sets the bound size, growing the buffer if needed
+	void resize(size_t size);
+	size_t size() const { return _size; }
+
+	// Copies data in the shadow, the buffer grows to fit
+	void write(size_t offset, const void* data, size_t size);
+
+	template <typename T>
+	void write(size_t offset, const T& value) {
+		write(offset, &value, sizeof(T));
+	}
+
+	// Uploads the pending changes in the next region and binds it.
+	// Call before the draws reading the buffer.
+	void flush();
+	// Call after the draws reading the buffer
+	void fence();
+
+	// Bytes copied to the GPU by the last flush()
+	size_t flushedBytes() const { return _flushedBytes; }
+
+   private:
+	static const int RegionCount = 3;
+
+	struct Region {
+		GLsync fence = nullptr;
+		std::vector<std::pair<size_t, size_t>> dirty;	// [begin, end) ranges
+	};
+
+	void allocate(size_t capacity);
+	void release();
+	static void addRange(std::vector<std::pair<size_t, size_t>>& ranges, size_t begin, size_t end);
+
+	GLenum _target;
+	GLuint _binding;
+	GLuint _buffer = 0;
+	uint8_t* _mapping = nullptr;
+	size_t _capacity = 0;		// Bytes per region
+	size_t _regionStride = 0;	// Capacity rounded to the offset alignment
+	size_t _size = 0;
+
+	std::vector<uint8_t> _shadow;
+	Region _regions[RegionCount];
+	int _current = 0;
+	size_t _flushedBytes = 0;
+};
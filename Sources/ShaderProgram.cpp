@@ -6,12 +6,40 @@
 
 #include <exception>
 #include <ios>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <vector>
 
 #include "Error.h"
 #include "IO.h"
 
 using namespace std;
 
+UniformStats ShaderProgram::s_stats;
+std::string ShaderProgram::s_binaryCacheDirectory = "ShaderCache";
+
+namespace {
+
+const char binaryMagic[8] = {'P', 'G', 'P', 'R', 'O', 'G', '0', '1'};
+
+// FNV-1a, continued from a previous hash
+uint64_t hashString(const std::string& str, uint64_t hash = 14695981039346656037ull) {
+    for (unsigned char c : str) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string glString(GLenum name) {
+    const GLubyte* str = glGetString(name);
+    return str ? reinterpret_cast<const char*>(str) : "";
+}
+
+}  // namespace
+
 ShaderProgram::ShaderProgram(const std::string& name) : m_id(glCreateProgram()), m_name(name) {}
 
 
@@ -20,8 +48,11 @@ ShaderProgram::~ShaderProgram() {
 }
 
 void ShaderProgram::loadShader(GLenum type, const std::string& shaderFilename) {
+    loadShaderSource(type, IO::file2String(shaderFilename), shaderFilename);
+}
+
+void ShaderProgram::loadShaderSource(GLenum type, const std::string& shaderSourceString, const std::string& shaderFilename) {
     GLuint shader = glCreateShader(type);
-    std::string shaderSourceString = IO::file2String(shaderFilename);
     const GLchar* shaderSource = (const GLchar*)shaderSourceString.c_str();
     glShaderSource(shader, 1, &shaderSource, NULL);
     glCompileShader(shader);
@@ -35,22 +66,157 @@ void ShaderProgram::loadShader(GLenum type, const std::string& shaderFilename) {
 }
 
 void ShaderProgram::link() {
+    if (!s_binaryCacheDirectory.empty())
+        glProgramParameteri(m_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(m_id);
     glCheckError("Linking Program " + name());
     GLint linked;
     glGetProgramiv(m_id, GL_LINK_STATUS, &linked);
     if (!linked)
         exitOnCriticalError("Shader program not linked: " + infoLog());
+    reflectUniforms();
+}
+
+void ShaderProgram::reflectUniforms() {
+    m_uniforms.clear();
+    m_handles.clear();
+
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(m_id, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(m_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<GLchar> buffer(std::max(maxLength, 1));
+
+    for (GLint i = 0; i < count; i++) {
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(m_id, GLuint(i), GLsizei(buffer.size()), nullptr, &size, &type, buffer.data());
+        std::string uniformName(buffer.data());
+
+        // Arrays of basic types are reported once as "name[0]", register every element
+        bool isArray = uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0;
+        std::string baseName = isArray ? uniformName.substr(0, uniformName.size() - 3) : uniformName;
+        for (GLint element = 0; element < size; element++) {
+            std::string elementName = isArray ? baseName + "[" + std::to_string(element) + "]" : uniformName;
+            GLint location = glGetUniformLocation(m_id, elementName.c_str());
+            if (location < 0) continue; // Member of a uniform block
+            m_handles[elementName] = UniformHandle(m_uniforms.size());
+            if (isArray && element == 0) m_handles[baseName] = UniformHandle(m_uniforms.size());
+            m_uniforms.push_back({location, type, false, {}});
+        }
+    }
+    glCheckError("Reflecting uniforms of " + name());
+}
+
+
+// Key of a program binary: the sources and everything identifying the driver
+std::string ShaderProgram::binaryCacheFile(const std::vector<std::string>& sources) {
+    uint64_t hash = hashString(glString(GL_VENDOR));
+    hash = hashString(glString(GL_RENDERER), hash);
+    hash = hashString(glString(GL_VERSION), hash);
+    for (const auto& source : sources) hash = hashString(source + '\0', hash);
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hash);
+    return (std::filesystem::path(s_binaryCacheDirectory) / name).string();
 }
 
+bool ShaderProgram::loadBinary(const std::vector<std::string>& sources) {
+    if (s_binaryCacheDirectory.empty()) return false;
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats == 0) return false;
+
+    std::ifstream in(binaryCacheFile(sources), std::ios::binary);
+    if (!in) return false;
+    char magic[8];
+    GLenum format = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&format), sizeof(format));
+    if (!in || std::memcmp(magic, binaryMagic, sizeof(magic)) != 0) return false;
+    std::vector<char> binary((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (binary.empty()) return false;
+
+    glProgramBinary(m_id, format, binary.data(), GLsizei(binary.size()));
+    GLint linked = GL_FALSE;
+    glGetProgramiv(m_id, GL_LINK_STATUS, &linked);
+    if (!linked) return false; // Driver update or corrupted file, the caller compiles from source
+    reflectUniforms();
+    return true;
+}
+
+void ShaderProgram::saveBinary(const std::vector<std::string>& sources) {
+    if (s_binaryCacheDirectory.empty()) return;
+    GLint length = 0;
+    glGetProgramiv(m_id, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(m_id, length, &length, &format, binary.data());
+    glCheckError("Retrieving binary of " + name());
+
+    std::error_code error;
+    std::filesystem::create_directories(s_binaryCacheDirectory, error);
+    std::ofstream out(binaryCacheFile(sources), std::ios::binary);
+    if (!out) {
+        std::cerr << "[Shader Cache] Cannot write the binary of " << name() << std::endl;
+        return;
+    }
+    out.write(binaryMagic, sizeof(binaryMagic));
+    out.write(reinterpret_cast<const char*>(&format), sizeof(format));
+    out.write(binary.data(), length);
+}
+
+std::string ShaderProgram::injectDefines(const std::string& source, const ShaderDefines& defines) {
+    if (defines.empty()) return source;
+    std::string block;
+    for (const auto& define : defines) block += "#define " + define.first + " " + define.second + "\n";
+
+    size_t version = source.find("#version");
+    if (version == std::string::npos) return block + "#line 1\n" + source;
+    size_t lineEnd = source.find('\n', version);
+    if (lineEnd == std::string::npos) return source + "\n" + block;
+    // Keep the line numbers of the compiler messages matching the file
+    size_t versionLine = 1 + std::count(source.begin(), source.begin() + lineEnd, '\n');
+    return source.substr(0, lineEnd + 1) + block + "#line " + std::to_string(versionLine + 1) + "\n" +
+           source.substr(lineEnd + 1);
+}
+
+std::string ShaderProgram::definesKey(const ShaderDefines& defines) {
+    std::string key;
+    for (const auto& define : defines) key += (key.empty() ? "" : " ") + define.first + "=" + define.second;
+    return key;
+}
 
 std::shared_ptr<ShaderProgram> ShaderProgram::genBasicShaderProgram(const std::string& vertexShaderFilename,
-    const std::string& fragmentShaderFilename) {
+    const std::string& fragmentShaderFilename, const ShaderDefines& defines) {
     std::string shaderProgramName = "Shader Program <" + vertexShaderFilename + " - " + fragmentShaderFilename + ">";
+    return genShaderProgram(shaderProgramName, {{GL_VERTEX_SHADER, vertexShaderFilename}, {GL_FRAGMENT_SHADER, fragmentShaderFilename}}, defines);
+}
+
+std::shared_ptr<ShaderProgram> ShaderProgram::genComputeShaderProgram(const std::string& computeShaderFilename,
+    const ShaderDefines& defines) {
+    std::string shaderProgramName = "Compute Program <" + computeShaderFilename + ">";
+    return genShaderProgram(shaderProgramName, {{GL_COMPUTE_SHADER, computeShaderFilename}}, defines);
+}
+
+std::shared_ptr<ShaderProgram> ShaderProgram::genShaderProgram(std::string shaderProgramName,
+    const std::vector<std::pair<GLenum, std::string>>& stages, const ShaderDefines& defines) {
+    auto start = std::chrono::high_resolution_clock::now();
+    if (!defines.empty()) shaderProgramName += " [" + definesKey(defines) + "]";
     std::shared_ptr<ShaderProgram> shaderProgramPtr = std::make_shared<ShaderProgram>(shaderProgramName);
-    shaderProgramPtr->loadShader(GL_VERTEX_SHADER, vertexShaderFilename);
-    shaderProgramPtr->loadShader(GL_FRAGMENT_SHADER, fragmentShaderFilename);
-    shaderProgramPtr->link();
+    std::vector<std::string> sources;
+    for (const auto& stage : stages) sources.push_back(injectDefines(IO::file2String(stage.second), defines));
+
+    bool cached = shaderProgramPtr->loadBinary(sources);
+    if (!cached) {
+        for (size_t i = 0; i < stages.size(); i++)
+            shaderProgramPtr->loadShaderSource(stages[i].first, sources[i], stages[i].second);
+        shaderProgramPtr->link();
+        shaderProgramPtr->saveBinary(sources);
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout << "[Shader Cache] " << shaderProgramName << (cached ? " loaded from binary (warm) in " : " compiled from source (cold) in ")
+              << ms << " ms" << std::endl;
     return shaderProgramPtr;
 }
 
@@ -3,9 +3,27 @@
 #include <glad/glad.h>
 #include <string>
 #include <memory>
+#include <vector>
+#include <unordered_map>
+#include <map>
+#include <cstring>
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
+// Preprocessor definitions injected after the #version line, sorted by name
+using ShaderDefines = std::map<std::string, std::string>;
+
+// Index of an active uniform in its program's table, -1 if the uniform is not active
+using UniformHandle = int;
+
+// Uniform traffic of all the programs since the last resetUniformStats()
+struct UniformStats {
+    size_t uploads = 0;
+    size_t skipped = 0;     // Value identical to the last upload
+    size_t lookups = 0;     // Name to handle resolutions
+    double seconds = 0.0;   // Filled by the caller around its uniform updates
+};
+
 class ShaderProgram {
 public:
     ShaderProgram(const std::string& name = "Unnamed Shader Program");
@@ -13,7 +31,16 @@ public:
     virtual ~ShaderProgram();
 
     static std::shared_ptr<ShaderProgram> genBasicShaderProgram(const std::string& vertexShaderFilename,
-        const std::string& fragmentShaderFilename);
+        const std::string& fragmentShaderFilename, const ShaderDefines& defines = {});
+
+    static std::shared_ptr<ShaderProgram> genComputeShaderProgram(const std::string& computeShaderFilename,
+        const ShaderDefines& defines = {});
+
+    // Inserts "#define name value" lines after the #version directive
+    static std::string injectDefines(const std::string& source, const ShaderDefines& defines);
+
+    // "NAME=value NAME=value", unique per define set
+    static std::string definesKey(const ShaderDefines& defines);
 
     inline GLuint id() { return m_id; }
 
@@ -21,36 +48,110 @@ public:
 
     void loadShader(GLenum type, const std::string& shaderFilename);
 
+    void loadShaderSource(GLenum type, const std::string& source, const std::string& shaderName);
+
+    // Links the program and reflects its active uniforms
     void link();
 
+    // Loads a program binary previously saved for exactly these sources on this driver.
+    // Returns false (and leaves the program untouched) if there is none or it is rejected.
+    bool loadBinary(const std::vector<std::string>& sources);
+
+    // Saves the linked program so that loadBinary() can skip the compilation next time
+    void saveBinary(const std::vector<std::string>& sources);
+
+    // Directory of the program binaries, empty to disable the cache
+    inline static void setBinaryCacheDirectory(const std::string& directory) { s_binaryCacheDirectory = directory; }
+
     inline void use() { glUseProgram(m_id); }
 
     inline static void stop() { glUseProgram(0); }
 
-    inline GLuint getLocation(const std::string& name) { use(); return glGetUniformLocation(m_id, name.c_str()); }
+    // Resolves a name once, the handle stays valid until the program is relinked
+    inline UniformHandle handle(const std::string& name) {
+        s_stats.lookups++;
+        auto it = m_handles.find(name);
+        return it == m_handles.end() ? -1 : it->second;
+    }
+
+    inline GLint getLocation(const std::string& name) {
+        UniformHandle h = handle(name);
+        return h < 0 ? -1 : m_uniforms[h].location;
+    }
+
+    // Handle-based setters, uploads are skipped when the value did not change.
+    // The program does not need to be bound.
+    inline void set(UniformHandle h, bool value) { set(h, value ? 1 : 0); }
+
+    inline void set(UniformHandle h, float value) { setCached(h, value, [&](GLint l) { glProgramUniform1f(m_id, l, value); }); }
+
+    inline void set(UniformHandle h, int value) { setCached(h, value, [&](GLint l) { glProgramUniform1i(m_id, l, value); }); }
 
-    inline void set(const std::string& name, bool value) { use(); glUniform1i(getLocation(name.c_str()), value ? 1 : 0); }
+    inline void set(UniformHandle h, unsigned int value) {
+        if (h < 0 || m_uniforms[h].type != GL_UNSIGNED_INT) return set(h, int(value));
+        setCached(h, value, [&](GLint l) { glProgramUniform1ui(m_id, l, value); });
+    }
 
-    inline void set(const std::string& name, float value) { use(); glUniform1f(getLocation(name.c_str()), value); }
+    inline void set(UniformHandle h, const glm::vec2& value) { setCached(h, value, [&](GLint l) { glProgramUniform2fv(m_id, l, 1, glm::value_ptr(value)); }); }
 
-    inline void set(const std::string& name, int value) { use(); glUniform1i(getLocation(name.c_str()), value); }
+    inline void set(UniformHandle h, const glm::vec3& value) { setCached(h, value, [&](GLint l) { glProgramUniform3fv(m_id, l, 1, glm::value_ptr(value)); }); }
 
-    inline void set(const std::string& name, unsigned int value) { use(); glUniform1i(getLocation(name.c_str()), int(value)); }
+    inline void set(UniformHandle h, const glm::vec4& value) { setCached(h, value, [&](GLint l) { glProgramUniform4fv(m_id, l, 1, glm::value_ptr(value)); }); }
 
-    inline void set(const std::string& name, const glm::vec2& value) { use(); glUniform2fv(getLocation(name.c_str()), 1, glm::value_ptr(value)); }
+    inline void set(UniformHandle h, const glm::mat3& value) { setCached(h, value, [&](GLint l) { glProgramUniformMatrix3fv(m_id, l, 1, GL_FALSE, glm::value_ptr(value)); }); }
 
-    inline void set(const std::string& name, const glm::vec3& value) { use(); glUniform3fv(getLocation(name.c_str()), 1, glm::value_ptr(value)); }
+    inline void set(UniformHandle h, const glm::mat4& value) { setCached(h, value, [&](GLint l) { glProgramUniformMatrix4fv(m_id, l, 1, GL_FALSE, glm::value_ptr(value)); }); }
 
-    inline void set(const std::string& name, const glm::vec4& value) { use(); glUniform4fv(getLocation(name.c_str()), 1, glm::value_ptr(value)); }
+    // Name-based setters, one hash lookup per call
+    template <typename T>
+    inline void set(const std::string& name, const T& value) { set(handle(name), value); }
 
-    inline void set(const std::string& name, const glm::mat4& value) { use(); glUniformMatrix4fv(getLocation(name.c_str()), 1, GL_FALSE, glm::value_ptr(value)); }
+    inline static UniformStats& uniformStats() { return s_stats; }
+
+    // Returns the stats accumulated since the last call and starts over
+    inline static UniformStats resetUniformStats() { UniformStats stats = s_stats; s_stats = UniformStats(); return stats; }
 
 private:
+    struct Uniform {
+        GLint location;
+        GLenum type;
+        bool cached = false;
+        alignas(16) unsigned char value[sizeof(glm::mat4)];
+    };
+
+    template <typename T, typename Upload>
+    inline void setCached(UniformHandle h, const T& value, Upload upload) {
+        static_assert(sizeof(T) <= sizeof(Uniform::value), "Uniform value too large for the cache");
+        if (h < 0) return;
+        Uniform& uniform = m_uniforms[h];
+        if (uniform.cached && std::memcmp(uniform.value, &value, sizeof(T)) == 0) {
+            s_stats.skipped++;
+            return;
+        }
+        std::memcpy(uniform.value, &value, sizeof(T));
+        uniform.cached = true;
+        upload(uniform.location);
+        s_stats.uploads++;
+    }
+
+    void reflectUniforms();
+
+    // Loads from the binary cache or compiles and links the (stage, filename) pairs
+    static std::shared_ptr<ShaderProgram> genShaderProgram(std::string shaderProgramName,
+        const std::vector<std::pair<GLenum, std::string>>& stages, const ShaderDefines& defines);
+
+    static std::string binaryCacheFile(const std::vector<std::string>& sources);
+
     std::string shaderInfoLog(const std::string& shaderName, GLuint shaderId);
 
     std::string infoLog();
 
     GLuint m_id = 0;
     std::string m_name;
-};
 
+    std::vector<Uniform> m_uniforms;
+    std::unordered_map<std::string, UniformHandle> m_handles;
+
+    static UniformStats s_stats;
+    static std::string s_binaryCacheDirectory;
+};
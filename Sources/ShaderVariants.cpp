@@ -0,0 +1,11 @@
+#include "ShaderVariants.h"
+
+std::shared_ptr<ShaderProgram> ShaderVariants::get(const ShaderDefines& defines) {
+	std::string key = ShaderProgram::definesKey(defines);
+	auto it = _variants.find(key);
+	if (it != _variants.end()) return it->second;
+
+	auto program = ShaderProgram::genBasicShaderProgram(_vertexShaderFilename, _fragmentShaderFilename, defines);
+	_variants.emplace(key, program);
+	return program;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "ShaderProgram.h"
+
+// Permutations of a vertex/fragment shader pair, one program per define set.
+// Variants are compiled (or loaded from the binary cache) on first use and
+// kept until clear().
+class ShaderVariants {
+   public:
+	ShaderVariants(const std::string& vertexShaderFilename, const std::string& fragmentShaderFilename)
+		: _vertexShaderFilename(vertexShaderFilename), _fragmentShaderFilename(fragmentShaderFilename) {}
+
+	std::shared_ptr<ShaderProgram> get(const ShaderDefines& defines);
+	// Registers a variant built elsewhere, e.g. on a loader context
+	void add(const ShaderDefines& defines, std::shared_ptr<ShaderProgram> program) {
+		_variants[ShaderProgram::definesKey(defines)] = std::move(program);
+	}
+
+	// Drops every variant, e.g. after the sources changed
+	void clear() { _variants.clear(); }
+
+	size_t size() const { return _variants.size(); }
+
+   private:
+	std::string _vertexShaderFilename;
+	std::string _fragmentShaderFilename;
+	std::unordered_map<std::string, std::shared_ptr<ShaderProgram>> _variants;
+};
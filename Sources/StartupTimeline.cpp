@@ -0,0 +1,52 @@
+#include "StartupTimeline.h"
+
+#include <cstdio>
+
+#include "Trace.h"
+
+StartupTimeline::StartupTimeline() : _startNs(traceClockNs()) {}
+
+double StartupTimeline::elapsedMs() const { return (traceClockNs() - _startNs) / 1e6; }
+
+void StartupTimeline::begin(const std::string& stage) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	StartupStage entry;
+	entry.name = stage;
+	entry.startMs = elapsedMs();
+	_stages.push_back(entry);
+}
+
+void StartupTimeline::end(const std::string& stage) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	for (StartupStage& entry : _stages) {
+		if (entry.name != stage || entry.endMs >= 0.0) continue;
+		entry.endMs = elapsedMs();
+		std::printf("[Startup] %-18s %9.1f ms, done at %9.1f ms\n", stage.c_str(), entry.endMs - entry.startMs,
+					entry.endMs);
+		std::fflush(stdout);
+		return;
+	}
+}
+
+void StartupTimeline::firstFrame() {
+	if (_firstFrameMs >= 0.0) return;
+	_firstFrameMs = elapsedMs();
+	std::printf("[Startup] First frame at %.1f ms\n", _firstFrameMs);
+}
+
+void StartupTimeline::firstPlanetFrame() {
+	if (_firstPlanetFrameMs >= 0.0) return;
+	_firstPlanetFrameMs = elapsedMs();
+	std::printf("[Startup] First planet frame at %.1f ms\n", _firstPlanetFrameMs);
+}
+
+void StartupTimeline::fullDetail() {
+	if (_fullDetailMs >= 0.0) return;
+	_fullDetailMs = elapsedMs();
+	std::lock_guard<std::mutex> lock(_mutex);
+	std::printf("[Startup] Full detail at %.1f ms (first frame %.1f ms, first planet frame %.1f ms)\n",
+				_fullDetailMs, _firstFrameMs, _firstPlanetFrameMs);
+	for (const StartupStage& stage : _stages)
+		std::printf("[Startup]   %-18s %9.1f - %9.1f ms\n", stage.name.c_str(), stage.startMs, stage.endMs);
+	std::fflush(stdout);
+}
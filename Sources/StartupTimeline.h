@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct StartupStage {
+	std::string name;
+	double startMs = 0.0;	// Since the start of the timeline
+	double endMs = -1.0;	// Negative while running
+};
+
+// Stages of the viewer startup, timed from the start of main(). The stages
+// overlap and may end on any thread; each one is logged as it finishes,
+// along with the time to the first frame and to the full detail.
+class StartupTimeline {
+   public:
+	StartupTimeline();
+
+	void begin(const std::string& stage);
+	void end(const std::string& stage);
+
+	// First presented frame, and first frame with the planet (placeholder or not)
+	void firstFrame();
+	void firstPlanetFrame();
+	// Every stage is done and swapped in, prints the summary
+	void fullDetail();
+	bool isFullDetail() const { return _fullDetailMs >= 0.0; }
+
+	double elapsedMs() const;
+
+   private:
+	uint64_t _startNs;
+	std::mutex _mutex;
+	std::vector<StartupStage> _stages;
+	double _firstFrameMs = -1.0;
+	double _firstPlanetFrameMs = -1.0;
+	double _fullDetailMs = -1.0;
+};
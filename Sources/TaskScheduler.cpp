@@ -0,0 +1,255 @@
+#include "TaskScheduler.h"
+
+#include <chrono>
+
+#include "PerfCounters.h"
+#include "Profiler.h"
+#include "Trace.h"
+
+namespace {
+
+std::mutex instanceMutex;
+std::atomic<TaskScheduler*> instancePtr{nullptr};
+std::unique_ptr<TaskScheduler> instanceOwner;
+
+thread_local int currentWorker = -1;
+thread_local int executeDepth = 0;	// Nested tasks run by wait() are already timed
+
+void runClosure(void* context, size_t, size_t) {
+	std::unique_ptr<std::function<void()>> function(static_cast<std::function<void()>*>(context));
+	(*function)();
+}
+
+}  // namespace
+
+bool TaskScheduler::Queue::pushBack(const Task& task) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (size == QueueCapacity) return false;
+	tasks[(head + size) % QueueCapacity] = task;
+	size++;
+	return true;
+}
+
+bool TaskScheduler::Queue::popBack(Task& task) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (size == 0) return false;
+	size--;
+	task = tasks[(head + size) % QueueCapacity];
+	return true;
+}
+
+bool TaskScheduler::Queue::popFront(Task& task) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (size == 0) return false;
+	task = tasks[head];
+	head = (head + 1) % QueueCapacity;
+	size--;
+	return true;
+}
+
+TaskScheduler& TaskScheduler::instance() {
+	TaskScheduler* scheduler = instancePtr.load(std::memory_order_acquire);
+	if (scheduler) return *scheduler;
+	std::lock_guard<std::mutex> lock(instanceMutex);
+	if (!instanceOwner) {
+		instanceOwner.reset(new TaskScheduler(hardwareThreads()));
+		instancePtr.store(instanceOwner.get(), std::memory_order_release);
+	}
+	return *instanceOwner;
+}
+
+void TaskScheduler::setThreadCount(int threads) {
+	std::lock_guard<std::mutex> lock(instanceMutex);
+	if (instanceOwner && instanceOwner->threadCount() == std::max(1, threads)) return;
+	instancePtr.store(nullptr, std::memory_order_release);
+	instanceOwner.reset();
+	instanceOwner.reset(new TaskScheduler(threads));
+	instancePtr.store(instanceOwner.get(), std::memory_order_release);
+}
+
+int TaskScheduler::hardwareThreads() {
+	return std::max(1, int(std::thread::hardware_concurrency()));
+}
+
+int TaskScheduler::workerIndex() { return currentWorker; }
+
+TaskScheduler::TaskScheduler(int threads) : _injection(std::make_unique<Worker>()) {
+	_injection->startNs = traceClockNs();
+	for (int i = 0; i < std::max(1, threads) - 1; i++) _workers.push_back(std::make_unique<Worker>());
+	// Started once _workers is complete, the workers steal from each other
+	for (int i = 0; i < int(_workers.size()); i++) {
+		_workers[i]->startNs = traceClockNs();
+		_workers[i]->thread = std::thread(&TaskScheduler::workerLoop, this, i);
+	}
+	// The setup of the workers allocates, keep it out of the caller's next measurements
+	while (_started.load() < int(_workers.size())) std::this_thread::yield();
+}
+
+TaskScheduler::~TaskScheduler() {
+	{
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+		_stop = true;
+	}
+	_wake.notify_all();
+	for (auto& worker : _workers) worker->thread.join();
+}
+
+void TaskScheduler::spawn(const Task& task, TaskPriority priority) {
+	if (task.group) task.group->_pending.fetch_add(1, std::memory_order_relaxed);
+	// Counted before the push so that the count never goes below the queued tasks
+	_queued.fetch_add(1);
+	if (!slot(currentWorker).queues[size_t(priority)].pushBack(task)) {
+		_queued.fetch_sub(1);
+		execute(task, slot(currentWorker));
+		return;
+	}
+	if (_sleeping.load() > 0) {
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+		_wake.notify_one();
+	}
+}
+
+void TaskScheduler::run(TaskGroup& group, std::function<void()> function, TaskPriority priority) {
+	Task task;
+	task.function = runClosure;
+	task.context = new std::function<void()>(std::move(function));
+	task.group = &group;
+	spawn(task, priority);
+}
+
+void TaskScheduler::submit(std::function<void()> function, TaskPriority priority) {
+	if (_workers.empty()) {
+		function();
+		return;
+	}
+	Task task;
+	task.function = runClosure;
+	task.context = new std::function<void()>(std::move(function));
+	spawn(task, priority);
+}
+
+void TaskScheduler::wait(TaskGroup& group) {
+	Task task;
+	int idle = 0;
+	while (!group.done()) {
+		if (findTask(currentWorker, task)) {
+			execute(task, slot(currentWorker));
+			idle = 0;
+		} else if (++idle < 64) {
+			std::this_thread::yield();
+		} else {
+			// The last tasks of the group run elsewhere
+			std::this_thread::sleep_for(std::chrono::microseconds(20));
+		}
+	}
+}
+
+bool TaskScheduler::findTask(int index, Task& task) {
+	const int workers = int(_workers.size());
+	for (size_t priority = 0; priority < size_t(TaskPriority::Count); priority++) {
+		bool found = (index >= 0 && _workers[index]->queues[priority].popBack(task)) ||
+					 _injection->queues[priority].popFront(task);
+		for (int i = 0; i < workers && !found; i++) {
+			const int victim = (index + 1 + i) % workers;
+			if (victim == index) continue;
+			found = _workers[victim]->queues[priority].popFront(task);
+			if (found) slot(index).steals.fetch_add(1, std::memory_order_relaxed);
+		}
+		if (found) {
+			_queued.fetch_sub(1);
+			return true;
+		}
+	}
+	return false;
+}
+
+void TaskScheduler::execute(const Task& task, Worker& slot) {
+	const uint64_t start = executeDepth == 0 ? traceClockNs() : 0;
+	executeDepth++;
+	task.function(task.context, task.begin, task.end);
+	executeDepth--;
+	if (executeDepth == 0) slot.busyNs.fetch_add(traceClockNs() - start, std::memory_order_relaxed);
+	slot.tasks.fetch_add(1, std::memory_order_relaxed);
+	if (task.group) task.group->_pending.fetch_sub(1, std::memory_order_release);
+}
+
+void TaskScheduler::workerLoop(int index) {
+	currentWorker = index;
+	Profiler::setThreadName("Worker " + std::to_string(index));
+	PerfCounters::registerThread();
+	_started.fetch_add(1);
+	Worker& self = *_workers[index];
+	Task task;
+	while (!_stop.load()) {
+		if (findTask(index, task)) {
+			execute(task, self);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(_sleepMutex);
+		_sleeping.fetch_add(1);
+		_wake.wait(lock, [&] { return _stop.load() || _queued.load() > 0; });
+		_sleeping.fetch_sub(1);
+	}
+	PerfCounters::unregisterThread();
+	currentWorker = -1;
+}
+
+std::vector<WorkerStats> TaskScheduler::stats() const {
+	const uint64_t now = traceClockNs();
+	std::vector<WorkerStats> result;
+	auto add = [&](const Worker& worker, std::string name) {
+		WorkerStats stats;
+		stats.name = std::move(name);
+		stats.tasks = worker.tasks.load(std::memory_order_relaxed);
+		stats.steals = worker.steals.load(std::memory_order_relaxed);
+		stats.busyNs = worker.busyNs.load(std::memory_order_relaxed);
+		stats.aliveNs = now - worker.startNs;
+		result.push_back(std::move(stats));
+	};
+	for (size_t i = 0; i < _workers.size(); i++) add(*_workers[i], "Worker " + std::to_string(i));
+	add(*_injection, "Other threads");
+	return result;
+}
+
+TaskGraph::Node TaskGraph::add(std::function<void()> function, TaskPriority priority) {
+	auto node = std::make_unique<NodeData>();
+	node->function = std::move(function);
+	node->priority = priority;
+	_nodes.push_back(std::move(node));
+	return _nodes.size() - 1;
+}
+
+void TaskGraph::precede(Node before, Node after) {
+	_nodes[before]->successors.push_back(after);
+	_nodes[after]->predecessors++;
+}
+
+TaskGraph::Node TaskGraph::then(Node node, std::function<void()> function, TaskPriority priority) {
+	Node next = add(std::move(function), priority);
+	precede(node, next);
+	return next;
+}
+
+void TaskGraph::spawnNode(Node node) {
+	Task task;
+	task.function = [](void* context, size_t index, size_t) {
+		TaskGraph& graph = *static_cast<TaskGraph*>(context);
+		NodeData& data = *graph._nodes[index];
+		data.function();
+		// Spawned before this task leaves the group, which stays non-empty
+		for (Node successor : data.successors)
+			if (graph._nodes[successor]->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				graph.spawnNode(successor);
+	};
+	task.context = this;
+	task.begin = node;
+	task.group = &_group;
+	TaskScheduler::instance().spawn(task, _nodes[node]->priority);
+}
+
+void TaskGraph::run() {
+	for (auto& node : _nodes) node->remaining.store(node->predecessors, std::memory_order_relaxed);
+	for (Node node = 0; node < _nodes.size(); node++)
+		if (_nodes[node]->predecessors == 0) spawnNode(node);
+	TaskScheduler::instance().wait(_group);
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Higher priorities are always taken first, by their owner and by thieves
+enum class TaskPriority : uint8_t { High, Normal, Low, Count };
+
+// Counts the pending tasks of a batch. TaskScheduler::wait() runs other tasks
+// until it is empty, so that waiting from inside a task never blocks a worker.
+class TaskGroup {
+   public:
+	TaskGroup() = default;
+	TaskGroup(const TaskGroup&) = delete;
+	TaskGroup& operator=(const TaskGroup&) = delete;
+
+	bool done() const { return _pending.load(std::memory_order_acquire) == 0; }
+
+   private:
+	friend class TaskScheduler;
+	std::atomic<size_t> _pending{0};
+};
+
+// Function over [begin, end) of an index range, without allocation
+struct Task {
+	void (*function)(void* context, size_t begin, size_t end) = nullptr;
+	void* context = nullptr;
+	size_t begin = 0;
+	size_t end = 0;
+	TaskGroup* group = nullptr;
+};
+
+struct WorkerStats {
+	std::string name;
+	size_t tasks = 0;
+	size_t steals = 0;	 // Tasks taken from the queue of another thread
+	uint64_t busyNs = 0;
+	uint64_t aliveNs = 0;
+};
+
+// Work-stealing scheduler. Every worker owns a bounded deque per priority: it
+// pushes and pops its own tasks at the back (depth first, cache friendly)
+// while idle workers steal from the front of the others (breadth first).
+// Tasks spawned outside of the workers go to a shared injection queue.
+// Threads waiting on a group execute tasks meanwhile, which makes nested
+// parallelism safe. With a thread count of 1 there are no workers, and the
+// tasks run on the waiting thread.
+class TaskScheduler {
+   public:
+	static constexpr size_t QueueCapacity = 1024;	// A task that does not fit runs inline
+
+	// Created on first use with one thread per hardware thread, the caller included
+	static TaskScheduler& instance();
+	// Restarts the workers, only call it while no task is pending
+	static void setThreadCount(int threads);
+	static int hardwareThreads();
+
+	~TaskScheduler();
+
+	// Workers plus the waiting thread
+	int threadCount() const { return int(_workers.size()) + 1; }
+	// Index of the current worker, -1 on other threads
+	static int workerIndex();
+
+	void spawn(const Task& task, TaskPriority priority = TaskPriority::Normal);
+	// Runs a closure, allocates it unlike spawn(Task)
+	void run(TaskGroup& group, std::function<void()> function, TaskPriority priority = TaskPriority::Normal);
+	// Fire and forget, with no worker it runs before returning
+	void submit(std::function<void()> function, TaskPriority priority = TaskPriority::Low);
+	// Executes pending tasks until the group is empty
+	void wait(TaskGroup& group);
+
+	// Cumulative per worker, followed by one entry for the other threads
+	std::vector<WorkerStats> stats() const;
+
+   private:
+	struct Queue {
+		std::mutex mutex;
+		Task tasks[QueueCapacity];
+		size_t head = 0;	// Oldest, stolen first
+		size_t size = 0;
+
+		bool pushBack(const Task& task);
+		bool popBack(Task& task);
+		bool popFront(Task& task);
+	};
+
+	struct Worker {
+		Queue queues[size_t(TaskPriority::Count)];
+		std::thread thread;
+		std::atomic<size_t> tasks{0};
+		std::atomic<size_t> steals{0};
+		std::atomic<uint64_t> busyNs{0};
+		uint64_t startNs = 0;
+	};
+
+	explicit TaskScheduler(int threads);
+
+	void workerLoop(int index);
+	bool findTask(int index, Task& task);
+	void execute(const Task& task, Worker& slot);
+	Worker& slot(int index) { return index >= 0 ? *_workers[index] : *_injection; }
+
+	std::vector<std::unique_ptr<Worker>> _workers;
+	std::unique_ptr<Worker> _injection;	// Also the statistics of the other threads
+
+	std::atomic<size_t> _queued{0};
+	std::atomic<int> _sleeping{0};
+	std::atomic<int> _started{0};	// Workers past their setup
+	std::atomic<bool> _stop{false};
+	std::mutex _sleepMutex;
+	std::condition_variable _wake;
+};
+
+// Runs function(rangeBegin, rangeEnd) over [begin, end) split in ranges of at
+// least grain indices, and returns once all of them are done.
+template <typename Function>
+void parallelFor(size_t begin, size_t end, size_t grain, const Function& function,
+				 TaskPriority priority = TaskPriority::Normal) {
+	if (end <= begin) return;
+	TaskScheduler& scheduler = TaskScheduler::instance();
+	const size_t count = end - begin;
+	// A few ranges per thread balance uneven work without flooding the queues
+	const size_t ranges = size_t(scheduler.threadCount()) * 4;
+	grain = std::max<size_t>({grain, 1, (count + ranges - 1) / ranges});
+	if (count <= grain || scheduler.threadCount() == 1) {
+		function(begin, end);
+		return;
+	}
+
+	TaskGroup group;
+	Task task;
+	task.function = [](void* context, size_t rangeBegin, size_t rangeEnd) {
+		(*static_cast<const Function*>(context))(rangeBegin, rangeEnd);
+	};
+	task.context = const_cast<Function*>(&function);
+	task.group = &group;
+	// The caller takes the first range itself
+	for (size_t b = begin + grain; b < end; b += grain) {
+		task.begin = b;
+		task.end = std::min(end, b + grain);
+		scheduler.spawn(task, priority);
+	}
+	function(begin, begin + grain);
+	scheduler.wait(group);
+}
+
+// Dependency graph of closures. A node starts once all its predecessors are
+// done, so continuations are nodes added with then().
+class TaskGraph {
+   public:
+	using Node = size_t;
+
+	Node add(std::function<void()> function, TaskPriority priority = TaskPriority::Normal);
+	// after starts once before is done
+	void precede(Node before, Node after);
+	// New node that continues node
+	Node then(Node node, std::function<void()> function, TaskPriority priority = TaskPriority::Normal);
+
+	// Runs every node, returns when the whole graph is done. Can run again.
+	void run();
+
+   private:
+	struct NodeData {
+		std::function<void()> function;
+		TaskPriority priority = TaskPriority::Normal;
+		std::vector<Node> successors;
+		size_t predecessors = 0;
+		std::atomic<size_t> remaining{0};
+	};
+
+	void spawnNode(Node node);
+
+	std::vector<std::unique_ptr<NodeData>> _nodes;
+	TaskGroup _group;
+};
@@ -0,0 +1,281 @@
+#include "TextureCompressor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "TaskScheduler.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BC1_USE_SSE2
+#endif
+
+namespace {
+
+inline uint16_t to565(const float c[3]) {
+	int r = std::clamp(int(c[0] * (31.0f / 255.0f) + 0.5f), 0, 31);
+	int g = std::clamp(int(c[1] * (63.0f / 255.0f) + 0.5f), 0, 63);
+	int b = std::clamp(int(c[2] * (31.0f / 255.0f) + 0.5f), 0, 31);
+	return uint16_t((r << 11) | (g << 5) | b);
+}
+
+inline void from565(uint16_t v, float out[3]) {
+	int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+	out[0] = float((r << 3) | (r >> 2));
+	out[1] = float((g << 2) | (g >> 4));
+	out[2] = float((b << 3) | (b >> 2));
+}
+
+// 2x2 box filter, clamping at odd borders
+std::vector<uint8_t> downsample(int width, int height, const std::vector<uint8_t>& src,
+								int& outWidth, int& outHeight) {
+	outWidth = std::max(1, width / 2);
+	outHeight = std::max(1, height / 2);
+	std::vector<uint8_t> dst(size_t(outWidth) * outHeight * 3);
+	for (int y = 0; y < outHeight; y++) {
+		int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+		for (int x = 0; x < outWidth; x++) {
+			int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+			for (int c = 0; c < 3; c++) {
+				int sum = src[(size_t(y0) * width + x0) * 3 + c] + src[(size_t(y0) * width + x1) * 3 + c] +
+						  src[(size_t(y1) * width + x0) * 3 + c] + src[(size_t(y1) * width + x1) * 3 + c];
+				dst[(size_t(y) * outWidth + x) * 3 + c] = uint8_t((sum + 2) / 4);
+			}
+		}
+	}
+	return dst;
+}
+
+// Gathers the 4x4 block at (bx, by), clamping texels outside the image
+void gatherBlock(int width, int height, const std::vector<uint8_t>& src, int bx, int by,
+				 uint8_t block[16 * 3]) {
+	for (int j = 0; j < 4; j++) {
+		int y = std::min(by * 4 + j, height - 1);
+		for (int i = 0; i < 4; i++) {
+			int x = std::min(bx * 4 + i, width - 1);
+			const uint8_t* texel = &src[(size_t(y) * width + x) * 3];
+			std::copy(texel, texel + 3, &block[(j * 4 + i) * 3]);
+		}
+	}
+}
+
+void encodeLevel(int width, int height, const std::vector<uint8_t>& rgb, CompressedMip& mip) {
+	const int blocksX = (width + 3) / 4;
+	const int blockTotal = int(TextureCompressor::blockCount(width, height));
+	mip.width = width;
+	mip.height = height;
+	mip.data.resize(size_t(blockTotal) * 8);
+
+	parallelFor(0, size_t(blockTotal), 256, [&](size_t begin, size_t end) {
+		uint8_t block[16 * 3];
+		for (size_t b = begin; b < end; b++) {
+			gatherBlock(width, height, rgb, int(b) % blocksX, int(b) / blocksX, block);
+			TextureCompressor::encodeBlockBC1(block, &mip.data[b * 8]);
+		}
+	});
+}
+
+}  // namespace
+
+void TextureCompressor::encodeBlockBC1(const uint8_t rgb[16 * 3], uint8_t out[8]) {
+	alignas(16) float r[16], g[16], b[16];
+	float mean[3] = {0.0f, 0.0f, 0.0f};
+	for (int i = 0; i < 16; i++) {
+		r[i] = rgb[i * 3 + 0];
+		g[i] = rgb[i * 3 + 1];
+		b[i] = rgb[i * 3 + 2];
+		mean[0] += r[i];
+		mean[1] += g[i];
+		mean[2] += b[i];
+	}
+	for (float& m : mean) m /= 16.0f;
+
+	// Principal axis of the block colors (covariance + power iteration)
+	float cov[6] = {0, 0, 0, 0, 0, 0};
+	for (int i = 0; i < 16; i++) {
+		float dr = r[i] - mean[0], dg = g[i] - mean[1], db = b[i] - mean[2];
+		cov[0] += dr * dr;
+		cov[1] += dr * dg;
+		cov[2] += dr * db;
+		cov[3] += dg * dg;
+		cov[4] += dg * db;
+		cov[5] += db * db;
+	}
+	// Seeded with the covariance row of the channel that varies most: (1, 1, 1)
+	// would be orthogonal to the principal axis of e.g. a red/green block
+	const float rows[3][3] = {{cov[0], cov[1], cov[2]}, {cov[1], cov[3], cov[4]}, {cov[2], cov[4], cov[5]}};
+	const int seed = cov[0] >= cov[3] ? (cov[0] >= cov[5] ? 0 : 2) : (cov[3] >= cov[5] ? 1 : 2);
+	float axis[3] = {rows[seed][0], rows[seed][1], rows[seed][2]};
+	if (std::max(std::fabs(axis[0]), std::max(std::fabs(axis[1]), std::fabs(axis[2]))) < 1e-6f) {
+		// Flat block, any axis gives the same endpoints
+		axis[0] = axis[1] = axis[2] = 1.0f;
+	}
+	for (int it = 0; it < 4; it++) {
+		float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+		float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+		float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+		float m = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+		if (m < 1e-6f) break;
+		axis[0] = x / m;
+		axis[1] = y / m;
+		axis[2] = z / m;
+	}
+	float axisLenSq = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+	// Extremes along the axis, inset by 1/16 of the range to reduce error
+	float tMin = 0.0f, tMax = 0.0f;
+	for (int i = 0; i < 16; i++) {
+		float t = (r[i] - mean[0]) * axis[0] + (g[i] - mean[1]) * axis[1] + (b[i] - mean[2]) * axis[2];
+		tMin = std::min(tMin, t);
+		tMax = std::max(tMax, t);
+	}
+	float inset = (tMax - tMin) / 16.0f;
+	tMin = (tMin + inset) / axisLenSq;
+	tMax = (tMax - inset) / axisLenSq;
+	float e0[3], e1[3];
+	for (int c = 0; c < 3; c++) {
+		e0[c] = mean[c] + tMax * axis[c];
+		e1[c] = mean[c] + tMin * axis[c];
+	}
+
+	uint16_t c0 = to565(e0), c1 = to565(e1);
+	if (c0 < c1) std::swap(c0, c1);
+
+	uint32_t indices = 0;
+	if (c0 != c1) {
+		// Four color mode palette: c0, c1, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1
+		float pal[4][3];
+		from565(c0, pal[0]);
+		from565(c1, pal[1]);
+		for (int c = 0; c < 3; c++) {
+			pal[2][c] = (2.0f * pal[0][c] + pal[1][c]) / 3.0f;
+			pal[3][c] = (pal[0][c] + 2.0f * pal[1][c]) / 3.0f;
+		}
+
+		alignas(16) int best[16];
+#ifdef BC1_USE_SSE2
+		for (int i = 0; i < 16; i += 4) {
+			__m128 pr = _mm_load_ps(r + i), pg = _mm_load_ps(g + i), pb = _mm_load_ps(b + i);
+			__m128 bestDist = _mm_set1_ps(1e30f);
+			__m128i bestIdx = _mm_setzero_si128();
+			for (int k = 0; k < 4; k++) {
+				__m128 dr = _mm_sub_ps(pr, _mm_set1_ps(pal[k][0]));
+				__m128 dg = _mm_sub_ps(pg, _mm_set1_ps(pal[k][1]));
+				__m128 db = _mm_sub_ps(pb, _mm_set1_ps(pal[k][2]));
+				__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+				__m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, bestDist));
+				bestDist = _mm_min_ps(d, bestDist);
+				bestIdx = _mm_or_si128(_mm_andnot_si128(closer, bestIdx),
+									   _mm_and_si128(closer, _mm_set1_epi32(k)));
+			}
+			_mm_store_si128(reinterpret_cast<__m128i*>(best + i), bestIdx);
+		}
+#else
+		for (int i = 0; i < 16; i++) {
+			float bestDist = 1e30f;
+			best[i] = 0;
+			for (int k = 0; k < 4; k++) {
+				float dr = r[i] - pal[k][0], dg = g[i] - pal[k][1], db = b[i] - pal[k][2];
+				float d = dr * dr + dg * dg + db * db;
+				if (d < bestDist) {
+					bestDist = d;
+					best[i] = k;
+				}
+			}
+		}
+#endif
+		for (int i = 0; i < 16; i++) indices |= uint32_t(best[i]) << (2 * i);
+	}
+
+	out[0] = uint8_t(c0);
+	out[1] = uint8_t(c0 >> 8);
+	out[2] = uint8_t(c1);
+	out[3] = uint8_t(c1 >> 8);
+	out[4] = uint8_t(indices);
+	out[5] = uint8_t(indices >> 8);
+	out[6] = uint8_t(indices >> 16);
+	out[7] = uint8_t(indices >> 24);
+}
+
+void TextureCompressor::decodeBlockBC1(const uint8_t block[8], uint8_t rgb[16 * 3]) {
+	uint16_t c0 = uint16_t(block[0] | (block[1] << 8));
+	uint16_t c1 = uint16_t(block[2] | (block[3] << 8));
+	uint32_t indices = uint32_t(block[4]) | (uint32_t(block[5]) << 8) |
+					   (uint32_t(block[6]) << 16) | (uint32_t(block[7]) << 24);
+
+	float pal[4][3];
+	from565(c0, pal[0]);
+	from565(c1, pal[1]);
+	for (int c = 0; c < 3; c++) {
+		if (c0 > c1) {
+			pal[2][c] = (2.0f * pal[0][c] + pal[1][c]) / 3.0f;
+			pal[3][c] = (pal[0][c] + 2.0f * pal[1][c]) / 3.0f;
+		} else {
+			pal[2][c] = (pal[0][c] + pal[1][c]) / 2.0f;
+			pal[3][c] = 0.0f;
+		}
+	}
+	for (int i = 0; i < 16; i++) {
+		const float* color = pal[(indices >> (2 * i)) & 3];
+		for (int c = 0; c < 3; c++) rgb[i * 3 + c] = uint8_t(color[c] + 0.5f);
+	}
+}
+
+float TextureCompressor::psnr(const CompressedMip& mip, const std::vector<uint8_t>& rgbPixels) {
+	const int blocksX = (mip.width + 3) / 4;
+	const int blockTotal = int(blockCount(mip.width, mip.height));
+	double squaredError = 0.0;
+	for (int b = 0; b < blockTotal; b++) {
+		uint8_t decoded[16 * 3];
+		decodeBlockBC1(&mip.data[size_t(b) * 8], decoded);
+		for (int j = 0; j < 4; j++) {
+			int y = (b / blocksX) * 4 + j;
+			for (int i = 0; i < 4; i++) {
+				int x = (b % blocksX) * 4 + i;
+				if (x >= mip.width || y >= mip.height) continue;
+				for (int c = 0; c < 3; c++) {
+					double d = double(decoded[(j * 4 + i) * 3 + c]) -
+							   double(rgbPixels[(size_t(y) * mip.width + x) * 3 + c]);
+					squaredError += d * d;
+				}
+			}
+		}
+	}
+	double mse = squaredError / (double(mip.width) * mip.height * 3.0);
+	if (mse <= 0.0) return 99.0f;
+	return float(10.0 * std::log10(255.0 * 255.0 / mse));
+}
+
+CompressedTexture TextureCompressor::encodeBC1(int width, int height,
+											   const std::vector<uint8_t>& rgbPixels,
+											   CompressionStats* stats) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	CompressedTexture texture;
+	std::vector<uint8_t> level;
+	const std::vector<uint8_t>* source = &rgbPixels;
+	int w = width, h = height;
+	size_t pixels = 0;
+	while (true) {
+		texture.mips.emplace_back();
+		encodeLevel(w, h, *source, texture.mips.back());
+		pixels += size_t(w) * h;
+		if (w == 1 && h == 1) break;
+		int nw, nh;
+		level = downsample(w, h, *source, nw, nh);
+		source = &level;
+		w = nw;
+		h = nh;
+	}
+
+	if (stats) {
+		auto end = std::chrono::high_resolution_clock::now();
+		stats->seconds = std::chrono::duration<double>(end - start).count();
+		stats->megapixelsPerSecond = stats->seconds > 0.0 ? pixels / stats->seconds * 1e-6 : 0.0;
+		stats->psnr = psnr(texture.mips[0], rgbPixels);
+		stats->uncompressedBytes = pixels * 4;
+		stats->compressedBytes = texture.bytes();
+	}
+	return texture;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// One level of a block-compressed mip chain
+struct CompressedMip {
+	int width = 0;
+	int height = 0;
+	std::vector<uint8_t> data;
+};
+
+// BC1 (DXT1) mip chain, level 0 first
+struct CompressedTexture {
+	std::vector<CompressedMip> mips;
+
+	size_t bytes() const {
+		size_t total = 0;
+		for (const auto& mip : mips) total += mip.data.size();
+		return total;
+	}
+};
+
+struct CompressionStats {
+	double seconds = 0.0;
+	double megapixelsPerSecond = 0.0;
+	float psnr = 0.0f;				// Level 0, in dB
+	size_t uncompressedBytes = 0;	// As stored by the driver for GL_RGB8 (RGBA8)
+	size_t compressedBytes = 0;
+};
+
+// CPU encoder from RGB8 images to BC1 mip chains
+class TextureCompressor {
+   public:
+	// Builds the full mip chain of an RGB8 image and encodes every level to BC1.
+	// Blocks of a level are encoded in parallel.
+	static CompressedTexture encodeBC1(int width, int height,
+									   const std::vector<uint8_t>& rgbPixels,
+									   CompressionStats* stats = nullptr);
+
+	// Encodes one 4x4 block given as 16 RGB8 texels
+	static void encodeBlockBC1(const uint8_t rgb[16 * 3], uint8_t out[8]);
+	// Decodes one BC1 block to 16 RGB8 texels
+	static void decodeBlockBC1(const uint8_t block[8], uint8_t rgb[16 * 3]);
+
+	// Peak signal to noise ratio of a BC1 level against its RGB8 source
+	static float psnr(const CompressedMip& mip, const std::vector<uint8_t>& rgbPixels);
+
+	static size_t blockCount(int width, int height) {
+		return size_t((width + 3) / 4) * size_t((height + 3) / 4);
+	}
+};
@@ -0,0 +1,132 @@
+#include "TextureIO.h"
+
+#include <iostream>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+#include "IO.h"
+#include "MemoryTracker.h"
+#include "Profiler.h"
+#include "TileCache.h"
+#include "TextureCompressor.h"
+
+// Not part of the core profile, exposed by EXT_texture_compression_s3tc
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+bool TextureIO::supportsBC1() {
+	static int supported = -1;
+	if (supported < 0) {
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+		std::vector<GLint> formats(count);
+		if (count > 0) glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats.data());
+		supported = std::find(formats.begin(), formats.end(), GL_COMPRESSED_RGB_S3TC_DXT1_EXT) != formats.end();
+	}
+	return supported == 1;
+}
+
+static unsigned int uploadTexture(int width, int height, const std::vector<GLubyte>& pixels) {
+	PROFILE_SCOPE("TextureIO::uploadTexture");
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	unsigned int textureID;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	// Stored as RGBA8 by the drivers, plus a third for the mips
+	MemoryTracker::trackTexture(textureID, size_t(width) * height * 4 * 4 / 3, MemoryCategory::Textures);
+
+	return textureID;
+}
+
+static unsigned int uploadCompressedTexture(const CompressedTexture& texture) {
+	PROFILE_SCOPE("TextureIO::uploadCompressedTexture");
+	unsigned int textureID;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	for (size_t level = 0; level < texture.mips.size(); level++) {
+		const CompressedMip& mip = texture.mips[level];
+		glCompressedTexImage2D(GL_TEXTURE_2D, GLint(level), GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+							   mip.width, mip.height, 0, GLsizei(mip.data.size()), mip.data.data());
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(texture.mips.size()) - 1);
+	MemoryTracker::trackTexture(textureID, texture.bytes(), MemoryCategory::Textures);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	return textureID;
+}
+
+bool TextureIO::fetchTile(int z, int x, int y, bool compress, TileImage& tile) {
+	PROFILE_SCOPE("TextureIO::fetchTile");
+	MemoryScope memoryScope(MemoryCategory::Textures);
+	tile = TileImage();
+	if (compress) {
+		tile.compressed = IO::tileCache().get(z, x, y);
+		if (tile.compressed) return true;
+	}
+
+	int width, height;
+	std::vector<GLubyte> pixels;
+	if (!IO::fetchTilePNG(z, x, y, width, height, pixels)) {
+		std::cerr << "Failed to fetch tile PNG\n";
+		return false;
+	}
+
+	std::cout << "Fetched tile PNG: " << width << "x" << height << ", tot: " << pixels.size() << "\n";
+
+	if (!compress) {
+		std::cerr << "BC1 textures not supported, uploading uncompressed tile\n";
+		tile.width = width;
+		tile.height = height;
+		tile.pixels = std::move(pixels);
+		return true;
+	}
+
+	CompressionStats stats;
+	std::shared_ptr<CompressedTexture> texture;
+	{
+		PROFILE_SCOPE("TextureIO::encodeBC1");
+		MemoryScope cacheScope(MemoryCategory::TileCache);
+		texture = std::make_shared<CompressedTexture>(TextureCompressor::encodeBC1(width, height, pixels, &stats));
+	}
+	IO::tileCache().put(z, x, y, texture);
+
+	std::cout << "Encoded tile " << z << "/" << x << "/" << y << " to BC1: "
+			  << texture->mips.size() << " mips, " << stats.megapixelsPerSecond << " MPix/s, PSNR "
+			  << stats.psnr << " dB, " << stats.uncompressedBytes << " -> " << stats.compressedBytes
+			  << " bytes (saved " << stats.uncompressedBytes - stats.compressedBytes << ")\n";
+
+	tile.compressed = texture;
+	return true;
+}
+
+unsigned int TextureIO::uploadTile(const TileImage& tile) {
+	MemoryScope memoryScope(MemoryCategory::Textures);
+	if (tile.compressed) return uploadCompressedTexture(*tile.compressed);
+	if (!tile.pixels.empty()) return uploadTexture(tile.width, tile.height, tile.pixels);
+	return 0;
+}
+
+unsigned int TextureIO::fetchTileToTexture(int z, int x, int y) {
+	PROFILE_SCOPE("TextureIO::fetchTileToTexture");
+	TileImage tile;
+	if (!fetchTile(z, x, y, supportsBC1(), tile)) return 0;
+	return uploadTile(tile);
+}
+
+unsigned int TextureIO::solidTexture(const glm::u8vec3& color) {
+	unsigned int textureID;
+	glCreateTextures(GL_TEXTURE_2D, 1, &textureID);
+	glTextureStorage2D(textureID, 1, GL_RGB8, 1, 1);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTextureSubImage2D(textureID, 0, 0, 0, 1, 1, GL_RGB, GL_UNSIGNED_BYTE, &color[0]);
+	MemoryTracker::trackTexture(textureID, 4, MemoryCategory::Textures);
+	return textureID;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+struct CompressedTexture;
+
+// Tile prepared for upload, either BC1 compressed or as RGB8 pixels
+struct TileImage {
+	std::shared_ptr<const CompressedTexture> compressed;
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> pixels;
+
+	bool valid() const { return compressed || !pixels.empty(); }
+};
+
+// Tile textures of the viewer. Only fetchTile() works without a GL context.
+class TextureIO {
+   public:
+	// Fetches a tile and, when compress is set, compresses it to BC1 through the
+	// tile cache. Thread safe, for fetches in the background.
+	static bool fetchTile(int z, int x, int y, bool compress, TileImage& tile);
+	static unsigned int uploadTile(const TileImage& tile);
+	// Fetches a tile, compresses it to BC1 through the tile cache and uploads it
+	static unsigned int fetchTileToTexture(int z, int x, int y);
+
+	// 1x1 texture, e.g. a placeholder until a tile is ready
+	static unsigned int solidTexture(const glm::u8vec3& color);
+	static bool supportsBC1();
+};
@@ -0,0 +1,154 @@
+#include "ThumbnailRenderer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+
+#include <stb_image_write.h>
+
+#include "Error.h"
+#include "MemoryTracker.h"
+#include "Mesh.h"
+#include "TileBaker.h"
+#include "WorldGen.h"
+
+namespace {
+
+const int TextureSize = 256;	// Color tile 0/0/0 of the planet
+const size_t LightArrayOffset = 16;	// int numOfLights, then the std430 array
+
+}  // namespace
+
+ThumbnailRenderer::ThumbnailRenderer(const std::string& shaderFolder, const ThumbnailOptions& options)
+	: _options(options),
+	  _shaders(shaderFolder + "PlanetShader.vert", shaderFolder + "PlanetShader.frag"),
+	  _chunkRenderer(shaderFolder, _meshPool),
+	  _framebuffer(options.size, options.size),
+	  _capture([this](const CapturedFrame& frame) { write(frame); }),
+	  _frameBuffer(GL_UNIFORM_BUFFER, FrameBufferBinding, sizeof(GPUFrame)),
+	  _materialBuffer(GL_UNIFORM_BUFFER, MaterialBufferBinding, sizeof(GPUMaterial)),
+	  _lightBuffer(GL_SHADER_STORAGE_BUFFER, LightBufferBinding) {
+	if (!_framebuffer.init()) exitOnCriticalError("Cannot create the thumbnail framebuffer");
+	std::error_code error;
+	std::filesystem::create_directories(options.outputDirectory, error);
+
+	_lights.push_back(std::make_shared<DirectionalLight>(glm::vec3(1.0f), 4.0f, glm::vec3(0.4f, -0.3f, -0.9f)));
+	_lights.push_back(std::make_shared<DirectionalLight>(glm::vec3(0.4f, 0.5f, 0.7f), 1.0f, glm::vec3(-0.6f, 0.2f, 0.8f)));
+
+	ShaderDefines defines{{"NUM_DIR_LIGHTS", std::to_string(_lights.size())}, {"NUM_POINT_LIGHTS", "0"}};
+	if (_meshPool.format() == VertexFormat::Compact) defines["COMPACT_VERTICES"] = "1";
+	_shader = _shaders.get(defines);
+
+	glCreateTextures(GL_TEXTURE_2D, 1, &_texture);
+	const int levels = 1 + int(std::log2(TextureSize));
+	glTextureStorage2D(_texture, levels, GL_RGB8, TextureSize, TextureSize);
+	MemoryTracker::trackTexture(_texture, size_t(TextureSize) * TextureSize * 4 * 4 / 3, MemoryCategory::Textures);
+	glTextureParameteri(_texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTextureParameteri(_texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	_camera.setAspectRatio(1.0f);
+	_camera.setTranslation(glm::vec3(0.0f, 0.0f, 3.0f));
+	_camera.setNear(0.1f);
+	_camera.setFar(100.0f);
+}
+
+ThumbnailRenderer::~ThumbnailRenderer() {
+	finish();
+	MemoryTracker::releaseTexture(_texture);
+	glDeleteTextures(1, &_texture);
+}
+
+void ThumbnailRenderer::render(int seed) {
+	WorldGen worldGen(seed);
+
+	// Replace the chunks of the previous planet, the pool reuses their ranges
+	for (uint32_t id : _chunks) _chunkRenderer.removeChunk(id);
+	_chunks.clear();
+	const int tiles = 1 << _options.chunkZoom;
+	for (int ty = 0; ty < tiles; ty++) {
+		for (int tx = 0; tx < tiles; tx++) {
+			Mesh chunk;
+			worldGen.generateMercatorPatch(_options.chunkZoom, tx, ty, _options.chunkSubdivisions,
+										   chunk.texCoords(), chunk.positions(), chunk.indices());
+			chunk.recomputePerVertexNormals();
+			_chunks.push_back(_chunkRenderer.addChunk(chunk));
+		}
+	}
+
+	BakeOptions bakeOptions;
+	bakeOptions.tileSize = TextureSize;
+	std::vector<uint8_t> color = TileBaker(worldGen, bakeOptions).renderColor(0, 0, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTextureSubImage2D(_texture, 0, 0, 0, TextureSize, TextureSize, GL_RGB, GL_UNSIGNED_BYTE, color.data());
+	glGenerateTextureMipmap(_texture);
+
+	_framebuffer.bind();
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	const glm::mat4 model(1.0f);
+	const glm::mat4 view = _camera.computeViewMatrix();
+	_chunkRenderer.cull(_camera.computeProjectionMatrix() * view * model, glm::vec3(glm::inverse(view)[3]));
+
+	_shader->use();
+	_shader->set("model", model);
+	_shader->set("normalMatrix", glm::mat3(1.0f));
+	_shader->set("tex_diffuse", 0);
+	_camera.write(_frameBuffer);
+	_material.write(_materialBuffer);
+	_lightBuffer.resize(LightArrayOffset + _lights.size() * sizeof(GPULight));
+	_lightBuffer.write(0, int(_lights.size()));
+	for (size_t i = 0; i < _lights.size(); i++) _lights[i]->write(_lightBuffer, LightArrayOffset + i * sizeof(GPULight));
+	_frameBuffer.flush();
+	_materialBuffer.flush();
+	_lightBuffer.flush();
+
+	glBindTextureUnit(0, _texture);
+	_chunkRenderer.draw();
+
+	_frameBuffer.fence();
+	_materialBuffer.fence();
+	_lightBuffer.fence();
+	_meshPool.endFrame();
+
+	_capture.capture(_framebuffer.id(), _framebuffer.width(), _framebuffer.height(), uint64_t(uint32_t(seed)));
+	_framebuffer.unbind();
+	_capture.poll();
+}
+
+void ThumbnailRenderer::finish() {
+	_capture.finish();
+	for (auto& pending : _writes) pending.get();
+	_writes.clear();
+}
+
+// Copies the pixels and encodes the PNG on another thread
+void ThumbnailRenderer::write(const CapturedFrame& frame) {
+	const size_t stride = size_t(frame.width) * 4;
+	auto pixels = std::make_shared<std::vector<uint8_t>>(frame.rgba, frame.rgba + stride * frame.height);
+	std::string file = _options.outputDirectory + "/planet_" + std::to_string(int32_t(frame.tag)) + ".png";
+
+	// Bounded number of encodes in flight
+	const size_t maxWrites = std::max(1u, std::thread::hardware_concurrency());
+	_writes.erase(std::remove_if(_writes.begin(), _writes.end(),
+								 [](std::future<void>& pending) {
+									 return pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+								 }),
+				  _writes.end());
+	if (_writes.size() >= maxWrites) {
+		_writes.front().get();
+		_writes.erase(_writes.begin());
+	}
+
+	const int width = frame.width, height = frame.height;
+	_writes.push_back(std::async(std::launch::async, [pixels, file, width, height, stride]() {
+		// Rows are bottom-up, write them from the last one with a negative stride
+		const uint8_t* lastRow = pixels->data() + stride * (height - 1);
+		if (!stbi_write_png(file.c_str(), width, height, 4, lastRow, -int(stride)))
+			std::cerr << "Cannot write thumbnail " << file << std::endl;
+	}));
+	_written++;
+}
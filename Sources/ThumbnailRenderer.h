@@ -0,0 +1,68 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Camera.h"
+#include "ChunkRenderer.h"
+#include "Framebuffer.h"
+#include "FrameCapture.h"
+#include "Light.h"
+#include "Material.h"
+#include "MeshPool.h"
+#include "ShaderBuffer.h"
+#include "ShaderVariants.h"
+
+struct ThumbnailOptions {
+	int size = 256;
+	int chunkZoom = 3;			// Chunks of the Mercator tiles at this zoom
+	int chunkSubdivisions = 16;
+	std::string outputDirectory = "Thumbnails";	// Images are written as planet_<seed>.png
+};
+
+// Renders planets offscreen and writes them as PNG, for batches of seeds on
+// machines without a display (see HeadlessContext). Each planet is rendered
+// into a Framebuffer and read back asynchronously by a FrameCapture, so the
+// readback and the PNG encoding overlap the generation of the next planets.
+class ThumbnailRenderer {
+   public:
+	ThumbnailRenderer(const std::string& shaderFolder, const ThumbnailOptions& options);
+	~ThumbnailRenderer();
+
+	// Generates and draws the planet of a seed, its image is written later
+	void render(int seed);
+	// Waits for the pending readbacks and writes
+	void finish();
+
+	size_t written() const { return _written; }
+	size_t captureStalls() const { return _capture.stalls(); }
+
+   private:
+	void write(const CapturedFrame& frame);
+
+	ThumbnailOptions _options;
+	ShaderVariants _shaders;
+	std::shared_ptr<ShaderProgram> _shader;
+	MeshPool _meshPool;
+	ChunkRenderer _chunkRenderer;
+	std::vector<uint32_t> _chunks;
+
+	Framebuffer _framebuffer;
+	FrameCapture _capture;
+	GLuint _texture = 0;
+
+	Camera _camera{};
+	Material _material{glm::vec3(1.0f), 0.8f, 0.5f, glm::vec3(1.0f)};
+	std::vector<std::shared_ptr<AbstractLight>> _lights;
+	ShaderBuffer _frameBuffer;
+	ShaderBuffer _materialBuffer;
+	ShaderBuffer _lightBuffer;
+
+	std::vector<std::future<void>> _writes;
+	size_t _written = 0;
+};
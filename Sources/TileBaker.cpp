@@ -0,0 +1,289 @@
+#include "TileBaker.h"
+
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+
+#include <glm/ext.hpp>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include "MemoryTracker.h"
+#include "Profiler.h"
+#include "ScratchArena.h"
+#include "TaskScheduler.h"
+
+namespace {
+
+const char* layerNames[2] = {"color", "elevation"};
+
+void appendToVector(void* context, void* data, int size) {
+	auto* buffer = static_cast<std::vector<uint8_t>*>(context);
+	auto* bytes = static_cast<uint8_t*>(data);
+	buffer->insert(buffer->end(), bytes, bytes + size);
+}
+
+std::vector<uint8_t> encodePNG(int size, const std::vector<uint8_t>& rgb) {
+	std::vector<uint8_t> png;
+	stbi_write_png_to_func(appendToVector, &png, size, size, 3, rgb.data(), size * 3);
+	return png;
+}
+
+// Mapbox Terrain-RGB: height = -10000 + (R * 256 * 256 + G * 256 + B) * 0.1
+std::vector<uint8_t> encodeTerrainRGB(const std::vector<float>& elevation) {
+	std::vector<uint8_t> rgb(elevation.size() * 3);
+	for (size_t i = 0; i < elevation.size(); i++) {
+		double scaled = std::round((double(elevation[i]) + 10000.0) * 10.0);
+		uint32_t v = uint32_t(std::clamp(scaled, 0.0, double(0xFFFFFF)));
+		rgb[i * 3 + 0] = uint8_t(v >> 16);
+		rgb[i * 3 + 1] = uint8_t(v >> 8);
+		rgb[i * 3 + 2] = uint8_t(v);
+	}
+	return rgb;
+}
+
+}  // namespace
+
+std::string DirectoryTileSink::path(TileLayer layer, int z, int x, int y) const {
+	return (std::filesystem::path(_root) / layerNames[int(layer)] / std::to_string(z) /
+			std::to_string(x) / (std::to_string(y) + ".png")).string();
+}
+
+bool DirectoryTileSink::write(TileLayer layer, int z, int x, int y, const std::vector<uint8_t>& png) {
+	std::filesystem::path file = path(layer, z, x, y);
+	std::error_code error;
+	std::filesystem::create_directories(file.parent_path(), error);
+	// Write then rename so that concurrent readers never see a partial tile
+	std::filesystem::path temp = file;
+	temp += ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+	{
+		std::ofstream out(temp, std::ios::binary);
+		if (!out) {
+			std::cerr << "Cannot write tile " << z << "/" << x << "/" << y << " to " << file << std::endl;
+			return false;
+		}
+		out.write(reinterpret_cast<const char*>(png.data()), std::streamsize(png.size()));
+		if (!out) return false;
+	}
+	std::filesystem::rename(temp, file, error);
+	return !error;
+}
+
+ArchiveTileSink::ArchiveTileSink(const std::string& filename)
+	: _out(filename.c_str(), std::ios::binary) {
+	if (!_out) {
+		std::cerr << "Cannot open archive " << filename << std::endl;
+		return;
+	}
+	const uint32_t version = 1, reserved = 0;
+	_out.write("PGTILES1", 8);
+	_out.write(reinterpret_cast<const char*>(&version), 4);
+	_out.write(reinterpret_cast<const char*>(&reserved), 4);
+	_offset = 16;
+}
+
+ArchiveTileSink::~ArchiveTileSink() { finish(); }
+
+bool ArchiveTileSink::write(TileLayer layer, int z, int x, int y, const std::vector<uint8_t>& png) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (!_out || _finished) return false;
+	_out.write(reinterpret_cast<const char*>(png.data()), std::streamsize(png.size()));
+	_index.push_back({uint8_t(layer), uint8_t(z), 0, uint32_t(x), uint32_t(y), _offset, uint32_t(png.size())});
+	_offset += png.size();
+	return bool(_out);
+}
+
+void ArchiveTileSink::finish() {
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (!_out || _finished) return;
+	_finished = true;
+	const uint32_t count = uint32_t(_index.size());
+	const uint64_t indexOffset = _offset;
+	_out.write(reinterpret_cast<const char*>(&count), 4);
+	_out.write(reinterpret_cast<const char*>(_index.data()), std::streamsize(_index.size() * sizeof(Entry)));
+	_out.write(reinterpret_cast<const char*>(&indexOffset), 8);
+	_out.write("PGTILEND", 8);
+	_out.close();
+}
+
+size_t TileBaker::tileBytes() const {
+	const size_t pixels = size_t(_options.tileSize) * _options.tileSize;
+	return pixels * (3 + sizeof(float));
+}
+
+void TileBaker::trackBytes(long long delta) {
+	long long live = _liveBytes.fetch_add(delta) + delta;
+	long long peak = _peakBytes.load();
+	while (live > peak && !_peakBytes.compare_exchange_weak(peak, live)) {
+	}
+}
+
+TileBaker::Tile TileBaker::generateTile(int z, int x, int y) {
+	PROFILE_SCOPE("TileBaker::generateTile");
+	MemoryScope memoryScope(MemoryCategory::Baking);
+	const int size = _options.tileSize;
+	const int grid = size + 2;	// One texel border for the normals
+	const float n = float(1 << z);
+
+	// Longitude only depends on the column and latitude on the row
+	ScratchScope scratch;
+	float* cosLon = scratch.allocate<float>(grid);
+	float* sinLon = scratch.allocate<float>(grid);
+	float* cosLat = scratch.allocate<float>(grid);
+	float* sinLat = scratch.allocate<float>(grid);
+	for (int i = 0; i < grid; i++) {
+		float t = (i - 0.5f) / float(size);
+		float lon = glm::two_pi<float>() * (x + t) / n - glm::pi<float>();
+		float lat = std::atan(std::sinh(glm::pi<float>() * (1.0f - 2.0f * (y + t) / n)));
+		cosLon[i] = std::cos(lon);
+		sinLon[i] = std::sin(lon);
+		cosLat[i] = std::cos(lat);
+		sinLat[i] = std::sin(lat);
+	}
+
+	const size_t count = size_t(grid) * grid;
+	float* xs = scratch.allocate<float>(count);
+	float* ys = scratch.allocate<float>(count);
+	float* zs = scratch.allocate<float>(count);
+	float* heights = scratch.allocate<float>(count);
+	for (int j = 0; j < grid; j++) {
+		for (int i = 0; i < grid; i++) {
+			size_t k = size_t(j) * grid + i;
+			xs[k] = cosLat[j] * cosLon[i];
+			ys[k] = sinLat[j];
+			zs[k] = cosLat[j] * sinLon[i];
+		}
+	}
+	_worldGen.getHeights(xs, ys, zs, int(count), heights);
+
+	auto position = [&](int i, int j) {
+		size_t k = size_t(j) * grid + i;
+		return glm::vec3(xs[k], ys[k], zs[k]) * heights[k];
+	};
+
+	Tile tile;
+	tile.rgb.resize(size_t(size) * size * 3);
+	tile.elevation.resize(size_t(size) * size);
+	for (int j = 1; j <= size; j++) {
+		for (int i = 1; i <= size; i++) {
+			glm::vec3 p = position(i, j);
+			glm::vec3 normal = glm::cross(position(i + 1, j) - position(i - 1, j),
+										  position(i, j + 1) - position(i, j - 1));
+			float len = glm::length(normal);
+			normal = len > 0.0f ? normal / len : glm::normalize(p);
+
+			glm::vec3 color = _worldGen.getBiomeColor(p, normal);
+			size_t out = size_t(j - 1) * size + (i - 1);
+			for (int c = 0; c < 3; c++)
+				tile.rgb[out * 3 + c] = uint8_t(glm::clamp(color[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+			tile.elevation[out] = (heights[size_t(j) * grid + i] - 1.0f) * _options.metersPerUnit;
+		}
+	}
+	trackBytes(tileBytes());
+	return tile;
+}
+
+// children: top-left, top-right, bottom-left, bottom-right
+TileBaker::Tile TileBaker::downsampleTile(const Tile children[4]) {
+	PROFILE_SCOPE("TileBaker::downsampleTile");
+	MemoryScope memoryScope(MemoryCategory::Baking);
+	const int size = _options.tileSize;
+	const int half = size / 2;
+	Tile tile;
+	tile.rgb.resize(size_t(size) * size * 3);
+	tile.elevation.resize(size_t(size) * size);
+	for (int c = 0; c < 4; c++) {
+		const Tile& child = children[c];
+		const int ox = (c & 1) * half, oy = (c >> 1) * half;
+		for (int j = 0; j < half; j++) {
+			for (int i = 0; i < half; i++) {
+				size_t s00 = size_t(2 * j) * size + 2 * i, s01 = s00 + 1;
+				size_t s10 = s00 + size, s11 = s10 + 1;
+				size_t out = size_t(oy + j) * size + (ox + i);
+				for (int k = 0; k < 3; k++) {
+					int sum = child.rgb[s00 * 3 + k] + child.rgb[s01 * 3 + k] +
+							  child.rgb[s10 * 3 + k] + child.rgb[s11 * 3 + k];
+					tile.rgb[out * 3 + k] = uint8_t((sum + 2) / 4);
+				}
+				tile.elevation[out] = 0.25f * (child.elevation[s00] + child.elevation[s01] +
+											   child.elevation[s10] + child.elevation[s11]);
+			}
+		}
+	}
+	trackBytes(tileBytes());
+	return tile;
+}
+
+void TileBaker::writeTile(TileSink& sink, int z, int x, int y, const Tile& tile) {
+	PROFILE_SCOPE("TileBaker::writeTile");
+	MemoryScope memoryScope(MemoryCategory::Baking);
+	const int size = _options.tileSize;
+	if (_options.color) sink.write(TileLayer::Color, z, x, y, encodePNG(size, tile.rgb));
+	if (_options.elevation)
+		sink.write(TileLayer::Elevation, z, x, y, encodePNG(size, encodeTerrainRGB(tile.elevation)));
+	_tileCount++;
+}
+
+std::vector<uint8_t> TileBaker::renderTile(TileLayer layer, int z, int x, int y) {
+	Tile tile = generateTile(z, x, y);
+	trackBytes(-(long long)tileBytes());
+	if (layer == TileLayer::Elevation)
+		return encodePNG(_options.tileSize, encodeTerrainRGB(tile.elevation));
+	return encodePNG(_options.tileSize, tile.rgb);
+}
+
+std::vector<uint8_t> TileBaker::renderColor(int z, int x, int y) {
+	Tile tile = generateTile(z, x, y);
+	trackBytes(-(long long)tileBytes());
+	return std::move(tile.rgb);
+}
+
+TileBaker::Tile TileBaker::bakeTile(int z, int x, int y) {
+	Tile tile;
+	if (z == _options.maxZoom) {
+		tile = generateTile(z, x, y);
+	} else {
+		Tile children[4];
+		TaskScheduler& scheduler = TaskScheduler::instance();
+		TaskGroup group;
+		for (int c = 0; c < 4; c++)
+			scheduler.run(group, [&, c] { children[c] = bakeTile(z + 1, 2 * x + (c & 1), 2 * y + (c >> 1)); });
+		scheduler.wait(group);
+		tile = downsampleTile(children);
+		trackBytes(-4 * (long long)tileBytes());
+	}
+	if (z >= _options.minZoom) writeTile(*_sink, z, x, y, tile);
+	return tile;
+}
+
+BakeStats TileBaker::bake(TileSink& sink) {
+	auto start = std::chrono::high_resolution_clock::now();
+	_sink = &sink;
+	_tileCount = 0;
+	_liveBytes = 0;
+	_peakBytes = 0;
+
+	const int n = 1 << _options.minZoom;
+	TaskScheduler& scheduler = TaskScheduler::instance();
+	TaskGroup group;
+	for (int y = 0; y < n; y++) {
+		for (int x = 0; x < n; x++) {
+			scheduler.run(group, [this, x, y] {
+				bakeTile(_options.minZoom, x, y);
+				trackBytes(-(long long)tileBytes());
+			});
+		}
+	}
+	scheduler.wait(group);
+
+	BakeStats stats;
+	stats.tiles = _tileCount;
+	stats.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	stats.tilesPerSecond = stats.seconds > 0.0 ? stats.tiles / stats.seconds : 0.0;
+	stats.peakBytes = size_t(_peakBytes.load());
+	return stats;
+}
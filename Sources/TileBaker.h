@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "WorldGen.h"
+
+enum class TileLayer : uint8_t { Color = 0, Elevation = 1 };
+
+// Destination of baked, PNG-encoded tiles. Implementations must accept
+// concurrent writes.
+class TileSink {
+   public:
+	virtual ~TileSink() {}
+	virtual bool write(TileLayer layer, int z, int x, int y, const std::vector<uint8_t>& png) = 0;
+};
+
+// Standard <root>/<layer>/<z>/<x>/<y>.png tree
+class DirectoryTileSink : public TileSink {
+   public:
+	DirectoryTileSink(const std::string& root) : _root(root) {}
+	bool write(TileLayer layer, int z, int x, int y, const std::vector<uint8_t>& png) override;
+
+	std::string path(TileLayer layer, int z, int x, int y) const;
+
+   private:
+	std::string _root;
+};
+
+// Single-file archive: a 16-byte header, the PNG blobs back to back, an index
+// of (layer, z, x, y, offset, size) entries and a footer pointing to the index.
+// All integers are little-endian.
+class ArchiveTileSink : public TileSink {
+   public:
+	ArchiveTileSink(const std::string& filename);
+	~ArchiveTileSink();
+	bool write(TileLayer layer, int z, int x, int y, const std::vector<uint8_t>& png) override;
+
+	// Writes the index and footer, called by the destructor if needed
+	void finish();
+
+   private:
+#pragma pack(push, 1)
+	struct Entry {
+		uint8_t layer;
+		uint8_t z;
+		uint16_t reserved;
+		uint32_t x;
+		uint32_t y;
+		uint64_t offset;
+		uint32_t size;
+	};
+#pragma pack(pop)
+
+	std::mutex _mutex;
+	std::ofstream _out;
+	std::vector<Entry> _index;
+	uint64_t _offset = 0;
+	bool _finished = false;
+};
+
+struct BakeOptions {
+	int minZoom = 0;
+	int maxZoom = 4;
+	int tileSize = 256;
+	bool color = true;
+	bool elevation = true;
+	// Elevation in meters of one unit of radius above the sea level
+	float metersPerUnit = 20000.0f;
+};
+
+struct BakeStats {
+	size_t tiles = 0;
+	double seconds = 0.0;
+	double tilesPerSecond = 0.0;
+	size_t peakBytes = 0;	// High-water mark of tile data held in memory
+};
+
+// Bakes a z/x/y raster pyramid of a WorldGen planet. Only the finest level is
+// evaluated, coarser levels are box-filtered from their four children.
+class TileBaker {
+   public:
+	TileBaker(const WorldGen& worldGen, const BakeOptions& options)
+		: _worldGen(worldGen), _options(options) {}
+
+	BakeStats bake(TileSink& sink);
+
+	// Generates a single tile of one layer at zoom z and returns it as PNG
+	std::vector<uint8_t> renderTile(TileLayer layer, int z, int x, int y);
+	// Generates the raw RGB pixels of a color tile
+	std::vector<uint8_t> renderColor(int z, int x, int y);
+
+   private:
+	struct Tile {
+		std::vector<uint8_t> rgb;
+		std::vector<float> elevation;	// Meters
+	};
+
+	Tile bakeTile(int z, int x, int y);
+	Tile generateTile(int z, int x, int y);
+	Tile downsampleTile(const Tile children[4]);
+	void writeTile(TileSink& sink, int z, int x, int y, const Tile& tile);
+
+	void trackBytes(long long delta);
+	size_t tileBytes() const;
+
+	const WorldGen& _worldGen;
+	BakeOptions _options;
+
+	std::atomic<size_t> _tileCount{0};
+	std::atomic<long long> _liveBytes{0};
+	std::atomic<long long> _peakBytes{0};
+	TileSink* _sink = nullptr;
+};
@@ -0,0 +1,59 @@
+#include "TileCache.h"
+
+std::shared_ptr<const CompressedTexture> TileCache::get(int z, int x, int y) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto it = _index.find(key(z, x, y));
+	if (it == _index.end()) return nullptr;
+	_lru.splice(_lru.begin(), _lru, it->second);
+	return it->second->second;
+}
+
+void TileCache::put(int z, int x, int y, std::shared_ptr<const CompressedTexture> texture) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	const uint64_t k = key(z, x, y);
+	auto it = _index.find(k);
+	if (it != _index.end()) {
+		_bytes -= it->second->second->bytes();
+		_lru.erase(it->second);
+	}
+	_bytes += texture->bytes();
+	_lru.emplace_front(k, std::move(texture));
+	_index[k] = _lru.begin();
+	evict();
+}
+
+void TileCache::clear() {
+	std::lock_guard<std::mutex> lock(_mutex);
+	_lru.clear();
+	_index.clear();
+	_bytes = 0;
+}
+
+void TileCache::setBudget(size_t budget) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	_budget = budget;
+	evict();
+}
+
+size_t TileCache::budget() const {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _budget;
+}
+
+size_t TileCache::size() const {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _index.size();
+}
+
+size_t TileCache::bytes() const {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _bytes;
+}
+
+void TileCache::evict() {
+	while (_bytes > _budget && _lru.size() > 1) {
+		_bytes -= _lru.back().second->bytes();
+		_index.erase(_lru.back().first);
+		_lru.pop_back();
+	}
+}
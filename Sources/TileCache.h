@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "TextureCompressor.h"
+
+// In-memory cache of compressed slippy tiles, keyed by z/x/y. The least
+// recently used tiles are evicted once the cache is over its byte budget.
+class TileCache {
+   public:
+	explicit TileCache(size_t budget = size_t(64) << 20) : _budget(budget) {}
+
+	std::shared_ptr<const CompressedTexture> get(int z, int x, int y);
+	void put(int z, int x, int y, std::shared_ptr<const CompressedTexture> texture);
+	void clear();
+
+	void setBudget(size_t budget);
+	size_t budget() const;
+
+	size_t size() const;
+	size_t bytes() const;
+
+   private:
+	using Entry = std::pair<uint64_t, std::shared_ptr<const CompressedTexture>>;
+
+	static uint64_t key(int z, int x, int y) {
+		return (uint64_t(z) << 58) | (uint64_t(uint32_t(x)) << 29) | uint64_t(uint32_t(y));
+	}
+
+	// Drops tiles from the back of the LRU, keeping at least the most recent one
+	void evict();
+
+	mutable std::mutex _mutex;
+	std::list<Entry> _lru;	// Most recently used first
+	std::unordered_map<uint64_t, std::list<Entry>::iterator> _index;
+	size_t _bytes = 0;
+	size_t _budget;
+};
@@ -0,0 +1,362 @@
+#include "TileServer.h"
+
+#include "MemoryTracker.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <utility>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#define closeSocket closesocket
+#define pollSockets WSAPoll
+#define SEND_FLAGS 0
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define closeSocket close
+#define pollSockets poll
+#define SEND_FLAGS MSG_NOSIGNAL
+#endif
+
+namespace {
+
+// Keep-alive connections idle for longer are closed
+const std::chrono::seconds IdleTimeout(5);
+
+bool sendAll(intptr_t client, const char* data, size_t size) {
+	while (size > 0) {
+		auto sent = send(client, data, int(size), SEND_FLAGS);
+		if (sent <= 0) return false;
+		data += sent;
+		size -= size_t(sent);
+	}
+	return true;
+}
+
+bool sendResponse(intptr_t client, const char* status, const std::string& headers,
+				  const std::vector<uint8_t>* body) {
+	std::string head = std::string("HTTP/1.1 ") + status + "\r\n" + headers +
+					   "Content-Length: " + std::to_string(body ? body->size() : 0) +
+					   "\r\nConnection: keep-alive\r\n\r\n";
+	if (!sendAll(client, head.data(), head.size())) return false;
+	return !body || sendAll(client, reinterpret_cast<const char*>(body->data()), body->size());
+}
+
+// Value of a header, matched case-insensitively, or an empty string
+std::string headerValue(const std::string& request, const std::string& name) {
+	std::istringstream lines(request);
+	std::string line;
+	while (std::getline(lines, line)) {
+		if (line.size() <= name.size() || line[name.size()] != ':') continue;
+		bool match = true;
+		for (size_t i = 0; i < name.size() && match; i++)
+			match = std::tolower(line[i]) == std::tolower(name[i]);
+		if (!match) continue;
+		size_t begin = line.find_first_not_of(" \t", name.size() + 1);
+		size_t end = line.find_last_not_of(" \t\r");
+		return begin == std::string::npos ? "" : line.substr(begin, end - begin + 1);
+	}
+	return "";
+}
+
+}  // namespace
+
+TileServer::TileServer(const WorldGen& worldGen, const TileServerOptions& options)
+	: _worldGen(worldGen), _options(options), _baker(worldGen, BakeOptions()),
+	  _diskCache(options.cacheDirectory + "/" + std::to_string(worldGen.seed())) {}
+
+TileServer::~TileServer() {
+	stop();
+	if (_wakeSocket >= 0) closeSocket(_wakeSocket);
+}
+
+bool TileServer::start() {
+#ifdef _WIN32
+	WSADATA wsaData;
+	WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+	_listenSocket = intptr_t(socket(AF_INET, SOCK_STREAM, 0));
+	if (_listenSocket < 0) {
+		std::cerr << "[Tile Server] Cannot create socket" << std::endl;
+		return false;
+	}
+	int reuse = 1;
+	setsockopt(_listenSocket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(uint16_t(_options.port));
+	if (bind(_listenSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+		listen(_listenSocket, 128) < 0) {
+		std::cerr << "[Tile Server] Cannot listen on port " << _options.port << std::endl;
+		closeSocket(_listenSocket);
+		_listenSocket = -1;
+		return false;
+	}
+
+	// Datagrams to itself make run() return from poll() when a connection is released or at stop
+	_wakeSocket = intptr_t(socket(AF_INET, SOCK_DGRAM, 0));
+	sockaddr_in wakeAddress{};
+	wakeAddress.sin_family = AF_INET;
+	wakeAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t wakeLength = sizeof(wakeAddress);
+	if (_wakeSocket < 0 || bind(_wakeSocket, reinterpret_cast<sockaddr*>(&wakeAddress), sizeof(wakeAddress)) < 0 ||
+		getsockname(_wakeSocket, reinterpret_cast<sockaddr*>(&wakeAddress), &wakeLength) < 0 ||
+		connect(_wakeSocket, reinterpret_cast<sockaddr*>(&wakeAddress), wakeLength) < 0) {
+		std::cerr << "[Tile Server] Cannot create the wake-up socket" << std::endl;
+		if (_wakeSocket >= 0) closeSocket(_wakeSocket);
+		closeSocket(_listenSocket);
+		_wakeSocket = _listenSocket = -1;
+		return false;
+	}
+
+	_running = true;
+	int workers = _options.workers > 0 ? _options.workers : int(std::max(1u, std::thread::hardware_concurrency()));
+	for (int i = 0; i < workers; i++) _workers.emplace_back(&TileServer::workerLoop, this);
+
+	std::cout << "[Tile Server] Serving seed " << _worldGen.seed() << " on http://localhost:"
+			  << _options.port << "/{z}/{x}/{y}.png with " << workers << " workers, disk cache in "
+			  << _options.cacheDirectory << std::endl;
+	return true;
+}
+
+void TileServer::run() {
+	using PollSocket = decltype(pollfd::fd);
+	std::vector<Connection> idle, waiting;
+	std::vector<pollfd> fds;
+	while (_running) {
+		{
+			std::lock_guard<std::mutex> lock(_queueMutex);
+			for (Connection& connection : _released) idle.push_back(std::move(connection));
+			_released.clear();
+		}
+
+		fds.clear();
+		fds.push_back({PollSocket(_listenSocket), POLLIN, 0});
+		fds.push_back({PollSocket(_wakeSocket), POLLIN, 0});
+		for (const Connection& connection : idle) fds.push_back({PollSocket(connection.socket), POLLIN, 0});
+		if (pollSockets(fds.data(), decltype(fds.size())(fds.size()), 1000) < 0) continue;
+		if (!_running) break;
+		if (fds[1].revents & POLLIN) {
+			char byte;
+			recv(_wakeSocket, &byte, 1, 0);
+		}
+
+		// Readable or closed connections go to the workers, expired ones are closed
+		const auto now = std::chrono::steady_clock::now();
+		bool dispatched = false;
+		waiting.clear();
+		{
+			std::lock_guard<std::mutex> lock(_queueMutex);
+			for (size_t i = 0; i < idle.size(); i++) {
+				if (fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR | POLLNVAL)) {
+					_ready.push(std::move(idle[i]));
+					dispatched = true;
+				} else if (now - idle[i].lastActive > IdleTimeout) {
+					closeSocket(idle[i].socket);
+				} else {
+					waiting.push_back(std::move(idle[i]));
+				}
+			}
+		}
+		idle.swap(waiting);
+		if (dispatched) _queueCondition.notify_all();
+
+		if (fds[0].revents & POLLIN) {
+			intptr_t client = intptr_t(accept(_listenSocket, nullptr, nullptr));
+			if (client < 0) continue;
+			int noDelay = 1;
+			setsockopt(client, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+			Connection connection;
+			connection.socket = client;
+			connection.lastActive = now;
+			idle.push_back(std::move(connection));
+		}
+	}
+	for (Connection& connection : idle) closeSocket(connection.socket);
+}
+
+void TileServer::stop() {
+	if (!_running.exchange(false)) return;
+	shutdown(_listenSocket, 2);	// Unblocks accept()
+	closeSocket(_listenSocket);
+	wake();
+	_queueCondition.notify_all();
+	for (auto& worker : _workers) worker.join();
+	_workers.clear();
+
+	// Connections still waiting for a worker or for the poll set
+	std::lock_guard<std::mutex> lock(_queueMutex);
+	for (; !_ready.empty(); _ready.pop()) closeSocket(_ready.front().socket);
+	for (Connection& connection : _released) closeSocket(connection.socket);
+	_released.clear();
+}
+
+void TileServer::workerLoop() {
+	while (true) {
+		Connection connection;
+		{
+			std::unique_lock<std::mutex> lock(_queueMutex);
+			_queueCondition.wait(lock, [this] { return !_ready.empty() || !_running; });
+			if (!_running) return;
+			connection = std::move(_ready.front());
+			_ready.pop();
+		}
+		if (serveRequest(connection))
+			release(std::move(connection));
+		else
+			closeSocket(connection.socket);
+	}
+}
+
+bool TileServer::serveRequest(Connection& connection) {
+	size_t end = connection.buffer.find("\r\n\r\n");
+	if (end == std::string::npos) {
+		// poll() reported the socket readable, so this does not block
+		char chunk[4096];
+		auto received = recv(connection.socket, chunk, sizeof(chunk), 0);
+		if (received <= 0) return false;
+		connection.buffer.append(chunk, size_t(received));
+		end = connection.buffer.find("\r\n\r\n");
+		// Partial request, the rest is waited for in the poll set
+		if (end == std::string::npos) return connection.buffer.size() <= 16384;
+	}
+	std::string request = connection.buffer.substr(0, end + 2);
+	connection.buffer.erase(0, end + 4);
+	return handleRequest(connection.socket, request);
+}
+
+void TileServer::release(Connection connection) {
+	connection.lastActive = std::chrono::steady_clock::now();
+	// A pipelined request already in the buffer would never make the socket readable
+	const bool pipelined = connection.buffer.find("\r\n\r\n") != std::string::npos;
+	{
+		std::lock_guard<std::mutex> lock(_queueMutex);
+		if (pipelined)
+			_ready.push(std::move(connection));
+		else
+			_released.push_back(std::move(connection));
+	}
+	if (pipelined)
+		_queueCondition.notify_one();
+	else
+		wake();
+}
+
+void TileServer::wake() {
+	char byte = 0;
+	send(_wakeSocket, &byte, 1, 0);
+}
+
+bool TileServer::handleRequest(intptr_t client, const std::string& request) {
+	_stats.requests++;
+
+	char method[8] = {0}, target[256] = {0};
+	if (std::sscanf(request.c_str(), "%7s %255s", method, target) != 2) {
+		sendResponse(client, "400 Bad Request", "", nullptr);
+		return false;
+	}
+	if (std::strcmp(method, "GET") != 0)
+		return sendResponse(client, "405 Method Not Allowed", "Allow: GET\r\n", nullptr);
+
+	TileLayer layer = TileLayer::Color;
+	const char* path = target;
+	if (std::strncmp(path, "/color/", 7) == 0) {
+		path += 6;
+	} else if (std::strncmp(path, "/elevation/", 11) == 0) {
+		layer = TileLayer::Elevation;
+		path += 10;
+	}
+	int z, x, y;
+	char extension[8] = {0};
+	if (std::sscanf(path, "/%d/%d/%d.%7s", &z, &x, &y, extension) != 4 ||
+		std::strcmp(extension, "png") != 0 || z < 0 || z > 24 || x < 0 || y < 0 ||
+		x >= (1 << z) || y >= (1 << z))
+		return sendResponse(client, "404 Not Found", "", nullptr);
+
+	std::string tag = etag(layer, z, x, y);
+	std::string headers = "ETag: " + tag + "\r\nCache-Control: public, max-age=86400\r\n";
+	if (headerValue(request, "If-None-Match") == tag) {
+		_stats.notModified++;
+		return sendResponse(client, "304 Not Modified", headers, nullptr);
+	}
+
+	Tile tile = getTile(layer, z, x, y);
+	return sendResponse(client, "200 OK", headers + "Content-Type: image/png\r\n", tile.get());
+}
+
+TileServer::Tile TileServer::getTile(TileLayer layer, int z, int x, int y) {
+	MemoryScope memoryScope(MemoryCategory::TileCache);
+	const uint64_t k = key(layer, z, x, y);
+	if (Tile tile = lruGet(k)) {
+		_stats.memoryHits++;
+		return tile;
+	}
+
+	std::string file = _diskCache.path(layer, z, x, y);
+	std::ifstream in(file, std::ios::binary);
+	if (in) {
+		auto png = std::make_shared<std::vector<uint8_t>>(std::istreambuf_iterator<char>(in),
+														  std::istreambuf_iterator<char>());
+		if (!png->empty()) {
+			_stats.diskHits++;
+			lruPut(k, png);
+			return png;
+		}
+	}
+
+	auto png = std::make_shared<const std::vector<uint8_t>>(_baker.renderTile(layer, z, x, y));
+	_stats.generated++;
+	_diskCache.write(layer, z, x, y, *png);
+	lruPut(k, png);
+	return png;
+}
+
+TileServer::Tile TileServer::lruGet(uint64_t key) {
+	std::lock_guard<std::mutex> lock(_lruMutex);
+	auto it = _lruIndex.find(key);
+	if (it == _lruIndex.end()) return nullptr;
+	_lru.splice(_lru.begin(), _lru, it->second);
+	return it->second->second;
+}
+
+void TileServer::lruPut(uint64_t key, Tile tile) {
+	std::lock_guard<std::mutex> lock(_lruMutex);
+	if (_lruIndex.count(key)) return;
+	_lruBytes += tile->size();
+	_lru.emplace_front(key, std::move(tile));
+	_lruIndex[key] = _lru.begin();
+	while (_lruBytes > _options.memoryBudget && _lru.size() > 1) {
+		_lruBytes -= _lru.back().second->size();
+		_lruIndex.erase(_lru.back().first);
+		_lru.pop_back();
+	}
+}
+
+// FNV-1a of the generator version, the seed and the tile coordinates
+std::string TileServer::etag(TileLayer layer, int z, int x, int y) const {
+	const int32_t generatorVersion = 1;	// Bump when the generated tiles change
+	const int32_t fields[6] = {generatorVersion, _worldGen.seed(), int32_t(layer), z, x, y};
+	uint64_t hash = 14695981039346656037ull;
+	for (int32_t field : fields) {
+		for (int b = 0; b < 4; b++) {
+			hash ^= uint8_t(uint32_t(field) >> (8 * b));
+			hash *= 1099511628211ull;
+		}
+	}
+	char tag[24];
+	std::snprintf(tag, sizeof(tag), "\"%016llx\"", (unsigned long long)hash);
+	return tag;
+}
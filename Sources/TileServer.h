@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "TileBaker.h"
+
+struct TileServerOptions {
+	int port = 8080;
+	int workers = 0;	// 0: one per hardware thread
+	std::string cacheDirectory = "TileCache";	// Tiles go in <cacheDirectory>/<seed>/
+	size_t memoryBudget = size_t(256) << 20;	// Hot LRU size in bytes
+};
+
+// Minimal HTTP/1.1 server on localhost generating tiles on demand.
+// Routes: GET /[color|elevation]/<z>/<x>/<y>.png, color being the default.
+// Tiles are looked up in a hot in-memory LRU, then in the on-disk cache, and
+// generated last. Tiles are deterministic for a seed, so ETags are derived
+// from the request and If-None-Match is answered with 304 without any work.
+// Idle keep-alive connections wait in run()'s poll set, and a worker only
+// takes a connection to serve the one request that made it readable.
+class TileServer {
+   public:
+	TileServer(const WorldGen& worldGen, const TileServerOptions& options);
+	~TileServer();
+
+	// Binds the socket and spawns the workers
+	bool start();
+	// Accepts connections and dispatches readable ones until stop() is called
+	void run();
+	void stop();
+
+	struct Stats {
+		std::atomic<size_t> requests{0};
+		std::atomic<size_t> notModified{0};
+		std::atomic<size_t> memoryHits{0};
+		std::atomic<size_t> diskHits{0};
+		std::atomic<size_t> generated{0};
+	};
+	const Stats& stats() const { return _stats; }
+
+   private:
+	using Tile = std::shared_ptr<const std::vector<uint8_t>>;
+
+	// Keep-alive connection, with the bytes received past its last request
+	struct Connection {
+		intptr_t socket = -1;
+		std::string buffer;
+		std::chrono::steady_clock::time_point lastActive;
+	};
+
+	void workerLoop();
+	// Serves at most one request, false when the connection must be closed
+	bool serveRequest(Connection& connection);
+	bool handleRequest(intptr_t client, const std::string& request);
+	// Gives a connection back to the poll set of run()
+	void release(Connection connection);
+	void wake();
+
+	Tile getTile(TileLayer layer, int z, int x, int y);
+	Tile lruGet(uint64_t key);
+	void lruPut(uint64_t key, Tile tile);
+	std::string etag(TileLayer layer, int z, int x, int y) const;
+
+	static uint64_t key(TileLayer layer, int z, int x, int y) {
+		return (uint64_t(layer) << 63) | (uint64_t(z) << 58) | (uint64_t(uint32_t(x)) << 29) |
+			   uint64_t(uint32_t(y));
+	}
+
+	const WorldGen& _worldGen;
+	TileServerOptions _options;
+	TileBaker _baker;
+	DirectoryTileSink _diskCache;
+
+	intptr_t _listenSocket = -1;
+	intptr_t _wakeSocket = -1;	// Loopback UDP socket connected to itself, interrupts poll()
+	std::atomic<bool> _running{false};
+	std::vector<std::thread> _workers;
+
+	// Connections with a request to serve, taken by the workers
+	std::mutex _queueMutex;
+	std::condition_variable _queueCondition;
+	std::queue<Connection> _ready;
+	// Connections served by a worker, waiting to re-enter the poll set
+	std::vector<Connection> _released;
+
+	// LRU: most recently used at the front
+	std::mutex _lruMutex;
+	std::list<std::pair<uint64_t, Tile>> _lru;
+	std::unordered_map<uint64_t, std::list<std::pair<uint64_t, Tile>>::iterator> _lruIndex;
+	size_t _lruBytes = 0;
+
+	Stats _stats;
+};
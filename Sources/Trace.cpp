@@ -0,0 +1,58 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+std::string escapeJSON(const std::string& text) {
+	std::string escaped;
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+			escaped += c;
+		} else if (uint8_t(c) < 0x20) {
+			char code[8];
+			std::snprintf(code, sizeof(code), "\\u%04x", c);
+			escaped += code;
+		} else {
+			escaped += c;
+		}
+	}
+	return escaped;
+}
+
+}  // namespace
+
+bool writeChromeTrace(const std::string& filename, const std::vector<TraceEvent>& events,
+					  const std::map<uint32_t, std::string>& threadNames) {
+	std::ofstream out(filename);
+	if (!out) {
+		std::cerr << "Cannot write trace " << filename << std::endl;
+		return false;
+	}
+	uint64_t origin = events.empty() ? 0 : events.front().startNs;
+	for (const TraceEvent& event : events) origin = std::min(origin, event.startNs);
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	for (const auto& thread : threadNames) {
+		out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread.first
+			<< ",\"args\":{\"name\":\"" << escapeJSON(thread.second) << "\"}}";
+		first = false;
+	}
+	char times[64];
+	for (const TraceEvent& event : events) {
+		// Microseconds with nanosecond precision
+		std::snprintf(times, sizeof(times), "\"ts\":%.3f,\"dur\":%.3f", (event.startNs - origin) / 1000.0,
+					  event.durationNs / 1000.0);
+		out << (first ? "" : ",\n") << "{\"name\":\"" << escapeJSON(event.name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+			<< event.thread << "," << times << "}";
+		first = false;
+	}
+	out << "\n]}\n";
+	std::cout << "Wrote " << events.size() << " trace events to " << filename << std::endl;
+	return bool(out);
+}
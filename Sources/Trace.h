@@ -0,0 +1,27 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Complete event of a Chrome trace (chrome://tracing, Perfetto), the format
+// shared by the CPU and GPU profilers so that their captures can be merged
+struct TraceEvent {
+	std::string name;
+	uint64_t startNs;		// On the steady clock, see traceClockNs()
+	uint64_t durationNs;
+	uint32_t thread;		// Track of the event
+};
+
+// Nanoseconds of std::chrono::steady_clock, the time base of every trace
+inline uint64_t traceClockNs() {
+	return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+						std::chrono::steady_clock::now().time_since_epoch())
+						.count());
+}
+
+// Writes events as Chrome trace JSON, tracks named by threadNames
+bool writeChromeTrace(const std::string& filename, const std::vector<TraceEvent>& events,
+					  const std::map<uint32_t, std::string>& threadNames);
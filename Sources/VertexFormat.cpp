@@ -0,0 +1,89 @@
+#include "VertexFormat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include <glm/packing.hpp>
+
+void VertexPrecision::merge(const VertexPrecision& other) {
+	position = std::max(position, other.position);
+	normal = std::max(normal, other.normal);
+	texCoord = std::max(texCoord, other.texCoord);
+}
+
+size_t vertexStride(VertexFormat format) {
+	return format == VertexFormat::Compact ? sizeof(CompactVertex) : 8 * sizeof(float);
+}
+
+const char* vertexFormatName(VertexFormat format) {
+	return format == VertexFormat::Compact ? "compact" : "float";
+}
+
+// Projects the unit sphere on an octahedron, the lower half folded over the corners
+glm::vec2 octahedralEncode(const glm::vec3& normal) {
+	glm::vec2 p = glm::vec2(normal) / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+	if (normal.z < 0.0f) {
+		glm::vec2 sign(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+		p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * sign;
+	}
+	return p;
+}
+
+glm::vec3 octahedralDecode(const glm::vec2& encoded) {
+	glm::vec3 n(encoded, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+	float t = std::max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return glm::normalize(n);
+}
+
+VertexQuantization encodeVertices(VertexFormat format, const std::vector<glm::vec3>& positions,
+								  const std::vector<glm::vec3>& normals, const std::vector<glm::vec2>& texCoords,
+								  std::vector<uint8_t>& out, VertexPrecision& precision) {
+	const size_t count = positions.size();
+	out.resize(count * vertexStride(format));
+
+	if (format == VertexFormat::Float) {
+		float* vertex = reinterpret_cast<float*>(out.data());
+		for (size_t i = 0; i < count; i++, vertex += 8) {
+			std::memcpy(vertex, &positions[i], sizeof(glm::vec3));
+			std::memcpy(vertex + 3, &normals[i], sizeof(glm::vec3));
+			std::memcpy(vertex + 6, &texCoords[i], sizeof(glm::vec2));
+		}
+		return {glm::vec4(0.0f), glm::vec4(1.0f)};
+	}
+
+	glm::vec3 boxMin(std::numeric_limits<float>::max()), boxMax(-std::numeric_limits<float>::max());
+	for (const auto& p : positions) {
+		boxMin = glm::min(boxMin, p);
+		boxMax = glm::max(boxMax, p);
+	}
+	const glm::vec3 extent = count > 0 ? boxMax - boxMin : glm::vec3(0.0f);
+	const VertexQuantization quantization{glm::vec4(boxMin, 0.0f), glm::vec4(extent, 0.0f)};
+
+	VertexPrecision error;
+	CompactVertex* vertex = reinterpret_cast<CompactVertex*>(out.data());
+	for (size_t i = 0; i < count; i++, vertex++) {
+		glm::vec3 decoded;
+		for (int c = 0; c < 3; c++) {
+			float t = extent[c] > 0.0f ? (positions[i][c] - boxMin[c]) / extent[c] : 0.0f;
+			vertex->position[c] = uint16_t(std::lround(glm::clamp(t, 0.0f, 1.0f) * 65535.0f));
+			decoded[c] = boxMin[c] + float(vertex->position[c]) / 65535.0f * extent[c];
+		}
+		vertex->padding = 0;
+		vertex->normal = glm::packSnorm2x16(octahedralEncode(normals[i]));
+		vertex->texCoord = glm::packHalf2x16(texCoords[i]);
+
+		glm::vec3 normal = octahedralDecode(glm::unpackSnorm2x16(vertex->normal));
+		// atan2 keeps its precision for tiny angles, unlike acos
+		float angle = std::atan2(glm::length(glm::cross(normal, normals[i])), glm::dot(normal, normals[i]));
+		glm::vec2 texCoord = glm::unpackHalf2x16(vertex->texCoord);
+		error.position = std::max(error.position, glm::distance(decoded, positions[i]));
+		error.normal = std::max(error.normal, glm::degrees(angle));
+		error.texCoord = std::max(error.texCoord, glm::length(texCoord - texCoords[i]));
+	}
+	precision.merge(error);
+	return quantization;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Layout of the vertices in the GPU buffers, both are interleaved
+enum class VertexFormat {
+	Float,		// 32 bytes: float position, normal and texture coordinates
+	Compact,	// 16 bytes: quantized position, octahedral normal, half texture coordinates
+};
+
+// Compact vertex, must match the attribute formats of MeshPool
+struct CompactVertex {
+	uint16_t position[3];	// Unorm, relative to the mesh bounds
+	uint16_t padding;
+	uint32_t normal;		// Octahedral, two snorm16
+	uint32_t texCoord;		// Two halfs
+};
+
+// Dequantization of the positions of a mesh: offset + unorm * scale.
+// Per-instance attributes of the vertex shader.
+struct VertexQuantization {
+	glm::vec4 offset;
+	glm::vec4 scale;
+};
+
+// Largest decoding errors, positions in the mesh units and normals in degrees
+struct VertexPrecision {
+	float position = 0.0f;
+	float normal = 0.0f;
+	float texCoord = 0.0f;
+
+	void merge(const VertexPrecision& other);
+};
+
+size_t vertexStride(VertexFormat format);
+const char* vertexFormatName(VertexFormat format);
+
+glm::vec2 octahedralEncode(const glm::vec3& normal);
+glm::vec3 octahedralDecode(const glm::vec2& encoded);
+
+// Interleaves the attributes in out (vertexStride bytes per vertex). The compact
+// format measures its precision, and both return the quantization to decode with.
+VertexQuantization encodeVertices(VertexFormat format, const std::vector<glm::vec3>& positions,
+								  const std::vector<glm::vec3>& normals, const std::vector<glm::vec2>& texCoords,
+								  std::vector<uint8_t>& out, VertexPrecision& precision);
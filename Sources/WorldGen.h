@@ -1,9 +1,19 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <glm/ext.hpp>
 
 #include <FastNoise/FastNoise.h>
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "MemoryTracker.h"
+#include "PerfCounters.h"
+#include "Profiler.h"
+#include "TaskScheduler.h"
+
 #include <math.h>
 #define DEG2RAD(a) ((a) / (180 / M_PI))
 #define RAD2DEG(a) ((a) * (180 / M_PI))
@@ -11,19 +21,18 @@
 
 class WorldGen {
    private:
-	inline void addFace(glm::vec3 xdir, glm::vec3 ydir, int subdivisions,
-						std::vector<glm::vec3>& vertices,
-						std::vector<glm::uvec3>& indices) {
+	// Writes the subdivisions^2 vertices and 2 (subdivisions - 1)^2 triangles of a
+	// cube face to preallocated arrays, offset being the index of its first vertex
+	static inline void addFace(glm::vec3 xdir, glm::vec3 ydir, int subdivisions,
+							   glm::vec3* vertices, glm::uvec3* indices, unsigned int offset) {
 		glm::vec3 zdir = glm::cross(xdir, ydir);
 
-		unsigned int offset = vertices.size();
 		for (int i = 0; i < subdivisions; i++) {
 			for (int j = 0; j < subdivisions; j++) {
 				// 0 to subdivisions - 1 => -1 to 1
 				float x = 2.0f * i / (float)(subdivisions - 1) - 1.0f;
 				float y = 2.0f * j / (float)(subdivisions - 1) - 1.0f;
-				glm::vec3 vertex = x * xdir + y * ydir + zdir;
-				vertices.push_back(vertex);
+				vertices[i * subdivisions + j] = x * xdir + y * ydir + zdir;
 			}
 		}
 
@@ -35,15 +44,32 @@ class WorldGen {
 				int v1 = i * subdivisions + j + 1;
 				int v2 = (i + 1) * subdivisions + j;
 				int v3 = (i + 1) * subdivisions + j + 1;
-				indices.push_back(glm::uvec3(v0, v2, v1) + offset);
-				indices.push_back(glm::uvec3(v1, v2, v3) + offset);
+				glm::uvec3* quad = &indices[2 * (i * (subdivisions - 1) + j)];
+				quad[0] = glm::uvec3(v0, v2, v1) + offset;
+				quad[1] = glm::uvec3(v1, v2, v3) + offset;
 			}
 		}
 	}
 
 	inline float getHeight(const glm::vec3& normPos, FastNoise::SmartNode<FastNoise::FractalFBm>& fn) {
-		float height = fn->GenSingle3D(normPos.x, normPos.y, normPos.z, 0);
+		return shapeHeight(fn->GenSingle3D(normPos.x, normPos.y, normPos.z, _seed));
+	}
+
+	// Projects the vertices from index first on the sphere, at the terrain radius
+	inline void applyHeights(std::vector<glm::vec3>& vertices, size_t first) {
+		// The noise alone, apart from the memory bound mesh construction
+		PerfScope perfScope("WorldGen::applyHeights");
+		parallelFor(first, vertices.size(), 1024, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				glm::vec3& vertex = vertices[i];
+				vertex = glm::normalize(vertex);
+				vertex *= getHeight(vertex, _noise);
+			}
+		});
+	}
 
+	// Maps a raw noise sample in [-1, 1] to a radius, flattening the oceans
+	static inline float shapeHeight(float height) {
 		height = 0.5f * height + 0.5f;
 		float ocean = 1.0f - height;
 		height = glm::pow(height, 4);
@@ -55,32 +81,211 @@ class WorldGen {
 		return 1 + height * 0.5f;
 	}
 
+	inline FastNoise::SmartNode<FastNoise::FractalFBm> createNoise() const {
+		MemoryScope memoryScope(MemoryCategory::Noise);
+		auto fnSimplex = FastNoise::New<FastNoise::Simplex>();
+		auto fnFractal = FastNoise::New<FastNoise::FractalFBm>();
+		fnFractal->SetSource(fnSimplex);
+		fnFractal->SetOctaveCount(10);
+		return fnFractal;
+	}
+
+	int _seed;
+	FastNoise::SmartNode<FastNoise::FractalFBm> _noise;
+
    public:
-	// Generate a sphere mesh with a given number of subdivisions
+	WorldGen(int seed = 0) : _seed(seed), _noise(createNoise()) {}
+
+	int seed() const { return _seed; }
+
+	// Radii of a batch of unit-sphere positions, given as separate coordinate
+	// arrays so that the noise is evaluated with the SIMD position-array path
+	inline void getHeights(const float* xs, const float* ys, const float* zs,
+						   int count, float* heights) const {
+		PROFILE_SCOPE("WorldGen::getHeights");
+		MemoryScope memoryScope(MemoryCategory::Noise);
+		_noise->GenPositionArray3D(heights, count, xs, ys, zs, 0.0f, 0.0f, 0.0f, _seed);
+		for (int i = 0; i < count; i++) heights[i] = shapeHeight(heights[i]);
+	}
+
+	// Biome color of a surface point (position scaled by its radius) given its
+	// normal, the CPU counterpart of the planet shader coloring
+	inline glm::vec3 getBiomeColor(const glm::vec3& pos, const glm::vec3& normal) const {
+		const float radius = 1.0f;
+		const float oceanHeight = 0.02f;
+		const float beachHeight = 0.02f;
+		const float snowHeight = 1.3f;
+
+		glm::vec3 up = glm::normalize(pos);
+		float steepness = 1.0f - glm::pow(glm::abs(glm::dot(normal, up)), 3.0f);
+
+		// 1 -> green, 0 -> orange
+		glm::vec3 albedo = glm::mix(glm::vec3(0.1f, 0.7f, 0.0f), glm::vec3(0.8f, 0.2f, 0.0f), steepness);
+
+		float height = glm::length(pos);
+		float sinOff = glm::sin(glm::dot(pos, glm::vec3(1, 1, 1)) * 10.f) * 0.03f;
+		sinOff += glm::sin(glm::dot(pos, glm::vec3(1, 0.8, -1.1)) * 15.f) * 0.02f;
+		sinOff += glm::sin(glm::dot(pos, glm::vec3(-1, 0.8, 1.1)) * 150.f) * 0.01f;
+		sinOff += glm::sin(glm::dot(pos, glm::vec3(1, 0.8, -1.1)) * 130.f) * 0.01f;
+		bool snow = glm::abs(up.y) > (0.9f + sinOff) || height > snowHeight;
+
+		if (height < radius + oceanHeight) {
+			albedo = glm::vec3(0.0f, 0.0f, 0.8f);
+		} else if (height < radius + oceanHeight + beachHeight) {
+			albedo = glm::mix(glm::vec3(1.0f, 1.0f, 0.2f), albedo, (height - radius - oceanHeight) / beachHeight);
+		}
+		if (snow) albedo = glm::vec3(1.0f);
+
+		return albedo;
+	}
+
+	// Generate a sphere mesh with a given number of subdivisions, appended to
+	// the arrays. Cleared arrays keep their capacity, so regenerating a mesh of
+	// the same size does not allocate.
 	inline void generateSphereMesh(int subdivisions,
 								   std::vector<glm::vec3>& vertices,
 								   std::vector<glm::uvec3>& indices) {
-		glm::vec3 xdir = glm::vec3(1.0f, 0.0f, 0.0f);
-		glm::vec3 ydir = glm::vec3(0.0f, 1.0f, 0.0f);
-		glm::vec3 zdir = glm::vec3(0.0f, 0.0f, 1.0f);
+		PROFILE_SCOPE("WorldGen::generateSphereMesh");
+		PerfScope perfScope("WorldGen::generateSphereMesh");
+		MemoryScope memoryScope(MemoryCategory::Meshes);
+		const glm::vec3 xdir = glm::vec3(1.0f, 0.0f, 0.0f);
+		const glm::vec3 ydir = glm::vec3(0.0f, 1.0f, 0.0f);
+		const glm::vec3 zdir = glm::vec3(0.0f, 0.0f, 1.0f);
+		const glm::vec3 faces[6][2] = {{xdir, ydir}, {-xdir, ydir}, {-ydir, zdir},
+									   {ydir, zdir}, {-xdir, zdir}, {xdir, zdir}};
 
-		addFace(xdir, ydir, subdivisions, vertices, indices);
-		addFace(-xdir, ydir, subdivisions, vertices, indices);
-		addFace(-ydir, zdir, subdivisions, vertices, indices);
-		addFace(ydir, zdir, subdivisions, vertices, indices);
-		addFace(-xdir, zdir, subdivisions, vertices, indices);
-		addFace(xdir, zdir, subdivisions, vertices, indices);
+		// Exact sizes up front, then every face writes its own ranges
+		const size_t faceVertices = size_t(subdivisions) * subdivisions;
+		const size_t faceTriangles = 2 * size_t(subdivisions - 1) * (subdivisions - 1);
+		const size_t firstVertex = vertices.size();
+		const size_t firstTriangle = indices.size();
+		vertices.resize(firstVertex + 6 * faceVertices);
+		indices.resize(firstTriangle + 6 * faceTriangles);
+		parallelFor(0, 6, 1, [&](size_t begin, size_t end) {
+			for (size_t f = begin; f < end; f++) {
+				const size_t offset = firstVertex + f * faceVertices;
+				addFace(faces[f][0], faces[f][1], subdivisions, &vertices[offset],
+						&indices[firstTriangle + f * faceTriangles], unsigned(offset));
+			}
+		});
 
-		auto fnSimplex = FastNoise::New<FastNoise::Simplex>();
-		auto fnFractal = FastNoise::New<FastNoise::FractalFBm>();
-		fnFractal->SetSource(fnSimplex);
-		fnFractal->SetOctaveCount(10);
+		applyHeights(vertices, firstVertex);
+	}
+
+	// Vertices of the meshes for a given subdivision, to compare them at equal cost
+	static size_t sphereVertexCount(int subdivisions) { return size_t(6) * subdivisions * subdivisions; }
+	static size_t icosphereVertexCount(int frequency) { return size_t(10) * frequency * frequency + 2; }
 
-#pragma omp parallel for
-		for (glm::vec3& vertex : vertices) {
-			vertex = glm::normalize(vertex);
-			vertex *= getHeight(vertex, fnFractal);
+	// Geodesic sphere: every face of an icosahedron split in frequency^2
+	// triangles, for 10 frequency^2 + 2 vertices, appended to the arrays like
+	// generateSphereMesh. Triangle sizes vary much less than on the cube sphere.
+	// Vertices are numbered corners first, then edges, then face interiors, so
+	// every lattice point has a closed-form index: the faces are built in
+	// parallel, with no map of the shared edge midpoints.
+	inline void generateIcosphereMesh(int frequency,
+									  std::vector<glm::vec3>& vertices,
+									  std::vector<glm::uvec3>& indices) {
+		PROFILE_SCOPE("WorldGen::generateIcosphereMesh");
+		PerfScope perfScope("WorldGen::generateIcosphereMesh");
+		MemoryScope memoryScope(MemoryCategory::Meshes);
+		const int n = std::max(1, frequency);
+		const float phi = 0.5f * (1.0f + std::sqrt(5.0f));
+		const glm::vec3 corners[12] = {
+			{-1, phi, 0}, {1, phi, 0}, {-1, -phi, 0}, {1, -phi, 0}, {0, -1, phi}, {0, 1, phi},
+			{0, -1, -phi}, {0, 1, -phi}, {phi, 0, -1}, {phi, 0, 1}, {-phi, 0, -1}, {-phi, 0, 1}};
+		// Counter-clockwise seen from outside
+		static const int faces[20][3] = {
+			{0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11}, {1, 5, 9}, {5, 11, 4},
+			{11, 10, 2}, {10, 7, 6}, {7, 1, 8}, {3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8},
+			{3, 8, 9}, {4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1}};
+
+		// The 30 edges, from their lower corner, and the edge of every face side
+		// (side s goes from faces[f][s] to faces[f][(s + 1) % 3])
+		int edges[30][2];
+		int faceEdges[20][3];
+		int edgeCount = 0;
+		for (int f = 0; f < 20; f++) {
+			for (int s = 0; s < 3; s++) {
+				const int u = std::min(faces[f][s], faces[f][(s + 1) % 3]);
+				const int v = std::max(faces[f][s], faces[f][(s + 1) % 3]);
+				int e = 0;
+				while (e < edgeCount && (edges[e][0] != u || edges[e][1] != v)) e++;
+				if (e == edgeCount) {
+					edges[e][0] = u;
+					edges[e][1] = v;
+					edgeCount++;
+				}
+				faceEdges[f][s] = e;
+			}
 		}
+
+		// Exact sizes up front, then every edge and face row writes its own ranges
+		const size_t edgeVertices = size_t(n - 1);
+		const size_t faceVertices = size_t(n - 1) * size_t(std::max(0, n - 2)) / 2;
+		const size_t firstVertex = vertices.size();
+		const size_t firstEdgeVertex = firstVertex + 12;
+		const size_t firstFaceVertex = firstEdgeVertex + 30 * edgeVertices;
+		const size_t firstTriangle = indices.size();
+		vertices.resize(firstFaceVertex + 20 * faceVertices);
+		indices.resize(firstTriangle + 20 * size_t(n) * n);
+
+		for (int c = 0; c < 12; c++) vertices[firstVertex + c] = glm::normalize(corners[c]);
+		parallelFor(0, 30, 1, [&](size_t begin, size_t end) {
+			for (size_t e = begin; e < end; e++)
+				for (int t = 1; t < n; t++)
+					vertices[firstEdgeVertex + e * edgeVertices + (t - 1)] =
+						glm::normalize(glm::mix(corners[edges[e][0]], corners[edges[e][1]], float(t) / n));
+		});
+
+		// Lattice point a + i (b - a) / n + j (c - a) / n of face (a, b, c)
+		auto vertexIndex = [&](int f, int i, int j) -> unsigned int {
+			const int* face = faces[f];
+			if (i == 0 && j == 0) return unsigned(firstVertex + face[0]);
+			if (i == n) return unsigned(firstVertex + face[1]);
+			if (j == n) return unsigned(firstVertex + face[2]);
+			int side, t;	// Steps from the start of the side
+			if (j == 0) {
+				side = 0;
+				t = i;
+			} else if (i + j == n) {
+				side = 1;
+				t = j;
+			} else if (i == 0) {
+				side = 2;
+				t = n - j;
+			} else {
+				// Interior rows i = 1 .. n - 2 hold j = 1 .. n - 1 - i
+				const size_t row = size_t(i - 1) * (n - 1) - size_t(i - 1) * i / 2;
+				return unsigned(firstFaceVertex + f * faceVertices + row + (j - 1));
+			}
+			const int e = faceEdges[f][side];
+			if (face[side] != edges[e][0]) t = n - t;
+			return unsigned(firstEdgeVertex + e * edgeVertices + (t - 1));
+		};
+
+		// One task range per set of rows i of the faces
+		parallelFor(0, 20 * size_t(n), 4, [&](size_t begin, size_t end) {
+			for (size_t r = begin; r < end; r++) {
+				const int f = int(r / n), i = int(r % n);
+				const glm::vec3 a = corners[faces[f][0]];
+				const glm::vec3 ab = (corners[faces[f][1]] - a) / float(n);
+				const glm::vec3 ac = (corners[faces[f][2]] - a) / float(n);
+				if (i > 0)
+					for (int j = 1; i + j < n; j++)
+						vertices[vertexIndex(f, i, j)] = glm::normalize(a + float(i) * ab + float(j) * ac);
+
+				// Row i holds n - i upward and n - i - 1 downward triangles
+				glm::uvec3* triangle = &indices[firstTriangle + size_t(f) * n * n + size_t(2 * n - i) * i];
+				for (int j = 0; i + j < n; j++) {
+					*triangle++ = glm::uvec3(vertexIndex(f, i, j), vertexIndex(f, i + 1, j), vertexIndex(f, i, j + 1));
+					if (i + j + 1 < n)
+						*triangle++ = glm::uvec3(vertexIndex(f, i + 1, j), vertexIndex(f, i + 1, j + 1),
+												 vertexIndex(f, i, j + 1));
+				}
+			}
+		});
+
+		applyHeights(vertices, firstVertex);
 	}
 
 	// Inverse Web‑Mercator: from normalized v in [0,1] to latitude in radians
@@ -95,18 +300,31 @@ class WorldGen {
 								  std::vector<glm::vec2>& positions2D,	// UV coordinates
 								  std::vector<glm::vec3>& positions3D,	// 3D positions on unit sphere
 								  std::vector<glm::uvec3>& indices) {
-		const uint32_t n = 1u << z;	 // number of squares per axis
+		generateMercatorPatch(0, 0, 0, 1 << z, positions2D, positions3D, indices);
+	}
+
+	// Mesh of the Web-Mercator tile (zoom, tileX, tileY) as a grid of subdivisions^2 squares.
+	// Vertices are appended, UVs are global so that one world texture covers every patch.
+	void generateMercatorPatch(int zoom, int tileX, int tileY, int subdivisions,
+							   std::vector<glm::vec2>& positions2D,	 // UV coordinates
+							   std::vector<glm::vec3>& positions3D,	 // 3D positions on unit sphere
+							   std::vector<glm::uvec3>& indices) {
+		PROFILE_SCOPE("WorldGen::generateMercatorPatch");
+		MemoryScope memoryScope(MemoryCategory::Meshes);
+		const uint32_t n = uint32_t(subdivisions);	// number of squares per axis
 		const uint32_t vertCount = (n + 1) * (n + 1);
+		const uint32_t base = uint32_t(positions3D.size());
+		const float tiles = float(1 << zoom);
 
-		positions2D.reserve(vertCount);
-		positions3D.reserve(vertCount);
-		indices.reserve(n * n * 2);	 // 2 triangles per square
+		positions2D.reserve(positions2D.size() + vertCount);
+		positions3D.reserve(positions3D.size() + vertCount);
+		indices.reserve(indices.size() + n * n * 2);	// 2 triangles per square
 
 		// build the grid of (u,v)
 		for (uint32_t y = 0; y <= n; ++y) {
-			float v = float(y) / float(n);
+			float v = (tileY + float(y) / float(n)) / tiles;
 			for (uint32_t x = 0; x <= n; ++x) {
-				float u = float(x) / float(n);
+				float u = (tileX + float(x) / float(n)) / tiles;
 				positions2D.emplace_back(u, v);
 
 				// inverse‑Mercator-> lat/lon
@@ -124,7 +342,7 @@ class WorldGen {
 		}
 
 		auto idx = [&](uint32_t ix, uint32_t iy) {
-			return iy * (n + 1) + ix;
+			return base + iy * (n + 1) + ix;
 		};
 
 		for (uint32_t y = 0; y < n; ++y) {
@@ -9,17 +9,256 @@
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
+#include <algorithm>
+#include <cstdio>
 #include <memory>
 
 #include "Material.h"
 #include "Transform.h"
+#include "ShaderProgram.h"
+#include "ChunkRenderer.h"
+#include "MeshPool.h"
+#include "GpuProfiler.h"
+#include "FrameStats.h"
+#include "TaskScheduler.h"
+#include "PerfCounters.h"
+#include "WorldGen.h"
 
 class DebugEditor : public Editor {
-	float &m_deltaTime;
+	FrameStats &m_frameStats;
+	const ChunkRenderStats &m_chunkStats;
+	MeshPool &m_meshPool;
+	GpuProfiler &m_gpuProfiler;
+
+	// Scheduler utilization over the last refresh interval
+	static constexpr double WorkerRefreshSeconds = 0.5;
+	std::vector<WorkerStats> m_workerStats;
+	std::vector<WorkerStats> m_workerDeltas;
+	double m_lastWorkerRefresh = -1.0;
+
+	// Generation run on demand to sample the hardware counters
+	WorldGen m_perfWorldGen;
+	Mesh m_perfMesh;
+	int m_perfSubdivisions = 128;
+
+	static void arenaUI(const char *name, const GpuArenaStats &stats) {
+		ImGui::Text("%s: %zu / %zu used, %zu pending, %zu allocations", name, stats.used, stats.capacity,
+					stats.pending, stats.allocations);
+		ImGui::ProgressBar(stats.capacity ? float(stats.used) / float(stats.capacity) : 0.0f, ImVec2(-1, 0));
+		ImGui::Text("  %zu free blocks, largest %zu, fragmentation %.1f%%", stats.freeBlocks, stats.largestFree,
+					stats.fragmentation * 100.0f);
+	}
 
    public:
-	DebugEditor(float &deltaTime)
-		: Editor("Performances"), m_deltaTime(deltaTime) {}
+	DebugEditor(FrameStats &frameStats, const ChunkRenderStats &chunkStats, MeshPool &meshPool,
+				GpuProfiler &gpuProfiler)
+		: Editor("Performances"),
+		  m_frameStats(frameStats),
+		  m_chunkStats(chunkStats),
+		  m_meshPool(meshPool),
+		  m_gpuProfiler(gpuProfiler) {}
+
+	void plotUI(const char *label, const std::vector<float> &history, float scaleMax) {
+		const size_t samples = m_frameStats.samples();
+		if (samples == 0) return;
+		const size_t last = (m_frameStats.historyOffset() + FrameStats::HistorySize - 1) % FrameStats::HistorySize;
+		char overlay[64];
+		std::snprintf(overlay, sizeof(overlay), "%s %.2f ms", label, history[last]);
+		ImGui::PushID(label);
+		ImGui::PlotLines("", history.data(), int(samples),
+						 samples == FrameStats::HistorySize ? int(m_frameStats.historyOffset()) : 0, overlay, 0.0f,
+						 scaleMax, ImVec2(-1, 60));
+		ImGui::PopID();
+	}
+
+	void frameTimesUI() {
+		const FrameTimeSummary summary = m_frameStats.summary();
+		ImGui::Text("FPS: %.1f over the last %zu frames", summary.averageMs > 0.0f ? 1000.0f / summary.averageMs : 0.0f,
+					summary.frames);
+		ImGui::Text("Frame ms: min %.2f, avg %.2f, p95 %.2f, p99 %.2f, max %.2f", summary.minMs, summary.averageMs,
+					summary.p95Ms, summary.p99Ms, summary.maxMs);
+		ImGui::Text("Hitches (over %.0fx the median): %zu in history, %zu total", FrameStats::HitchFactor,
+					summary.hitches, m_frameStats.totalHitches());
+
+		// Hitches above the scale stay visible as clipped peaks
+		const float scaleMax = std::max(2.0f * summary.p99Ms, 1.0f);
+		plotUI("Frame", m_frameStats.frameHistory(), scaleMax);
+		plotUI("CPU", m_frameStats.cpuHistory(), scaleMax);
+
+		if (ImGui::BeginTable("CPU stages", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+			ImGui::TableSetupColumn("Stage");
+			ImGui::TableSetupColumn("Last ms");
+			ImGui::TableSetupColumn("Avg ms");
+			ImGui::TableSetupColumn("Max ms");
+			ImGui::TableHeadersRow();
+			const size_t last = (m_frameStats.historyOffset() + FrameStats::HistorySize - 1) % FrameStats::HistorySize;
+			for (const FrameStage &stage : m_frameStats.stages()) {
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(stage.name.c_str());
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", stage.history[last]);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", m_frameStats.stageAverageMs(stage));
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", m_frameStats.stageMaxMs(stage));
+			}
+			ImGui::EndTable();
+		}
+
+		if (!m_frameStats.recording()) {
+			if (ImGui::Button("Record CSV")) m_frameStats.startRecording("PlanetGenFrames.csv");
+		} else {
+			if (ImGui::Button("Stop CSV")) m_frameStats.stopRecording();
+			ImGui::SameLine();
+			ImGui::Text("%zu frames to %s", m_frameStats.recordedFrames(), m_frameStats.recordingFile().c_str());
+		}
+	}
+
+	void gpuProfilerUI() {
+		ImGui::Text("GPU frame: %.3f ms, %zu frames not ready in time", m_gpuProfiler.frameMs(),
+					m_gpuProfiler.droppedFrames());
+		if (ImGui::BeginTable("GPU passes", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+			ImGui::TableSetupColumn("Pass");
+			ImGui::TableSetupColumn("Last ms");
+			ImGui::TableSetupColumn("Avg ms");
+			ImGui::TableSetupColumn("Max ms");
+			ImGui::TableHeadersRow();
+			for (const GpuPassStats &pass : m_gpuProfiler.passes()) {
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(pass.name.c_str());
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", pass.lastMs);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", pass.averageMs);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", pass.maxMs);
+			}
+			ImGui::EndTable();
+		}
+		ImGui::TextDisabled("Traces are recorded from the CPU Profiler window");
+	}
+
+	void schedulerUI() {
+		TaskScheduler &scheduler = TaskScheduler::instance();
+		const double now = ImGui::GetTime();
+		if (m_lastWorkerRefresh < 0.0 || now - m_lastWorkerRefresh >= WorkerRefreshSeconds) {
+			std::vector<WorkerStats> stats = scheduler.stats();
+			m_workerDeltas = stats;
+			// Restarted workers have no previous sample
+			if (m_workerStats.size() == stats.size()) {
+				for (size_t i = 0; i < stats.size(); i++) {
+					m_workerDeltas[i].tasks -= std::min(m_workerDeltas[i].tasks, m_workerStats[i].tasks);
+					m_workerDeltas[i].steals -= std::min(m_workerDeltas[i].steals, m_workerStats[i].steals);
+					m_workerDeltas[i].busyNs -= std::min(m_workerDeltas[i].busyNs, m_workerStats[i].busyNs);
+					m_workerDeltas[i].aliveNs -= std::min(m_workerDeltas[i].aliveNs, m_workerStats[i].aliveNs);
+				}
+			}
+			m_workerStats = std::move(stats);
+			m_lastWorkerRefresh = now;
+		}
+
+		ImGui::Text("%d threads (%zu workers and the waiting thread)", scheduler.threadCount(),
+					m_workerStats.empty() ? size_t(0) : m_workerStats.size() - 1);
+		if (ImGui::BeginTable("Workers", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+			ImGui::TableSetupColumn("Thread");
+			ImGui::TableSetupColumn("Busy");
+			ImGui::TableSetupColumn("Tasks");
+			ImGui::TableSetupColumn("Steals");
+			ImGui::TableHeadersRow();
+			for (const WorkerStats &worker : m_workerDeltas) {
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(worker.name.c_str());
+				ImGui::TableNextColumn();
+				const float busy = worker.aliveNs ? std::min(1.0f, float(worker.busyNs) / float(worker.aliveNs)) : 0.0f;
+				ImGui::ProgressBar(busy, ImVec2(-1, 0));
+				ImGui::TableNextColumn();
+				ImGui::Text("%zu", worker.tasks);
+				ImGui::TableNextColumn();
+				ImGui::Text("%zu", worker.steals);
+			}
+			ImGui::EndTable();
+		}
+	}
+
+	static void counterCell(const PerfCounterValues &values, HardwareCounter counter) {
+		ImGui::TableNextColumn();
+		if (values.has(counter))
+			ImGui::Text("%.2f", values.perKiloInstruction(counter));
+		else
+			ImGui::TextDisabled("n/a");
+	}
+
+	void perfCountersUI() {
+		bool enabled = PerfCounters::enabled();
+		if (ImGui::Checkbox("Collect hardware counters", &enabled)) PerfCounters::setEnabled(enabled);
+		if (!PerfCounters::enabled()) {
+			ImGui::TextDisabled("%s", PerfCounters::reason().c_str());
+			return;
+		}
+
+		ImGui::SliderInt("Subdivisions", &m_perfSubdivisions, 16, 512);
+		if (ImGui::Button("Run sphere generation")) {
+			m_perfMesh.positions().clear();
+			m_perfMesh.indices().clear();
+			m_perfWorldGen.generateSphereMesh(m_perfSubdivisions, m_perfMesh.positions(), m_perfMesh.indices());
+			m_perfMesh.recomputePerVertexNormals();
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Reset")) PerfCounters::resetStages();
+
+		if (ImGui::BeginTable("Counters", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+			ImGui::TableSetupColumn("Stage");
+			ImGui::TableSetupColumn("Calls");
+			ImGui::TableSetupColumn("Mcycles");
+			ImGui::TableSetupColumn("IPC");
+			ImGui::TableSetupColumn("Cache miss/kI");
+			ImGui::TableSetupColumn("Branch miss/kI");
+			ImGui::TableHeadersRow();
+			for (const PerfStage &stage : PerfCounters::stages()) {
+				const PerfCounterValues &totals = stage.totals;
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(stage.name.c_str());
+				ImGui::TableNextColumn();
+				ImGui::Text("%zu", stage.calls);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.2f", totals[HardwareCounter::Cycles] / 1e6);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.2f", totals.instructionsPerCycle());
+				counterCell(totals, HardwareCounter::CacheMisses);
+				counterCell(totals, HardwareCounter::BranchMisses);
+			}
+			ImGui::EndTable();
+		}
+		ImGui::TextDisabled("Stages count every thread of the process while they run");
+	}
+
+	void renderUI() override {
+		if (ImGui::CollapsingHeader("Frame times", ImGuiTreeNodeFlags_DefaultOpen)) frameTimesUI();
+		ImGui::Text("Chunks: %zu visible / %zu, %zu triangles, %zu draw calls", m_chunkStats.visibleChunks,
+					m_chunkStats.chunks, m_chunkStats.visibleTriangles, m_chunkStats.drawCalls);
+
+		if (ImGui::CollapsingHeader("GPU passes", ImGuiTreeNodeFlags_DefaultOpen)) gpuProfilerUI();
+
+		const UniformStats &uniforms = ShaderProgram::uniformStats();
+		ImGui::Text("Uniforms: %.3f ms, %zu uploads, %zu skipped, %zu lookups",
+					uniforms.seconds * 1000.0, uniforms.uploads, uniforms.skipped, uniforms.lookups);
+
+		if (ImGui::CollapsingHeader("Task scheduler")) schedulerUI();
+		if (ImGui::CollapsingHeader("Hardware counters")) perfCountersUI();
 
-	void renderUI() override { ImGui::Text("FPS: %.1f", 1.0f / m_deltaTime); }
+		if (ImGui::CollapsingHeader("Mesh pool")) {
+			const MeshPoolStats pool = m_meshPool.stats();
+			ImGui::Text("%.1f MiB, %zu defragmentations", pool.bytes / (1024.0 * 1024.0), pool.defragmentations);
+			ImGui::Text("%s vertices, %zu bytes each", vertexFormatName(m_meshPool.format()), pool.vertexStride);
+			ImGui::Text("Max errors: position %.2e, normal %.4f deg, texcoord %.2e", pool.precision.position,
+						pool.precision.normal, pool.precision.texCoord);
+			arenaUI("Vertices", pool.vertices);
+			arenaUI("Indices", pool.indices);
+			if (ImGui::Button("Defragment")) m_meshPool.defragment();
+		}
+	}
 };
\ No newline at end of file
@@ -11,22 +11,31 @@
 
 #include <memory>
 #include <vector>
+#include <algorithm>
 
 #include "Material.h"
 #include "Transform.h"
 #include "Light.h"
+#include "LightClusters.h"
 
 class LightsEditor : public Editor {
 	std::vector<std::shared_ptr<AbstractLight>>& m_lights;
+	const ClusterStats& m_clusterStats;
+	LightStressBenchmark& m_stressBenchmark;
+	int m_spawnCount = 2000;
+
+	// Lights past this one are only counted, not listed
+	static const int MaxListedLights = 16;
 
    public:
-	LightsEditor(std::vector<std::shared_ptr<AbstractLight>>& lights)
-		: Editor("Lights"), m_lights(lights) {}
+	LightsEditor(std::vector<std::shared_ptr<AbstractLight>>& lights, const ClusterStats& clusterStats,
+				 LightStressBenchmark& stressBenchmark)
+		: Editor("Lights"), m_lights(lights), m_clusterStats(clusterStats), m_stressBenchmark(stressBenchmark) {}
 
 	void renderUI() override {
 		const char* items[] = {"Directional", "Point"};
 
-		for (int i = 0; i < m_lights.size(); i++) {
+		for (int i = 0; i < m_lights.size() && i < MaxListedLights; i++) {
 			AbstractLight& light = *m_lights[i];
 			if (ImGui::CollapsingHeader(
 					std::string("Light " + std::to_string(i)).c_str())) {
@@ -106,15 +115,33 @@ class LightsEditor : public Editor {
 				ImGui::Indent(-10.0f);
 			}
 		}
-		if (m_lights.size() < 10) {
-			if (ImGui::Button("Add light")) {
-				m_lights.push_back(std::make_shared<PointLight>(
-					glm::vec3(1.0f), 1.0f, glm::vec3(0.0f), 1.0f, 0.0f, 0.0f));
-			}
-			ImGui::SameLine();
+		if (ImGui::Button("Add light")) {
+			m_lights.push_back(std::make_shared<PointLight>(
+				glm::vec3(1.0f), 1.0f, glm::vec3(0.0f), 1.0f, 0.0f, 0.0f));
 		}
+		ImGui::SameLine();
 		if (m_lights.size() > 0 && ImGui::Button("Remove light")) {
 			m_lights.erase(m_lights.begin() + m_lights.size() - 1);
 		}
+
+		// Many lights: clustered culling
+		ImGui::Separator();
+		if (m_lights.size() > MaxListedLights)
+			ImGui::Text("%d more lights not listed", int(m_lights.size()) - MaxListedLights);
+		ImGui::SliderInt("Count##city", &m_spawnCount, 100, 20000);
+		if (ImGui::Button("Spawn city lights"))
+			LightStressBenchmark::spawnCityLights(m_lights, m_spawnCount, unsigned(m_lights.size()));
+		ImGui::SameLine();
+		if (ImGui::Button("Remove point lights")) {
+			m_lights.erase(std::remove_if(m_lights.begin(), m_lights.end(),
+										  [](const std::shared_ptr<AbstractLight>& light) { return light->getType() == 1; }),
+						   m_lights.end());
+		}
+		ImGui::BeginDisabled(m_stressBenchmark.running());
+		if (ImGui::Button("Run stress benchmark")) m_stressBenchmark.start();
+		ImGui::EndDisabled();
+		ImGui::Text("Clustering: %.3f ms, %zu point lights, %zu references, max %zu per cluster",
+					m_clusterStats.buildSeconds * 1000.0, m_clusterStats.pointLights, m_clusterStats.references,
+					m_clusterStats.maxPerCluster);
 	}
 };
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Editor.h"
+
+#include <imgui.h>
+
+#include "MemoryTracker.h"
+
+// Live CPU and GPU memory per subsystem, with the high-water marks
+class MemoryEditor : public Editor {
+	static double mib(size_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+	static void rowUI(const char *name, const MemoryCounters &cpu, const MemoryCounters &gpu) {
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		ImGui::TextUnformatted(name);
+		ImGui::TableNextColumn();
+		ImGui::Text("%.2f", mib(cpu.bytes));
+		ImGui::TableNextColumn();
+		ImGui::Text("%.2f", mib(cpu.peakBytes));
+		ImGui::TableNextColumn();
+		ImGui::Text("%zu", cpu.allocations);
+		ImGui::TableNextColumn();
+		ImGui::Text("%.2f", mib(gpu.bytes));
+		ImGui::TableNextColumn();
+		ImGui::Text("%.2f", mib(gpu.peakBytes));
+	}
+
+   public:
+	MemoryEditor() : Editor("Memory") {}
+
+	void renderUI() override {
+		const MemoryCounters cpuTotal = MemoryTracker::cpuTotal();
+		const MemoryCounters gpuTotal = MemoryTracker::gpuTotal();
+		if (MemoryTracker::tracksCPU())
+			ImGui::Text("CPU: %.1f MiB (peak %.1f MiB), %zu allocations since startup", mib(cpuTotal.bytes),
+						mib(cpuTotal.peakBytes), cpuTotal.totalAllocations);
+		else
+			ImGui::TextDisabled("CPU tracking is disabled (PLANETGEN_MEMORY_TRACKING=OFF)");
+		ImGui::Text("GPU: %.1f MiB (peak %.1f MiB), %zu objects", mib(gpuTotal.bytes), mib(gpuTotal.peakBytes),
+					gpuTotal.allocations);
+
+		if (ImGui::BeginTable("Memory", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+			ImGui::TableSetupColumn("Category");
+			ImGui::TableSetupColumn("CPU MiB");
+			ImGui::TableSetupColumn("CPU peak");
+			ImGui::TableSetupColumn("Live allocs");
+			ImGui::TableSetupColumn("GPU MiB");
+			ImGui::TableSetupColumn("GPU peak");
+			ImGui::TableHeadersRow();
+			for (int i = 0; i < int(MemoryCategory::Count); i++) {
+				const MemoryCategory category = MemoryCategory(i);
+				rowUI(MemoryTracker::name(category), MemoryTracker::cpu(category), MemoryTracker::gpu(category));
+			}
+			rowUI("Total", cpuTotal, gpuTotal);
+			ImGui::EndTable();
+		}
+
+		if (ImGui::Button("Save snapshot")) MemoryTracker::writeSnapshot("PlanetGenMemory.json");
+	}
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Editor.h"
+
+#include <imgui.h>
+
+#include <vector>
+
+#include "Profiler.h"
+#include "GpuProfiler.h"
+
+// Live flame summary of the CPU zones, and trace recording of the CPU zones with the GPU passes
+class ProfilerEditor : public Editor {
+	static constexpr uint64_t WindowNs = 1000000000;	// Summarized time span
+	static constexpr double RefreshSeconds = 0.5;
+
+	GpuProfiler &m_gpuProfiler;
+	std::vector<ThreadProfile> m_summary;
+	size_t m_frames = 0;
+	double m_lastRefresh = -1.0;
+	uint64_t m_recordStart = 0;
+	bool m_recording = false;
+
+	void nodeUI(const ProfileNode &node, double parentMs) {
+		const double perFrame = node.totalMs / double(m_frames ? m_frames : 1);
+		ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_SpanFullWidth;
+		if (node.children.empty()) flags |= ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen;
+		const bool open = ImGui::TreeNodeEx(node.name.c_str(), flags, "%s", node.name.c_str());
+		ImGui::SameLine(ImGui::GetWindowWidth() * 0.55f);
+		ImGui::Text("%8.3f ms %5.1f%% %6zu calls", perFrame, parentMs > 0.0 ? 100.0 * node.totalMs / parentMs : 100.0,
+					node.calls);
+		if (open && !node.children.empty()) {
+			for (const ProfileNode &child : node.children) nodeUI(child, node.totalMs);
+			ImGui::TreePop();
+		}
+	}
+
+   public:
+	ProfilerEditor(GpuProfiler &gpuProfiler) : Editor("CPU Profiler"), m_gpuProfiler(gpuProfiler) {}
+
+	void renderUI() override {
+#if !PLANETGEN_PROFILER
+		ImGui::TextUnformatted("Built without PLANETGEN_PROFILER, no zones are recorded.");
+#endif
+		const double now = glfwGetTime();
+		if (now - m_lastRefresh >= RefreshSeconds) {
+			const uint64_t since = traceClockNs() - WindowNs;
+			m_summary = Profiler::summary(since);
+			m_frames = Profiler::frames(since);
+			m_lastRefresh = now;
+		}
+
+		ImGui::Text("Last second, per frame over %zu frames", m_frames);
+		for (const ThreadProfile &thread : m_summary) {
+			ImGui::PushID(int(thread.thread));
+			if (ImGui::CollapsingHeader(thread.name.c_str(), ImGuiTreeNodeFlags_DefaultOpen)) {
+				for (const ProfileNode &node : thread.root.children) nodeUI(node, thread.root.totalMs);
+			}
+			ImGui::PopID();
+		}
+
+		// The CPU rings always record, only the GPU passes need to be kept while recording
+		if (!m_recording) {
+			if (ImGui::Button("Record trace")) {
+				m_gpuProfiler.recorded().clear();
+				m_gpuProfiler.setRecording(true);
+				m_recordStart = traceClockNs();
+				m_recording = true;
+			}
+		} else if (ImGui::Button("Save trace")) {
+			m_gpuProfiler.setRecording(false);
+			m_recording = false;
+			Profiler::writeTrace("PlanetGenTrace.json", m_recordStart, m_gpuProfiler.recorded(),
+								 {{GpuProfiler::GpuTraceThread, "GPU"}});
+		}
+		ImGui::SameLine();
+		ImGui::TextDisabled("Chrome / Perfetto JSON, the last %zu zones of each thread", Profiler::RingSize);
+	}
+};
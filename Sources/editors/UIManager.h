@@ -24,7 +24,7 @@ class UIManager {
 
 		// Setup Platform/Renderer backends
 		ImGui_ImplGlfw_InitForOpenGL(windowPtr, true);
-		ImGui_ImplOpenGL3_Init("#version 460");
+		ImGui_ImplOpenGL3_Init("#version 450");
 	}
 	void renderUIs() {
 		ImGui_ImplOpenGL3_NewFrame();
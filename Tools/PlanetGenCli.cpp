@@ -0,0 +1,192 @@
+// Headless planet generation on top of planetgen_core, without GL or a display.
+//
+// Usage: planetgen-cli mesh    [--seed N] [--resolution N] [--threads N] [--no-normals] [--counters]
+//                              [--icosphere] [--output planet.obj]
+//        planetgen-cli texture [--seed N] [--resolution N] [--threads N] [--output planet.png]
+//        planetgen-cli bake    [--seed N] [--resolution N] [--threads N] [--min-zoom N] [--max-zoom N]
+//                              [--output <directory | file.pgtiles>]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "IO.h"
+#include "MemoryTracker.h"
+#include "Mesh.h"
+#include "PerfCounters.h"
+#include "TaskScheduler.h"
+#include "TileBaker.h"
+#include "WorldGen.h"
+
+namespace {
+
+struct Options {
+	std::string command;
+	std::string output;
+	int seed = 0;
+	int resolution = 0;	 // Command default when 0
+	int threads = 0;	 // All available when 0
+	int minZoom = 0;
+	int maxZoom = 4;
+	bool normals = true;
+	bool counters = false;	// Hardware counters per stage, Linux only
+	bool icosphere = false;	// Geodesic mesh instead of the cube sphere
+};
+
+int usage(const char* program) {
+	std::cerr << "Usage: " << program << " <mesh | texture | bake> [--seed N] [--resolution N] [--threads N]\n"
+			  << "       [--output file] [--no-normals] [--counters] [--icosphere] [--min-zoom N] [--max-zoom N]\n\n"
+			  << "  mesh     Cube-sphere planet with --resolution vertices per face edge (64), as OBJ;\n"
+			  << "           with --icosphere, icosphere with --resolution segments per triangle edge\n"
+			  << "  texture  Web-Mercator color map of the whole planet, --resolution pixels wide (1024), as PNG\n"
+			  << "  bake     Tile pyramid of --resolution pixel tiles (256), as with PlanetGen --bake\n";
+	return 1;
+}
+
+// Prints the duration of a stage when it goes out of scope
+class StageTimer {
+   public:
+	explicit StageTimer(const char* name) : _name(name), _start(std::chrono::steady_clock::now()) {}
+	~StageTimer() {
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - _start;
+		std::printf("[CLI] %-10s %10.2f ms\n", _name, elapsed.count());
+	}
+
+   private:
+	const char* _name;
+	std::chrono::steady_clock::time_point _start;
+};
+
+int runMesh(const Options& options) {
+	const int resolution = options.resolution > 0 ? options.resolution : 64;
+	const std::string output = options.output.empty() ? "planet.obj" : options.output;
+	WorldGen worldGen(options.seed);
+	Mesh mesh;
+	{
+		StageTimer timer("generate");
+		if (options.icosphere)
+			worldGen.generateIcosphereMesh(resolution, mesh.positions(), mesh.indices());
+		else
+			worldGen.generateSphereMesh(resolution, mesh.positions(), mesh.indices());
+	}
+	if (options.normals) {
+		StageTimer timer("normals");
+		mesh.recomputePerVertexNormals();
+	}
+	{
+		StageTimer timer("export");
+		if (!IO::saveOBJ(output, mesh)) return 1;
+	}
+	std::printf("[CLI] %zu vertices, %zu triangles to %s\n", mesh.positions().size(), mesh.indices().size(),
+				output.c_str());
+	return 0;
+}
+
+int runTexture(const Options& options) {
+	BakeOptions bakeOptions;
+	bakeOptions.tileSize = options.resolution > 0 ? options.resolution : 1024;
+	const std::string output = options.output.empty() ? "planet.png" : options.output;
+	WorldGen worldGen(options.seed);
+	std::vector<uint8_t> png;
+	{
+		StageTimer timer("generate");
+		png = TileBaker(worldGen, bakeOptions).renderTile(TileLayer::Color, 0, 0, 0);
+	}
+	{
+		StageTimer timer("export");
+		std::ofstream out(output, std::ios::binary);
+		out.write(reinterpret_cast<const char*>(png.data()), std::streamsize(png.size()));
+		if (!out) {
+			std::cerr << "Cannot write " << output << std::endl;
+			return 1;
+		}
+	}
+	std::printf("[CLI] %dx%d color map, %zu bytes to %s\n", bakeOptions.tileSize, bakeOptions.tileSize, png.size(),
+				output.c_str());
+	return 0;
+}
+
+int runBake(const Options& options) {
+	BakeOptions bakeOptions;
+	bakeOptions.minZoom = options.minZoom;
+	bakeOptions.maxZoom = std::max(options.minZoom, options.maxZoom);
+	if (options.resolution > 0) bakeOptions.tileSize = options.resolution;
+	const std::string output = options.output.empty() ? "tiles" : options.output;
+	WorldGen worldGen(options.seed);
+
+	std::unique_ptr<TileSink> sink;
+	if (output.size() > 8 && output.compare(output.size() - 8, 8, ".pgtiles") == 0)
+		sink = std::make_unique<ArchiveTileSink>(output);
+	else
+		sink = std::make_unique<DirectoryTileSink>(output);
+
+	BakeStats stats;
+	{
+		StageTimer timer("bake");
+		stats = TileBaker(worldGen, bakeOptions).bake(*sink);
+		sink.reset();
+	}
+	std::printf("[CLI] %zu tiles (z%d-z%d) to %s: %.1f tiles/s, peak tile memory %.1f MiB\n", stats.tiles,
+				bakeOptions.minZoom, bakeOptions.maxZoom, output.c_str(), stats.tilesPerSecond,
+				stats.peakBytes / (1024.0 * 1024.0));
+	return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+	if (argc < 2) return usage(argv[0]);
+	Options options;
+	options.command = argv[1];
+	if (options.command != "mesh" && options.command != "texture" && options.command != "bake") return usage(argv[0]);
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--seed" && hasValue) {
+			options.seed = std::stoi(argv[++i]);
+		} else if (arg == "--resolution" && hasValue) {
+			options.resolution = std::max(2, std::stoi(argv[++i]));
+		} else if (arg == "--threads" && hasValue) {
+			options.threads = std::max(1, std::stoi(argv[++i]));
+		} else if (arg == "--output" && hasValue) {
+			options.output = argv[++i];
+		} else if (arg == "--min-zoom" && hasValue) {
+			options.minZoom = std::max(0, std::stoi(argv[++i]));
+		} else if (arg == "--max-zoom" && hasValue) {
+			options.maxZoom = std::max(0, std::stoi(argv[++i]));
+		} else if (arg == "--no-normals") {
+			options.normals = false;
+		} else if (arg == "--counters") {
+			options.counters = true;
+		} else if (arg == "--icosphere") {
+			options.icosphere = true;
+		} else {
+			return usage(argv[0]);
+		}
+	}
+	if (options.threads > 0) TaskScheduler::setThreadCount(options.threads);
+	std::printf("[CLI] %s, seed %d, %d threads\n", options.command.c_str(), options.seed,
+				TaskScheduler::instance().threadCount());
+	if (options.counters) PerfCounters::setEnabled(true);
+
+	int result;
+	if (options.command == "mesh")
+		result = runMesh(options);
+	else if (options.command == "texture")
+		result = runTexture(options);
+	else
+		result = runBake(options);
+
+	for (const WorkerStats& worker : TaskScheduler::instance().stats())
+		if (worker.tasks > 0)
+			std::printf("[CLI] %-14s %6zu tasks, %5zu steals, %5.1f%% busy\n", worker.name.c_str(), worker.tasks,
+						worker.steals, worker.aliveNs ? 100.0 * double(worker.busyNs) / double(worker.aliveNs) : 0.0);
+	if (options.counters) PerfCounters::printSummary();
+	MemoryTracker::printSummary();
+	return result;
+}
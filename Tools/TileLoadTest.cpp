@@ -0,0 +1,176 @@
+// Load test client for the PlanetGen tile server (PlanetGen --serve).
+// Each thread keeps one keep-alive connection and requests random tiles,
+// revalidating previously seen ones with If-None-Match.
+//
+// Usage: PlanetGenLoadTest [port] [threads] [requestsPerThread] [maxZoom]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+struct Result {
+	std::vector<double> latencies;	// Milliseconds
+	size_t ok = 0;
+	size_t notModified = 0;
+	size_t errors = 0;
+	size_t bytes = 0;
+};
+
+int connectTo(int port) {
+	int sock = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(uint16_t(port));
+	if (connect(sock, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+		close(sock);
+		return -1;
+	}
+	int noDelay = 1;
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+	return sock;
+}
+
+// Sends a request and reads the full response. Returns the status code, or -1.
+int request(int sock, const std::string& path, const std::string& etag, std::string& outEtag,
+			size_t& outBytes, std::string& buffer) {
+	std::string req = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n";
+	if (!etag.empty()) req += "If-None-Match: " + etag + "\r\n";
+	req += "\r\n";
+	if (send(sock, req.data(), req.size(), MSG_NOSIGNAL) != ssize_t(req.size())) return -1;
+
+	char chunk[65536];
+	size_t end;
+	while ((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+		ssize_t received = recv(sock, chunk, sizeof(chunk), 0);
+		if (received <= 0) return -1;
+		buffer.append(chunk, size_t(received));
+	}
+	std::string head = buffer.substr(0, end);
+	buffer.erase(0, end + 4);
+
+	int status = 0;
+	std::sscanf(head.c_str(), "HTTP/1.1 %d", &status);
+	size_t length = 0;
+	size_t pos = head.find("Content-Length:");
+	if (pos != std::string::npos) length = std::stoul(head.substr(pos + 15));
+	pos = head.find("ETag:");
+	if (pos != std::string::npos) {
+		size_t lineEnd = head.find("\r\n", pos);
+		outEtag = head.substr(pos + 6, lineEnd == std::string::npos ? std::string::npos : lineEnd - pos - 6);
+	}
+
+	while (buffer.size() < length) {
+		ssize_t received = recv(sock, chunk, sizeof(chunk), 0);
+		if (received <= 0) return -1;
+		buffer.append(chunk, size_t(received));
+	}
+	buffer.erase(0, length);
+	outBytes = length;
+	return status;
+}
+
+void worker(int port, int requests, int maxZoom, unsigned seed, Result& result) {
+	std::mt19937 rng(seed);
+	std::unordered_map<std::string, std::string> etags;
+	std::vector<std::string> seen;
+	std::string buffer;
+
+	int sock = connectTo(port);
+	for (int i = 0; i < requests; i++) {
+		if (sock < 0) {
+			result.errors++;
+			sock = connectTo(port);
+			continue;
+		}
+		std::string path;
+		if (!seen.empty() && rng() % 4 == 0) {
+			path = seen[rng() % seen.size()];
+		} else {
+			int z = int(rng() % (maxZoom + 1));
+			int x = int(rng() % (1u << z)), y = int(rng() % (1u << z));
+			path = std::string(rng() % 2 ? "/color/" : "/elevation/") + std::to_string(z) + "/" +
+				   std::to_string(x) + "/" + std::to_string(y) + ".png";
+		}
+
+		std::string etag;
+		size_t bytes = 0;
+		auto start = std::chrono::steady_clock::now();
+		int status = request(sock, path, etags[path], etag, bytes, buffer);
+		auto end = std::chrono::steady_clock::now();
+
+		if (status == 200) {
+			result.ok++;
+			result.bytes += bytes;
+			etags[path] = etag;
+			seen.push_back(path);
+		} else if (status == 304) {
+			result.notModified++;
+		} else {
+			result.errors++;
+			close(sock);
+			buffer.clear();
+			sock = connectTo(port);
+			continue;
+		}
+		result.latencies.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+	}
+	if (sock >= 0) close(sock);
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+	if (sorted.empty()) return 0.0;
+	size_t index = std::min(sorted.size() - 1, size_t(p * (sorted.size() - 1) + 0.5));
+	return sorted[index];
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+	int port = argc > 1 ? std::stoi(argv[1]) : 8080;
+	int threads = argc > 2 ? std::stoi(argv[2]) : 8;
+	int requests = argc > 3 ? std::stoi(argv[3]) : 200;
+	int maxZoom = argc > 4 ? std::stoi(argv[4]) : 6;
+
+	std::vector<Result> results(threads);
+	std::vector<std::thread> workers;
+	auto start = std::chrono::steady_clock::now();
+	for (int t = 0; t < threads; t++)
+		workers.emplace_back(worker, port, requests, maxZoom, 1234u + t, std::ref(results[t]));
+	for (auto& w : workers) w.join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	Result total;
+	for (const auto& r : results) {
+		total.latencies.insert(total.latencies.end(), r.latencies.begin(), r.latencies.end());
+		total.ok += r.ok;
+		total.notModified += r.notModified;
+		total.errors += r.errors;
+		total.bytes += r.bytes;
+	}
+	std::sort(total.latencies.begin(), total.latencies.end());
+
+	std::printf("%d threads x %d requests (z0-z%d) in %.2f s: %.1f req/s, %.2f MiB received\n", threads,
+				requests, maxZoom, seconds, total.latencies.size() / seconds, total.bytes / (1024.0 * 1024.0));
+	std::printf("200: %zu  304: %zu  errors: %zu\n", total.ok, total.notModified, total.errors);
+	std::printf("latency ms: p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n", percentile(total.latencies, 0.5),
+				percentile(total.latencies, 0.9), percentile(total.latencies, 0.99),
+				total.latencies.empty() ? 0.0 : total.latencies.back());
+	return total.errors == 0 ? 0 : 1;
+}